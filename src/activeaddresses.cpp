@@ -0,0 +1,101 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "activeaddresses.h"
+
+#include <algorithm>
+#include <assert.h>
+
+static void SortUnique(std::vector<uint160>& vAddresses)
+{
+    std::sort(vAddresses.begin(), vAddresses.end());
+    vAddresses.erase(std::unique(vAddresses.begin(), vAddresses.end()), vAddresses.end());
+}
+
+void CActiveAddresses::AddAddresses(const std::vector<uint160>& vAddresses)
+{
+    for (const uint160& address : vAddresses) {
+        mapBlockCount[address]++;
+    }
+}
+
+void CActiveAddresses::RemoveAddresses(const std::vector<uint160>& vAddresses)
+{
+    for (const uint160& address : vAddresses) {
+        auto it = mapBlockCount.find(address);
+        assert(it != mapBlockCount.end());
+        if (--it->second == 0)
+            mapBlockCount.erase(it);
+    }
+}
+
+void CActiveAddresses::PushBack(const uint256& hash, int nHeight, int64_t nTime, std::vector<uint160> vAddresses)
+{
+    SortUnique(vAddresses);
+    LOCK(cs);
+    AddAddresses(vAddresses);
+    blocks.push_back(Block{hash, nHeight, nTime, std::move(vAddresses)});
+    while (blocks.front().nTime <= nTime - nWindow) {
+        RemoveAddresses(blocks.front().vAddresses);
+        blocks.pop_front();
+    }
+}
+
+bool CActiveAddresses::PushFront(const uint256& hash, int nHeight, int64_t nTime, std::vector<uint160> vAddresses)
+{
+    SortUnique(vAddresses);
+    LOCK(cs);
+    if (blocks.empty() || nTime <= blocks.back().nTime - nWindow)
+        return false;
+    AddAddresses(vAddresses);
+    blocks.push_front(Block{hash, nHeight, nTime, std::move(vAddresses)});
+    return true;
+}
+
+bool CActiveAddresses::PopBack()
+{
+    LOCK(cs);
+    if (blocks.empty())
+        return false;
+    RemoveAddresses(blocks.back().vAddresses);
+    blocks.pop_back();
+    return true;
+}
+
+void CActiveAddresses::Clear()
+{
+    LOCK(cs);
+    blocks.clear();
+    mapBlockCount.clear();
+}
+
+bool CActiveAddresses::IsEmpty() const
+{
+    LOCK(cs);
+    return blocks.empty();
+}
+
+uint256 CActiveAddresses::TipHash() const
+{
+    LOCK(cs);
+    return blocks.empty() ? uint256() : blocks.back().hash;
+}
+
+int CActiveAddresses::FrontHeight() const
+{
+    LOCK(cs);
+    return blocks.empty() ? -1 : blocks.front().nHeight;
+}
+
+bool CActiveAddresses::InWindow(int64_t nTime) const
+{
+    LOCK(cs);
+    return !blocks.empty() && nTime > blocks.back().nTime - nWindow;
+}
+
+size_t CActiveAddresses::Count() const
+{
+    LOCK(cs);
+    return mapBlockCount.size();
+}
@@ -0,0 +1,74 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ACTIVEADDRESSES_H
+#define BITCOIN_ACTIVEADDRESSES_H
+
+#include "crypto/common.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <deque>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+/** Blocks are counted in the active addresses for this long after the tip's block time. */
+static const int64_t ACTIVE_ADDRESS_WINDOW = 24 * 60 * 60;
+
+/**
+ * The addresses used by the blocks in a rolling window of block time that
+ * ends at the tip, kept up to date block by block as the tip moves.
+ *
+ * Each block keeps its own (distinct) addresses, and every address counts
+ * the blocks in the window it appears in, so that a block entering or
+ * leaving the window only touches its own addresses.
+ */
+class CActiveAddresses
+{
+public:
+    explicit CActiveAddresses(int64_t nWindowIn) : nWindow(nWindowIn) {}
+
+    /** Add the block on top of the tip, and drop the blocks that fell out of the window behind it. */
+    void PushBack(const uint256& hash, int nHeight, int64_t nTime, std::vector<uint160> vAddresses);
+    /** Add the block before the oldest one. Returns false, without adding it, if it is outside the window. */
+    bool PushFront(const uint256& hash, int nHeight, int64_t nTime, std::vector<uint160> vAddresses);
+    /** Remove the tip block. The window then needs extending at the front, see InWindow. */
+    bool PopBack();
+    void Clear();
+
+    bool IsEmpty() const;
+    /** Hash of the tip block, null if empty. */
+    uint256 TipHash() const;
+    /** Height of the oldest block, -1 if empty. */
+    int FrontHeight() const;
+    /** Whether a block with this time belongs in the window of the current tip. */
+    bool InWindow(int64_t nTime) const;
+
+    /** Number of distinct addresses in the window. */
+    size_t Count() const;
+
+private:
+    struct Block {
+        uint256 hash;
+        int nHeight;
+        int64_t nTime;
+        std::vector<uint160> vAddresses;
+    };
+
+    struct AddressHasher {
+        size_t operator()(const uint160& address) const { return ReadLE64(address.begin()); }
+    };
+
+    void AddAddresses(const std::vector<uint160>& vAddresses);
+    void RemoveAddresses(const std::vector<uint160>& vAddresses);
+
+    const int64_t nWindow;
+
+    mutable CCriticalSection cs;
+    std::deque<Block> blocks;
+    std::unordered_map<uint160, unsigned int, AddressHasher> mapBlockCount;
+};
+
+#endif // BITCOIN_ACTIVEADDRESSES_H
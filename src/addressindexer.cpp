@@ -0,0 +1,150 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindexer.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "txdb.h"
+#include "txmempool.h"
+#include "util.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include <atomic>
+#include <functional>
+
+#include <boost/thread.hpp>
+
+/** Seconds between progress messages of the background build */
+static const int64_t ADDRESS_INDEXER_LOG_INTERVAL = 60;
+
+static std::atomic<bool> fAddressIndexSyncing(false);
+static std::atomic<int> nAddressIndexSyncHeight(0);
+
+bool IsAddressIndexSyncing(int& nHeight)
+{
+    nHeight = nAddressIndexSyncHeight;
+    return fAddressIndexSyncing;
+}
+
+/** Add the address and spent index entries of the mempool transactions. */
+static void IndexMempool()
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(mempool.cs);
+    CCoinsViewMemPool viewMemPool(pcoinsTip, mempool);
+    CCoinsViewCache view(&viewMemPool);
+    for (const CTxMemPoolEntry& entry : mempool.mapTx) {
+        mempool.addAddressIndex(entry, view);
+        mempool.addSpentIndex(entry, view);
+    }
+}
+
+/** Index the active chain up to its tip and hand over to ConnectBlock. Returns false on failure. */
+static bool SyncAddressIndex(const CChainParams& chainparams)
+{
+    const Consensus::Params& consensusParams = chainparams.GetConsensus();
+
+    const CBlockIndex* pindexBest;
+    {
+        LOCK(cs_main);
+        uint256 hashBest;
+        if (pindexdb->ReadAddressIndexSync(hashBest)) {
+            BlockMap::const_iterator it = mapBlockIndex.find(hashBest);
+            if (it == mapBlockIndex.end())
+                return error("%s: the address index was built up to unknown block %s", __func__, hashBest.ToString());
+            pindexBest = it->second;
+            LogPrintf("%s: resuming the address index build after block %d\n", __func__, pindexBest->nHeight);
+        } else {
+            pindexBest = chainActive.Genesis();
+            LogPrintf("%s: building the address index in the background\n", __func__);
+        }
+    }
+    nAddressIndexSyncHeight = pindexBest->nHeight;
+
+    int64_t nLastLog = GetTime();
+    while (true) {
+        boost::this_thread::interruption_point();
+
+        const CBlockIndex* pindex;
+        bool fErase = false;
+        {
+            LOCK(cs_main);
+            if (!chainActive.Contains(pindexBest)) {
+                // A block already indexed was reorganised away, take it back out
+                pindex = pindexBest;
+                fErase = true;
+            } else {
+                pindex = chainActive.Next(pindexBest);
+            }
+
+            if (!pindex) {
+                // Caught up. The last blocks connected while the build was
+                // running are indexed by now, and with cs_main held no other
+                // block can be connected before ConnectBlock takes over.
+                // The progress is only dropped once the flag is written, so
+                // that the build is never started over on a partial index.
+                FlushStateToDisk();
+                if (!pblocktree->WriteFlag("addrbalance", true) || !pblocktree->WriteFlag("addrindex", true))
+                    return error("%s: failed to enable the address index", __func__);
+                pindexdb->WriteAddressIndexSync(uint256());
+                {
+                    // The transactions already in the mempool were accepted
+                    // without the index; add them before any new one is.
+                    LOCK(mempool.cs);
+                    fAddressIndex = true;
+                    IndexMempool();
+                }
+                LoadActiveAddresses(chainparams);
+                LogPrintf("%s: address index built up to block %d\n", __func__, pindexBest->nHeight);
+                return true;
+            }
+        }
+
+        // The block and undo files are only read here, and are never pruned
+        // while the build runs.
+        if (!IndexBlockFromDisk(pindex, fErase, consensusParams))
+            return false;
+        pindexBest = fErase ? pindex->pprev : pindex;
+        pindexdb->WriteAddressIndexSync(pindexBest->GetBlockHash());
+        nAddressIndexSyncHeight = pindexBest->nHeight;
+
+        // Until the hand over, the index writes buffered are the build's
+        // own, so they are written without the chainstate, after the block
+        // index the progress refers to.
+        if (pindexdb->IndexWriteBufferUsage() > nCoinCacheUsage && !FlushIndexesToDisk())
+            return error("%s: failed to write the address index", __func__);
+
+        if (GetTime() - nLastLog >= ADDRESS_INDEXER_LOG_INTERVAL) {
+            LogPrintf("%s: address index built up to block %d\n", __func__, pindexBest->nHeight);
+            nLastLog = GetTime();
+        }
+    }
+}
+
+static void ThreadAddressIndexer(const CChainParams& chainparams)
+{
+    try {
+        if (!SyncAddressIndex(chainparams))
+            LogPrintf("%s: the address index build failed, restart the node to retry it\n", __func__);
+    } catch (const boost::thread_interrupted&) {
+        fAddressIndexSyncing = false;
+        throw;
+    }
+    fAddressIndexSyncing = false;
+}
+
+void StartAddressIndexer(boost::thread_group& threadGroup, const CChainParams& chainparams)
+{
+    if (fAddressIndex || !gArgs.GetBoolArg("-addrindex", false))
+        return;
+    if (fPruneMode) {
+        LogPrintf("%s: the address index cannot be built on a pruned node, use -reindex\n", __func__);
+        return;
+    }
+
+    fAddressIndexSyncing = true;
+    threadGroup.create_thread(boost::bind(&TraceThread<std::function<void()> >, "addrindex", std::function<void()>(std::bind(&ThreadAddressIndexer, std::cref(chainparams)))));
+}
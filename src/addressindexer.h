@@ -0,0 +1,30 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ADDRESSINDEXER_H
+#define BITCOIN_ADDRESSINDEXER_H
+
+class CChainParams;
+
+namespace boost {
+class thread_group;
+} // namespace boost
+
+/**
+ * Start building the address and spent indexes in the background
+ * if -addrindex asks for them on a node whose database does not have them.
+ *
+ * The build walks the active chain from the block and undo files, keeping
+ * its progress in the index database with the entries it has written (see
+ * CIndexDB::ReadAddressIndexSync), and follows reorganisations of
+ * the blocks it has already indexed. Once it reaches the tip it enables
+ * fAddressIndex under cs_main, so that ConnectBlock takes over from the very
+ * next block, and indexes the transactions already in the mempool.
+ */
+void StartAddressIndexer(boost::thread_group& threadGroup, const CChainParams& chainparams);
+
+/** Whether the background build is running, with the height it has indexed up to. */
+bool IsAddressIndexSyncing(int& nHeight);
+
+#endif // BITCOIN_ADDRESSINDEXER_H
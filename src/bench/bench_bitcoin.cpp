@@ -4,7 +4,10 @@
 
 #include "bench.h"
 
+#include "chainparams.h"
 #include "crypto/sha256.h"
+#include "fs.h"
+#include "hash.h"
 #include "key.h"
 #include "validation.h"
 #include "util.h"
@@ -14,12 +17,21 @@ int
 main(int argc, char** argv)
 {
     SHA256AutoDetect();
+    X11AutoDetect();
     RandomInit();
     ECC_Start();
     SetupEnvironment();
+    // The database benchmarks keep their databases in memory, but those are
+    // still named after the data directory, so give them a scratch one.
+    SelectParams(CBaseChainParams::REGTEST);
+    fs::path pathTemp = fs::temp_directory_path() / fs::unique_path("bench_bitcoin_%%%%_%%%%");
+    fs::create_directories(pathTemp);
+    gArgs.ForceSetArg("-datadir", pathTemp.string());
     fPrintToDebugLog = false; // don't want to write to debug.log file
 
     benchmark::BenchRunner::RunAll();
 
+    fs::remove_all(pathTemp);
+
     ECC_Stop();
 }
@@ -0,0 +1,116 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "txdb.h"
+#include "validation.h"
+#include "versionbits.h"
+
+#include <memory>
+#include <vector>
+
+/* Size of the synthetic block index, roughly that of a synced mainnet node. */
+static const int BLOCK_INDEX_ENTRIES = 500000;
+/* The index holds this many interleaved chains, so that the setup can hash
+ * one header of each chain per HashX11Batch call. */
+static const int BLOCK_INDEX_CHAINS = 4;
+
+namespace {
+
+/** An in-memory block tree database filled with BLOCK_INDEX_ENTRIES X11 headers. */
+class BlockIndexFixture
+{
+public:
+    BlockIndexFixture()
+    {
+        db.reset(new CBlockTreeDB(1 << 20, true));
+
+        std::vector<CBlockIndex> vIndex(BLOCK_INDEX_ENTRIES);
+        std::vector<uint256> vHash(BLOCK_INDEX_ENTRIES);
+        CBlockHeader headers[BLOCK_INDEX_CHAINS];
+        for (int i = 0; i < BLOCK_INDEX_ENTRIES; i += BLOCK_INDEX_CHAINS) {
+            for (int j = 0; j < BLOCK_INDEX_CHAINS; j++) {
+                headers[j].nVersion = VERSIONBITS_TOP_BITS | VERSIONBITS_BITCOINX;
+                headers[j].hashPrevBlock = i ? vHash[i + j - BLOCK_INDEX_CHAINS] : uint256();
+                headers[j].nTime = 1500000000 + i;
+                headers[j].nBits = 0x207fffff;
+                headers[j].nNonce = i + j;
+            }
+            HashX11Batch(headers, BLOCK_INDEX_CHAINS, &vHash[i]);
+            for (int j = 0; j < BLOCK_INDEX_CHAINS; j++) {
+                CBlockIndex& index = vIndex[i + j];
+                index.phashBlock = &vHash[i + j];
+                index.pprev = i ? &vIndex[i + j - BLOCK_INDEX_CHAINS] : nullptr;
+                index.nHeight = i / BLOCK_INDEX_CHAINS;
+                index.nVersion = headers[j].nVersion;
+                index.nTime = headers[j].nTime;
+                index.nBits = headers[j].nBits;
+                index.nNonce = headers[j].nNonce;
+                index.nStatus = BLOCK_VALID_TREE;
+                // Proof of stake entries, so loading does not depend on the
+                // synthetic headers meeting their target.
+                index.nFlags = CBlockIndex::BLOCK_PROOF_OF_STAKE;
+            }
+        }
+
+        std::vector<const CBlockIndex*> vBatch;
+        for (const CBlockIndex& index : vIndex) {
+            vBatch.push_back(&index);
+            if (vBatch.size() == 10000) {
+                db->WriteBatchSync({}, 0, vBatch);
+                vBatch.clear();
+            }
+        }
+        db->WriteBatchSync({}, 0, vBatch);
+    }
+
+    std::unique_ptr<CBlockTreeDB> db;
+};
+
+BlockIndexFixture& GetFixture()
+{
+    static BlockIndexFixture fixture;
+    return fixture;
+}
+
+void LoadBlockIndexBench(benchmark::State& state, bool fVerifyHashes)
+{
+    BlockIndexFixture& fixture = GetFixture();
+    const std::unique_ptr<CChainParams> chainParams = CreateChainParams(CBaseChainParams::REGTEST);
+    while (state.KeepRunning()) {
+        BlockMap mapIndex;
+        auto insertBlockIndex = [&mapIndex](const uint256& hash) -> CBlockIndex* {
+            if (hash.IsNull()) return nullptr;
+            BlockMap::iterator mi = mapIndex.find(hash);
+            if (mi != mapIndex.end()) return mi->second;
+            CBlockIndex* pindexNew = new CBlockIndex();
+            mi = mapIndex.insert(std::make_pair(hash, pindexNew)).first;
+            pindexNew->phashBlock = &mi->first;
+            return pindexNew;
+        };
+        assert(fixture.db->LoadBlockIndexGuts(chainParams->GetConsensus(), insertBlockIndex, fVerifyHashes));
+        assert(mapIndex.size() == (size_t)BLOCK_INDEX_ENTRIES);
+        for (const std::pair<const uint256, CBlockIndex*>& item : mapIndex) {
+            delete item.second;
+        }
+    }
+}
+
+} // namespace
+
+static void LoadBlockIndex500k(benchmark::State& state)
+{
+    LoadBlockIndexBench(state, false);
+}
+
+static void LoadBlockIndex500kVerifyHashes(benchmark::State& state)
+{
+    LoadBlockIndexBench(state, true);
+}
+
+BENCHMARK(LoadBlockIndex500k);
+BENCHMARK(LoadBlockIndex500kVerifyHashes);
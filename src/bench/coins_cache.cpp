@@ -0,0 +1,64 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "coins.h"
+#include "random.h"
+#include "script/script.h"
+
+#include <vector>
+
+/* Coins in the cache while measuring, as after a few hundred MB of dbcache. */
+static const int COINS_CACHE_ENTRIES = 1000000;
+
+namespace {
+
+/** A cache holding COINS_CACHE_ENTRIES pay to pubkey hash coins. */
+class CoinsCacheFixture
+{
+public:
+    CoinsCacheFixture() : rng(true), cache(&base)
+    {
+        const CScript script = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG;
+        vOutPoints.reserve(COINS_CACHE_ENTRIES);
+        for (int i = 0; i < COINS_CACHE_ENTRIES; i++) {
+            vOutPoints.emplace_back(rng.rand256(), 0);
+            cache.AddCoin(vOutPoints.back(), Coin(CTxOut(50 * COIN, script), 1, false), false);
+        }
+        coin = Coin(CTxOut(COIN, script), 2, false);
+    }
+
+    FastRandomContext rng;
+    CCoinsView base;
+    CCoinsViewCache cache;
+    std::vector<COutPoint> vOutPoints;
+    Coin coin;
+};
+
+} // namespace
+
+// A coin created and spent in the same block, as in ConnectBlock: the coin
+// is FRESH, so spending it erases it from the cache.
+static void CoinsCacheInsert(benchmark::State& state)
+{
+    CoinsCacheFixture fixture;
+    while (state.KeepRunning()) {
+        const COutPoint outpoint(fixture.rng.rand256(), 0);
+        fixture.cache.AddCoin(outpoint, Coin(fixture.coin), false);
+        fixture.cache.SpendCoin(outpoint);
+    }
+}
+
+static void CoinsCacheLookup(benchmark::State& state)
+{
+    CoinsCacheFixture fixture;
+    while (state.KeepRunning()) {
+        const COutPoint& outpoint = fixture.vOutPoints[fixture.rng.randrange(COINS_CACHE_ENTRIES)];
+        assert(fixture.cache.HaveCoinInCache(outpoint));
+    }
+}
+
+BENCHMARK(CoinsCacheInsert);
+BENCHMARK(CoinsCacheLookup);
@@ -0,0 +1,79 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "coins.h"
+#include "crypto/common.h"
+#include "key.h"
+#include "pubkey.h"
+#include "script/standard.h"
+#include "txdb.h"
+
+#include <memory>
+#include <vector>
+
+/* Coins in the UTXO set, all of them paying to pubkeys, as coinstakes do. */
+static const int P2PK_COINS = 20000;
+/* Stakers the coins pay to. */
+static const int P2PK_STAKERS = 64;
+
+namespace {
+
+/** An in-memory coins database of P2PK_COINS pay to pubkey coins. */
+class P2PKCoinsFixture
+{
+public:
+    explicit P2PKCoinsFixture(bool fCompressed)
+    {
+        db.reset(new CCoinsViewDB(8 << 20, true));
+
+        std::vector<CScript> vScripts;
+        for (int i = 0; i < P2PK_STAKERS; i++) {
+            CKey key;
+            key.MakeNewKey(fCompressed);
+            vScripts.push_back(GetScriptForRawPubKey(key.GetPubKey()));
+        }
+
+        CCoinsViewCache cache(db.get());
+        for (int i = 0; i < P2PK_COINS; i++) {
+            uint256 hash;
+            WriteLE32(hash.begin(), i);
+            vOutPoints.emplace_back(hash, 1);
+            cache.AddCoin(vOutPoints.back(), Coin(CTxOut(50 * COIN, vScripts[i % P2PK_STAKERS]), i, false), false);
+        }
+        cache.SetBestBlock(uint256S("0x01"));
+        assert(cache.Flush());
+    }
+
+    ECCVerifyHandle verifyHandle;
+    std::unique_ptr<CCoinsViewDB> db;
+    std::vector<COutPoint> vOutPoints;
+};
+
+void ReadP2PKCoins(benchmark::State& state, bool fCompressed)
+{
+    P2PKCoinsFixture fixture(fCompressed);
+    while (state.KeepRunning()) {
+        Coin coin;
+        for (const COutPoint& outpoint : fixture.vOutPoints) {
+            assert(fixture.db->GetCoin(outpoint, coin));
+        }
+    }
+}
+
+} // namespace
+
+static void CCoinsViewDBReadP2PK(benchmark::State& state)
+{
+    ReadP2PKCoins(state, false);
+}
+
+static void CCoinsViewDBReadP2PKCompressed(benchmark::State& state)
+{
+    ReadP2PKCoins(state, true);
+}
+
+BENCHMARK(CCoinsViewDBReadP2PK);
+BENCHMARK(CCoinsViewDBReadP2PKCompressed);
@@ -3,10 +3,12 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <iostream>
+#include <string.h>
 
 #include "bench.h"
 #include "bloom.h"
 #include "hash.h"
+#include "primitives/block.h"
 #include "random.h"
 #include "uint256.h"
 #include "utiltime.h"
@@ -14,6 +16,7 @@
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "crypto/sha512.h"
+#include "versionbits.h"
 
 /* Number of bytes to hash per iteration */
 static const uint64_t BUFFER_SIZE = 1000*1000;
@@ -60,6 +63,138 @@ static void SHA512(benchmark::State& state)
         CSHA512().Write(in.data(), in.size()).Finalize(hash);
 }
 
+static void X11_80b(benchmark::State& state)
+{
+    std::vector<uint8_t> in(80,0);
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000; i++) {
+            uint256 hash = HashX11(in.begin(), in.end());
+            memcpy(&in[0], hash.begin(), 32);
+        }
+    }
+}
+
+/* The AES based X11 stages, as dispatched by X11AutoDetect(), on one
+ * 64-byte intermediate hash. */
+static void X11Groestl512_64b(benchmark::State& state)
+{
+    uint8_t buf[64] = {0};
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000; i++) {
+            X11Groestl512(buf, buf);
+        }
+    }
+}
+
+static void X11Shavite512_64b(benchmark::State& state)
+{
+    uint8_t buf[64] = {0};
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000; i++) {
+            X11Shavite512(buf, buf);
+        }
+    }
+}
+
+static void X11Echo512_64b(benchmark::State& state)
+{
+    uint8_t buf[64] = {0};
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000; i++) {
+            X11Echo512(buf, buf);
+        }
+    }
+}
+
+static CBlockHeader BenchBlockHeader()
+{
+    CBlockHeader header;
+    header.nVersion = VERSIONBITS_TOP_BITS | VERSIONBITS_BITCOINX;
+    header.nTime = 1500000000;
+    header.nBits = 0x1d00ffff;
+    return header;
+}
+
+/* CBlockHeader::GetHash() on a header not hashed before, as when received. */
+static void X11BlockHeaderHash(benchmark::State& state)
+{
+    CBlockHeader header = BenchBlockHeader();
+    uint256 hash;
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000; i++) {
+            header.nNonce++;
+            header.hashCache.Reset();
+            hash = header.GetHash();
+        }
+    }
+}
+
+/* CBlockHeader::GetHash() again on a header already hashed. */
+static void X11BlockHeaderHashCached(benchmark::State& state)
+{
+    CBlockHeader header = BenchBlockHeader();
+    uint256 hash = header.GetHash();
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000; i++) {
+            hash = header.GetHash();
+        }
+    }
+}
+
+/* Number of headers hashed per iteration of the header batch benchmarks. */
+static const size_t HEADER_BATCH_SIZE = 2000;
+
+static void X11HeadersScalar(benchmark::State& state)
+{
+    std::vector<unsigned char> in(80 * HEADER_BATCH_SIZE, 0);
+    std::vector<uint256> out(HEADER_BATCH_SIZE);
+    for (size_t i = 0; i < in.size(); i++) in[i] = (unsigned char)i;
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < HEADER_BATCH_SIZE; i++) {
+            out[i] = HashX11(in.begin() + 80 * i, in.begin() + 80 * (i + 1));
+        }
+    }
+}
+
+static void X11HeadersBatch(benchmark::State& state)
+{
+    std::vector<unsigned char> in(80 * HEADER_BATCH_SIZE, 0);
+    std::vector<uint256> out(HEADER_BATCH_SIZE);
+    for (size_t i = 0; i < in.size(); i++) in[i] = (unsigned char)i;
+    while (state.KeepRunning()) {
+        HashX11Batch80(in.data(), HEADER_BATCH_SIZE, out.data());
+    }
+}
+
+/* One X11 stage with a 4-way AVX2 kernel, on four lanes, through sph one lane
+ * at a time or through the kernel. The AVX2 variants report nothing when the
+ * CPU (or the build) has no AVX2. */
+template<X11Stage4Way STAGE, bool AVX2>
+static void X11StageBench(benchmark::State& state)
+{
+    unsigned char in[4 * 80], out[4 * 64];
+    for (size_t i = 0; i < sizeof(in); i++) in[i] = (unsigned char)i;
+    if (!X11Stage4Lanes(STAGE, AVX2, out, in))
+        return;
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000; i++) {
+            X11Stage4Lanes(STAGE, AVX2, out, in);
+            memcpy(in, out, sizeof(out));
+        }
+    }
+}
+
+static void X11Blake512_4x80b(benchmark::State& state) { X11StageBench<X11Stage4Way::BLAKE512, false>(state); }
+static void X11Blake512_4x80b_AVX2(benchmark::State& state) { X11StageBench<X11Stage4Way::BLAKE512, true>(state); }
+static void X11Bmw512_4x64b(benchmark::State& state) { X11StageBench<X11Stage4Way::BMW512, false>(state); }
+static void X11Bmw512_4x64b_AVX2(benchmark::State& state) { X11StageBench<X11Stage4Way::BMW512, true>(state); }
+static void X11Skein512_4x64b(benchmark::State& state) { X11StageBench<X11Stage4Way::SKEIN512, false>(state); }
+static void X11Skein512_4x64b_AVX2(benchmark::State& state) { X11StageBench<X11Stage4Way::SKEIN512, true>(state); }
+static void X11Keccak512_4x64b(benchmark::State& state) { X11StageBench<X11Stage4Way::KECCAK512, false>(state); }
+static void X11Keccak512_4x64b_AVX2(benchmark::State& state) { X11StageBench<X11Stage4Way::KECCAK512, true>(state); }
+static void X11CubeHash512_4x64b(benchmark::State& state) { X11StageBench<X11Stage4Way::CUBEHASH512, false>(state); }
+static void X11CubeHash512_4x64b_AVX2(benchmark::State& state) { X11StageBench<X11Stage4Way::CUBEHASH512, true>(state); }
+
 static void SipHash_32b(benchmark::State& state)
 {
     uint256 x;
@@ -96,6 +231,24 @@ BENCHMARK(RIPEMD160);
 BENCHMARK(SHA1);
 BENCHMARK(SHA256);
 BENCHMARK(SHA512);
+BENCHMARK(X11_80b);
+BENCHMARK(X11Groestl512_64b);
+BENCHMARK(X11Shavite512_64b);
+BENCHMARK(X11Echo512_64b);
+BENCHMARK(X11BlockHeaderHash);
+BENCHMARK(X11BlockHeaderHashCached);
+BENCHMARK(X11HeadersScalar);
+BENCHMARK(X11HeadersBatch);
+BENCHMARK(X11Blake512_4x80b);
+BENCHMARK(X11Blake512_4x80b_AVX2);
+BENCHMARK(X11Bmw512_4x64b);
+BENCHMARK(X11Bmw512_4x64b_AVX2);
+BENCHMARK(X11Skein512_4x64b);
+BENCHMARK(X11Skein512_4x64b_AVX2);
+BENCHMARK(X11Keccak512_4x64b);
+BENCHMARK(X11Keccak512_4x64b_AVX2);
+BENCHMARK(X11CubeHash512_4x64b);
+BENCHMARK(X11CubeHash512_4x64b_AVX2);
 
 BENCHMARK(SHA256_32b);
 BENCHMARK(SipHash_32b);
@@ -0,0 +1,80 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "random.h"
+#include "script/indexaddress.h"
+#include "script/script.h"
+
+#include <vector>
+
+/* Scripts of the synthetic block: the inputs' previous outputs and the outputs. */
+static const int INDEX_ADDRESS_SCRIPTS = 2000;
+/* Stakers in the block, each spending and paying to its own pubkey. */
+static const int INDEX_ADDRESS_STAKERS = 4;
+
+/** A block's worth of scripts, a quarter of them pay to pubkey scripts of a few stakers. */
+static std::vector<CScript> IndexAddressBlockScripts()
+{
+    FastRandomContext rng(true);
+    std::vector<std::vector<unsigned char> > vPubKeys;
+    for (int i = 0; i < INDEX_ADDRESS_STAKERS; i++) {
+        std::vector<unsigned char> vch(33);
+        vch[0] = 0x02;
+        for (size_t j = 1; j < vch.size(); j++) {
+            vch[j] = rng.rand32();
+        }
+        vPubKeys.push_back(vch);
+    }
+
+    std::vector<CScript> vScripts;
+    for (int i = 0; i < INDEX_ADDRESS_SCRIPTS; i++) {
+        std::vector<unsigned char> vchHash(20);
+        for (unsigned char& ch : vchHash) {
+            ch = rng.rand32();
+        }
+        switch (i % 4) {
+        case 0:
+            vScripts.push_back(CScript() << vPubKeys[(i / 4) % INDEX_ADDRESS_STAKERS] << OP_CHECKSIG);
+            break;
+        case 1:
+            vScripts.push_back(CScript() << OP_HASH160 << vchHash << OP_EQUAL);
+            break;
+        default:
+            vScripts.push_back(CScript() << OP_DUP << OP_HASH160 << vchHash << OP_EQUALVERIFY << OP_CHECKSIG);
+            break;
+        }
+    }
+    return vScripts;
+}
+
+static void IndexAddressExtract(benchmark::State& state)
+{
+    const std::vector<CScript> vScripts = IndexAddressBlockScripts();
+    uint160 hash;
+    int addressType;
+    while (state.KeepRunning()) {
+        for (const CScript& script : vScripts) {
+            ExtractIndexAddress(script, addressType, hash);
+        }
+    }
+}
+
+static void IndexAddressExtractMemo(benchmark::State& state)
+{
+    const std::vector<CScript> vScripts = IndexAddressBlockScripts();
+    uint160 hash;
+    int addressType;
+    while (state.KeepRunning()) {
+        // One extractor per block, as in ConnectBlock
+        CIndexAddressExtractor extractor;
+        for (const CScript& script : vScripts) {
+            extractor.Extract(script, addressType, hash);
+        }
+    }
+}
+
+BENCHMARK(IndexAddressExtract);
+BENCHMARK(IndexAddressExtractMemo);
@@ -0,0 +1,107 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blocktimeindex.h"
+
+#include "chain.h"
+
+#include <algorithm>
+
+unsigned int CBlockTimeIndex::LogicalTime(const CBlockIndex* pindex, unsigned int nPrevLogicalTime)
+{
+    return std::max(pindex->nTime, nPrevLogicalTime + 1);
+}
+
+bool CBlockTimeIndex::Connect(const CBlockIndex* pindex)
+{
+    LOCK(cs);
+    if (pindex->pprev != (vChain.empty() ? nullptr : vChain.back().pindex))
+        return false;
+    const unsigned int nLogicalTime = LogicalTime(pindex, vChain.empty() ? 0 : vChain.back().nLogicalTime);
+    // A stale block coming back to the active chain
+    auto range = mapStale.equal_range(nLogicalTime);
+    for (auto it = range.first; it != range.second; it++) {
+        if (it->second == pindex) {
+            mapStale.erase(it);
+            break;
+        }
+    }
+    vChain.push_back(Block{pindex, nLogicalTime});
+    return true;
+}
+
+bool CBlockTimeIndex::Disconnect(const CBlockIndex* pindex)
+{
+    LOCK(cs);
+    if (vChain.empty() || vChain.back().pindex != pindex)
+        return false;
+    mapStale.emplace(vChain.back().nLogicalTime, pindex);
+    vChain.pop_back();
+    return true;
+}
+
+void CBlockTimeIndex::Load(const CBlockIndex* pindexTip, const std::vector<const CBlockIndex*>& vStale)
+{
+    LOCK(cs);
+    vChain.clear();
+    mapStale.clear();
+    if (pindexTip == nullptr)
+        return;
+
+    vChain.resize(pindexTip->nHeight + 1);
+    for (const CBlockIndex* pindex = pindexTip; pindex; pindex = pindex->pprev) {
+        vChain[pindex->nHeight].pindex = pindex;
+    }
+    unsigned int nLogicalTime = 0;
+    for (Block& block : vChain) {
+        nLogicalTime = block.nLogicalTime = LogicalTime(block.pindex, nLogicalTime);
+    }
+
+    // Parents before children, so that each finds its parent's time.
+    std::vector<const CBlockIndex*> vSorted(vStale);
+    std::sort(vSorted.begin(), vSorted.end(), [](const CBlockIndex* a, const CBlockIndex* b) { return a->nHeight < b->nHeight; });
+    std::map<const CBlockIndex*, unsigned int> mapLogicalTime;
+    for (const CBlockIndex* pindex : vSorted) {
+        unsigned int nPrevLogicalTime = 0;
+        const CBlockIndex* pprev = pindex->pprev;
+        if (pprev && pprev->nHeight < (int)vChain.size() && vChain[pprev->nHeight].pindex == pprev) {
+            nPrevLogicalTime = vChain[pprev->nHeight].nLogicalTime;
+        } else if (pprev && mapLogicalTime.count(pprev)) {
+            nPrevLogicalTime = mapLogicalTime[pprev];
+        }
+        nLogicalTime = LogicalTime(pindex, nPrevLogicalTime);
+        mapLogicalTime[pindex] = nLogicalTime;
+        mapStale.emplace(nLogicalTime, pindex);
+    }
+}
+
+void CBlockTimeIndex::Clear()
+{
+    LOCK(cs);
+    vChain.clear();
+    mapStale.clear();
+}
+
+void CBlockTimeIndex::Find(unsigned int nHigh, unsigned int nLow, bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> >& hashes) const
+{
+    LOCK(cs);
+    const size_t nBegin = hashes.size();
+    auto it = std::lower_bound(vChain.begin(), vChain.end(), nLow, [](const Block& block, unsigned int nTime) { return block.nLogicalTime < nTime; });
+    for (; it != vChain.end() && it->nLogicalTime < nHigh; it++) {
+        hashes.emplace_back(it->pindex->GetBlockHash(), it->nLogicalTime);
+    }
+    if (fActiveOnly)
+        return;
+
+    bool fStale = false;
+    for (auto its = mapStale.lower_bound(nLow); its != mapStale.end() && its->first < nHigh; its++) {
+        hashes.emplace_back(its->second->GetBlockHash(), its->first);
+        fStale = true;
+    }
+    if (fStale) {
+        std::sort(hashes.begin() + nBegin, hashes.end(), [](const std::pair<uint256, unsigned int>& a, const std::pair<uint256, unsigned int>& b) {
+            return a.second < b.second || (a.second == b.second && a.first < b.first);
+        });
+    }
+}
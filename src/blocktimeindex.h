@@ -0,0 +1,58 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKTIMEINDEX_H
+#define BITCOIN_BLOCKTIMEINDEX_H
+
+#include "sync.h"
+#include "uint256.h"
+
+#include <map>
+#include <utility>
+#include <vector>
+
+class CBlockIndex;
+
+/**
+ * The logical timestamps of the blocks that have been connected, for
+ * getblockhashes. A block's logical timestamp is its time, raised to one
+ * more than its parent's logical timestamp where it is not later, so that
+ * they strictly increase along every chain.
+ *
+ * The active chain is kept as a vector by height, which is therefore
+ * sorted by logical timestamp and searched by bisection. The few blocks
+ * that were connected but are no longer in the active chain are kept
+ * apart, by logical timestamp.
+ */
+class CBlockTimeIndex
+{
+public:
+    /** Add the block just connected on top of the active chain. Returns false, without adding it, if it does not extend the chain kept. */
+    bool Connect(const CBlockIndex* pindex);
+    /** Take the block just disconnected off the active chain, keeping it as a stale block. Returns false if it is not the tip kept. */
+    bool Disconnect(const CBlockIndex* pindex);
+    /** Start over from the active chain ending at pindexTip and the other connected blocks. */
+    void Load(const CBlockIndex* pindexTip, const std::vector<const CBlockIndex*>& vStale);
+    void Clear();
+
+    /**
+     * Hashes and logical timestamps of the blocks with logical timestamps
+     * in [nLow, nHigh), in order, optionally only those of the active chain.
+     */
+    void Find(unsigned int nHigh, unsigned int nLow, bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> >& hashes) const;
+
+private:
+    struct Block {
+        const CBlockIndex* pindex;
+        unsigned int nLogicalTime;
+    };
+
+    static unsigned int LogicalTime(const CBlockIndex* pindex, unsigned int nPrevLogicalTime);
+
+    mutable CCriticalSection cs;
+    std::vector<Block> vChain;
+    std::multimap<unsigned int, const CBlockIndex*> mapStale;
+};
+
+#endif // BITCOIN_BLOCKTIMEINDEX_H
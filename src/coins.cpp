@@ -34,7 +34,7 @@ size_t CCoinsViewBacked::EstimateSize() const { return base->EstimateSize(); }
 
 SaltedOutpointHasher::SaltedOutpointHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0) {}
+CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cacheCoins(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), CCoinsMap::allocator_type(&cacheCoinsResource)), cachedCoinsUsage(0) {}
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
     return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
@@ -135,6 +135,15 @@ bool CCoinsViewCache::HaveCoinInCache(const COutPoint &outpoint) const {
     return (it != cacheCoins.end() && !it->second.coin.IsSpent());
 }
 
+void CCoinsViewCache::AddFetchedCoin(const COutPoint &outpoint, Coin&& coin) {
+    assert(!coin.IsSpent());
+    std::pair<CCoinsMap::iterator, bool> inserted = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::tuple<>());
+    if (!inserted.second)
+        return;
+    inserted.first->second.coin = std::move(coin);
+    cachedCoinsUsage += inserted.first->second.coin.DynamicMemoryUsage();
+}
+
 uint256 CCoinsViewCache::GetBestBlock() const {
     if (hashBlock.IsNull())
         hashBlock = base->GetBestBlock();
@@ -203,11 +212,44 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
 
 bool CCoinsViewCache::Flush() {
     bool fOk = base->BatchWrite(cacheCoins, hashBlock);
-    cacheCoins.clear();
-    cachedCoinsUsage = 0;
+    ReallocateCache();
     return fOk;
 }
 
+void CCoinsViewCache::ReallocateCache() {
+    // The pool keeps the chunks of freed nodes, and the map can be neither
+    // assigned nor swapped, so both are made anew in place.
+    cacheCoins.~CCoinsMap();
+    cacheCoinsResource.~CCoinsMapMemoryResource();
+    ::new (&cacheCoinsResource) CCoinsMapMemoryResource();
+    ::new (&cacheCoins) CCoinsMap(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), CCoinsMap::allocator_type(&cacheCoinsResource));
+    cachedCoinsUsage = 0;
+}
+
+size_t CCoinsViewCache::TakeDirty(CCoinsMap &mapDirty, size_t nKeepUsage) {
+    std::vector<std::pair<COutPoint, CCoinsCacheEntry> > vKeep;
+    size_t nKept = 0;
+    size_t nDirtyUsage = 0;
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end(); it++) {
+        const size_t nUsage = it->second.coin.DynamicMemoryUsage();
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            mapDirty.emplace(it->first, std::move(it->second));
+            nDirtyUsage += nUsage;
+        } else if (!it->second.coin.IsSpent() && nKept + nUsage <= nKeepUsage) {
+            vKeep.emplace_back(it->first, std::move(it->second));
+            nKept += nUsage;
+        }
+    }
+    // The kept coins move to a new pool, so that the old one can be freed
+    ReallocateCache();
+    cacheCoins.reserve(vKeep.size());
+    for (auto& entry : vKeep) {
+        cacheCoins.emplace(entry.first, std::move(entry.second));
+    }
+    cachedCoinsUsage = nKept;
+    return memusage::DynamicUsage(mapDirty) + nDirtyUsage;
+}
+
 void CCoinsViewCache::Uncache(const COutPoint& hash)
 {
     CCoinsMap::iterator it = cacheCoins.find(hash);
@@ -12,6 +12,7 @@
 #include "hash.h"
 #include "memusage.h"
 #include "serialize.h"
+#include "support/allocators/pool.h"
 #include "uint256.h"
 
 #include <assert.h>
@@ -192,7 +193,16 @@ struct CCoinsCacheEntry
     explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+/**
+ * The nodes of a CCoinsMap come from a pool, sized for the node, which also
+ * holds the next pointer and the cached hash of the map.
+ */
+typedef PoolAllocator<std::pair<const COutPoint, CCoinsCacheEntry>,
+                      sizeof(std::pair<const COutPoint, CCoinsCacheEntry>) + sizeof(void*) * 4,
+                      alignof(void*)>
+    CCoinsMapAllocator;
+typedef CCoinsMapAllocator::ResourceType CCoinsMapMemoryResource;
+typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher, std::equal_to<COutPoint>, CCoinsMapAllocator> CCoinsMap;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -279,6 +289,8 @@ protected:
      * declared as "const".  
      */
     mutable uint256 hashBlock;
+    //! Where cacheCoins allocates its nodes, so declared before it
+    mutable CCoinsMapMemoryResource cacheCoinsResource;
     mutable CCoinsMap cacheCoins;
 
     /* Cached dynamic memory usage for the inner Coin objects. */
@@ -304,6 +316,13 @@ public:
      */
     bool HaveCoinInCache(const COutPoint &outpoint) const;
 
+    /**
+     * Add a coin read from the base view on this cache's behalf, as a cache
+     * miss would have, so that the reads can be done ahead of time and in
+     * parallel. Does nothing if the outpoint is already in the cache.
+     */
+    void AddFetchedCoin(const COutPoint &outpoint, Coin&& coin);
+
     /**
      * Return a reference to Coin in the cache, or a pruned one if not found. This is
      * more efficient than GetCoin.
@@ -336,6 +355,15 @@ public:
      */
     bool Flush();
 
+    /**
+     * Move the modifications applied to this cache out to mapDirty, for the
+     * caller to push to the base, and keep unspent unmodified coins up to
+     * nKeepUsage bytes of them, so that the cache does not start over cold.
+     * Returns the memory used by mapDirty. Until mapDirty is in the base,
+     * the base has to serve its coins itself.
+     */
+    size_t TakeDirty(CCoinsMap &mapDirty, size_t nKeepUsage);
+
     /**
      * Removes the UTXO with the given outpoint from the cache, if it is
      * not modified.
@@ -364,6 +392,9 @@ public:
 private:
     CCoinsMap::iterator FetchCoin(const COutPoint &outpoint) const;
 
+    /** Empty the cache and give its pool's memory back */
+    void ReallocateCache();
+
     /**
      * By making the copy constructor private, we prevent accidentally using it when one intends to create a cache on top of a base cache.
      */
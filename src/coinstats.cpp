@@ -0,0 +1,53 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinstats.h"
+
+#include "serialize.h"
+#include "version.h"
+
+#include <assert.h>
+
+CCoinsStatsHasher::CCoinsStatsHasher(CCoinsStats& statsIn, const uint256& hashBlock) : stats(statsIn), ss(SER_GETHASH, PROTOCOL_VERSION)
+{
+    stats.hashBlock = hashBlock;
+    ss << hashBlock;
+}
+
+void CCoinsStatsHasher::Add(const COutPoint& outpoint, Coin&& coin)
+{
+    if (!outputs.empty() && outpoint.hash != prevkey) {
+        ApplyStats();
+        outputs.clear();
+    }
+    prevkey = outpoint.hash;
+    outputs[outpoint.n] = std::move(coin);
+}
+
+void CCoinsStatsHasher::Finalize()
+{
+    if (!outputs.empty()) {
+        ApplyStats();
+        outputs.clear();
+    }
+    stats.hashSerialized = ss.GetHash();
+}
+
+void CCoinsStatsHasher::ApplyStats()
+{
+    assert(!outputs.empty());
+    ss << prevkey;
+    ss << VARINT(outputs.begin()->second.nHeight * 2 + outputs.begin()->second.fCoinBase);
+    stats.nTransactions++;
+    for (const auto& output : outputs) {
+        ss << VARINT(output.first + 1);
+        ss << output.second.out.scriptPubKey;
+        ss << VARINT(output.second.out.nValue);
+        stats.nTransactionOutputs++;
+        stats.nTotalAmount += output.second.out.nValue;
+        stats.nBogoSize += 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
+                           2 /* scriptPubKey len */ + output.second.out.scriptPubKey.size() /* scriptPubKey */;
+    }
+    ss << VARINT(0);
+}
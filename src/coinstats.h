@@ -0,0 +1,53 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSTATS_H
+#define BITCOIN_COINSTATS_H
+
+#include "amount.h"
+#include "coins.h"
+#include "hash.h"
+#include "uint256.h"
+
+#include <map>
+#include <stdint.h>
+
+struct CCoinsStats
+{
+    int nHeight;
+    uint256 hashBlock;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    uint64_t nBogoSize;
+    uint256 hashSerialized;
+    uint64_t nDiskSize;
+    CAmount nTotalAmount;
+
+    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nTotalAmount(0) {}
+};
+
+/**
+ * Computes the statistics of a UTXO set, and its serialized hash as shown
+ * by gettxoutsetinfo, from its coins in the order of the coins database,
+ * where the outputs of a transaction are next to each other.
+ */
+class CCoinsStatsHasher
+{
+public:
+    CCoinsStatsHasher(CCoinsStats& statsIn, const uint256& hashBlock);
+
+    void Add(const COutPoint& outpoint, Coin&& coin);
+    /** Account for the last transaction and set stats.hashSerialized. */
+    void Finalize();
+
+private:
+    void ApplyStats();
+
+    CCoinsStats& stats;
+    CHashWriter ss;
+    uint256 prevkey;
+    std::map<uint32_t, Coin> outputs;
+};
+
+#endif // BITCOIN_COINSTATS_H
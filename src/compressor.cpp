@@ -5,10 +5,69 @@
 
 #include "compressor.h"
 
+#include "crypto/common.h"
 #include "hash.h"
 #include "pubkey.h"
 #include "script/standard.h"
 
+#include <mutex>
+#include <string.h>
+
+namespace {
+
+/**
+ * Recently decompressed pubkeys of uncompressed pay to pubkey scripts,
+ * shared by every reader of compressed scripts: the coins database and the
+ * undo data. Each decompression is an EC square root, and the same stakers'
+ * keys come back with every coinstake.
+ */
+class CDecompressedPubKeyCache
+{
+public:
+    /** Copy the uncompressed form of the compressed pubkey vch to vchFull, if known. */
+    bool Get(const unsigned char* vch, unsigned char* vchFull)
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        const Slot& slot = slots[SlotIndex(vch)];
+        if (!slot.fUsed || memcmp(slot.vch, vch, sizeof(slot.vch)) != 0)
+            return false;
+        memcpy(vchFull, slot.vchFull, sizeof(slot.vchFull));
+        return true;
+    }
+
+    void Add(const unsigned char* vch, const unsigned char* vchFull)
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        Slot& slot = slots[SlotIndex(vch)];
+        memcpy(slot.vch, vch, sizeof(slot.vch));
+        memcpy(slot.vchFull, vchFull, sizeof(slot.vchFull));
+        slot.fUsed = true;
+    }
+
+private:
+    static const size_t SLOTS = 4096;
+
+    struct Slot {
+        bool fUsed;
+        unsigned char vch[33];
+        unsigned char vchFull[65];
+    };
+
+    /** The x coordinate is as good as random, so its first bytes pick the slot. */
+    static size_t SlotIndex(const unsigned char* vch) { return ReadLE32(vch + 1) % SLOTS; }
+
+    std::mutex mut;
+    Slot slots[SLOTS] = {};
+};
+
+CDecompressedPubKeyCache& GetDecompressedPubKeyCache()
+{
+    static CDecompressedPubKeyCache cache;
+    return cache;
+}
+
+} // namespace
+
 bool CScriptCompressor::IsToKeyID(CKeyID &hash) const
 {
     if (script.size() == 25 && script[0] == OP_DUP && script[1] == OP_HASH160
@@ -117,13 +176,18 @@ bool CScriptCompressor::Decompress(unsigned int nSize, const std::vector<unsigne
         unsigned char vch[33] = {};
         vch[0] = nSize - 2;
         memcpy(&vch[1], in.data(), 32);
-        CPubKey pubkey(&vch[0], &vch[33]);
-        if (!pubkey.Decompress())
-            return false;
-        assert(pubkey.size() == 65);
+        unsigned char vchFull[65];
+        if (!GetDecompressedPubKeyCache().Get(vch, vchFull)) {
+            CPubKey pubkey(&vch[0], &vch[33]);
+            if (!pubkey.Decompress())
+                return false;
+            assert(pubkey.size() == 65);
+            memcpy(vchFull, pubkey.begin(), 65);
+            GetDecompressedPubKeyCache().Add(vch, vchFull);
+        }
         script.resize(67);
         script[0] = 65;
-        memcpy(&script[1], pubkey.begin(), 65);
+        memcpy(&script[1], vchFull, 65);
         script[66] = OP_CHECKSIG;
         return true;
     }
@@ -0,0 +1,380 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// This is an AES-NI implementation of the X11 stages that are built on the AES
+// round function (Groestl, SHAvite-3 and ECHO). Every function hashes a single
+// 64-byte message, which is what X11 feeds them, and produces output that is
+// bit-identical to the corresponding sph_*512 function.
+
+#ifdef ENABLE_AESNI
+
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+namespace x11_aesni {
+namespace {
+
+/** Multiply every byte by x in GF(2^8) modulo the AES polynomial. */
+inline __m128i XTime(__m128i a)
+{
+    const __m128i hi = _mm_cmpgt_epi8(_mm_setzero_si128(), a);
+    return _mm_xor_si128(_mm_add_epi8(a, a), _mm_and_si128(hi, _mm_set1_epi8(0x1b)));
+}
+
+/** Groestl-512 */
+namespace groestl {
+
+/** The 1024-bit state is kept as its eight rows, one 16-byte row per register. */
+typedef __m128i State[8];
+
+/** Shuffles that undo AES ShiftRows (applied by aesenclast together with
+ *  SubBytes) and rotate a row left by the Groestl ShiftBytes amount instead. */
+struct ShiftMasks
+{
+    __m128i p[8], q[8];
+
+    ShiftMasks()
+    {
+        static const int SHIFT_P[8] = {0, 1, 2, 3, 4, 5, 6, 11};
+        static const int SHIFT_Q[8] = {1, 3, 5, 11, 0, 2, 4, 6};
+        for (int i = 0; i < 8; i++) {
+            p[i] = Mask(SHIFT_P[i]);
+            q[i] = Mask(SHIFT_Q[i]);
+        }
+    }
+
+    static __m128i Mask(int shift)
+    {
+        alignas(16) unsigned char m[16];
+        for (int j = 0; j < 16; j++) {
+            // aesenclast moves byte r + 4c to r + 4(c - r); 13 * k mod 16 is that map.
+            m[j] = (13 * (j + shift)) & 15;
+        }
+        return _mm_load_si128((const __m128i*)m);
+    }
+};
+
+const ShiftMasks& Masks()
+{
+    static const ShiftMasks masks;
+    return masks;
+}
+
+/** One row of MixBytes: 2*a[i] ^ 2*a[i+1] ^ 3*a[i+2] ^ 4*a[i+3] ^ 5*a[i+4] ^ 3*a[i+5] ^ 5*a[i+6] ^ 7*a[i+7],
+ *  evaluated as x*(x*p ^ q) ^ r with p, q and r the rows carrying each bit of
+ *  the coefficients. t[i] is a[i] ^ a[i+1]. */
+template<int i>
+inline __m128i MixRow(const __m128i* a, const __m128i* t)
+{
+    __m128i p = _mm_xor_si128(t[(i + 3) & 7], t[(i + 6) & 7]);
+    __m128i q = _mm_xor_si128(_mm_xor_si128(t[i], a[(i + 2) & 7]), _mm_xor_si128(a[(i + 5) & 7], a[(i + 7) & 7]));
+    __m128i r = _mm_xor_si128(a[(i + 2) & 7], _mm_xor_si128(t[(i + 4) & 7], t[(i + 6) & 7]));
+    return _mm_xor_si128(XTime(_mm_xor_si128(XTime(p), q)), r);
+}
+
+template<int i>
+inline __m128i SubShift(__m128i a, const __m128i* mask)
+{
+    return _mm_shuffle_epi8(_mm_aesenclast_si128(a, _mm_setzero_si128()), mask[i]);
+}
+
+/** SubBytes, ShiftBytes and MixBytes of one round. */
+inline void SubShiftMix(State a, const __m128i* mask)
+{
+    __m128i s[8], t[8];
+    s[0] = SubShift<0>(a[0], mask);
+    s[1] = SubShift<1>(a[1], mask);
+    s[2] = SubShift<2>(a[2], mask);
+    s[3] = SubShift<3>(a[3], mask);
+    s[4] = SubShift<4>(a[4], mask);
+    s[5] = SubShift<5>(a[5], mask);
+    s[6] = SubShift<6>(a[6], mask);
+    s[7] = SubShift<7>(a[7], mask);
+    t[0] = _mm_xor_si128(s[0], s[1]);
+    t[1] = _mm_xor_si128(s[1], s[2]);
+    t[2] = _mm_xor_si128(s[2], s[3]);
+    t[3] = _mm_xor_si128(s[3], s[4]);
+    t[4] = _mm_xor_si128(s[4], s[5]);
+    t[5] = _mm_xor_si128(s[5], s[6]);
+    t[6] = _mm_xor_si128(s[6], s[7]);
+    t[7] = _mm_xor_si128(s[7], s[0]);
+    a[0] = MixRow<0>(s, t);
+    a[1] = MixRow<1>(s, t);
+    a[2] = MixRow<2>(s, t);
+    a[3] = MixRow<3>(s, t);
+    a[4] = MixRow<4>(s, t);
+    a[5] = MixRow<5>(s, t);
+    a[6] = MixRow<6>(s, t);
+    a[7] = MixRow<7>(s, t);
+}
+
+inline void RoundP(State a, int r, const ShiftMasks& masks)
+{
+    const __m128i col = _mm_setr_epi8(0x00, 0x10, 0x20, 0x30, 0x40, 0x50, 0x60, 0x70,
+                                      (char)0x80, (char)0x90, (char)0xa0, (char)0xb0,
+                                      (char)0xc0, (char)0xd0, (char)0xe0, (char)0xf0);
+    a[0] = _mm_xor_si128(a[0], _mm_xor_si128(col, _mm_set1_epi8(r)));
+    SubShiftMix(a, masks.p);
+}
+
+inline void RoundQ(State a, int r, const ShiftMasks& masks)
+{
+    const __m128i ones = _mm_set1_epi8((char)0xff);
+    const __m128i col = _mm_setr_epi8((char)0xff, (char)0xef, (char)0xdf, (char)0xcf,
+                                      (char)0xbf, (char)0xaf, (char)0x9f, (char)0x8f,
+                                      0x7f, 0x6f, 0x5f, 0x4f, 0x3f, 0x2f, 0x1f, 0x0f);
+    a[0] = _mm_xor_si128(a[0], ones);
+    a[1] = _mm_xor_si128(a[1], ones);
+    a[2] = _mm_xor_si128(a[2], ones);
+    a[3] = _mm_xor_si128(a[3], ones);
+    a[4] = _mm_xor_si128(a[4], ones);
+    a[5] = _mm_xor_si128(a[5], ones);
+    a[6] = _mm_xor_si128(a[6], ones);
+    a[7] = _mm_xor_si128(a[7], _mm_xor_si128(col, _mm_set1_epi8(r)));
+    SubShiftMix(a, masks.q);
+}
+
+/** P and Q of the compression function are independent, so their rounds are
+ *  interleaved to keep the AES unit busy. */
+void PermutePQ(State p, State q)
+{
+    const ShiftMasks& masks = Masks();
+    for (int r = 0; r < 14; r++) {
+        RoundP(p, r, masks);
+        RoundQ(q, r, masks);
+    }
+}
+
+void PermuteP(State a)
+{
+    const ShiftMasks& masks = Masks();
+    for (int r = 0; r < 14; r++) {
+        RoundP(a, r, masks);
+    }
+}
+
+/** Byte k of a block is row k % 8 of column k / 8. */
+void LoadBlock(State a, const unsigned char* block)
+{
+    alignas(16) unsigned char rows[8][16];
+    for (int j = 0; j < 16; j++) {
+        for (int i = 0; i < 8; i++) {
+            rows[i][j] = block[8 * j + i];
+        }
+    }
+    for (int i = 0; i < 8; i++) {
+        a[i] = _mm_load_si128((const __m128i*)rows[i]);
+    }
+}
+
+void Hash(unsigned char* out, const unsigned char* in)
+{
+    // The padded message is a single block: 64 bytes of data, 0x80 and the
+    // big-endian block count (1) in the last byte.
+    unsigned char block[128] = {0};
+    memcpy(block, in, 64);
+    block[64] = 0x80;
+    block[127] = 1;
+
+    State h, p, q;
+    for (int i = 0; i < 8; i++) {
+        h[i] = _mm_setzero_si128();
+    }
+    // The IV is the output length in bits, big endian, in the last column.
+    h[6] = _mm_insert_epi16(h[6], 0x0200, 7);
+    LoadBlock(q, block);
+    for (int i = 0; i < 8; i++) {
+        p[i] = _mm_xor_si128(h[i], q[i]);
+    }
+    PermutePQ(p, q);
+    for (int i = 0; i < 8; i++) {
+        h[i] = _mm_xor_si128(h[i], _mm_xor_si128(p[i], q[i]));
+        p[i] = h[i];
+    }
+    PermuteP(p);
+
+    // Output transformation: the last eight columns of P(h) ^ h.
+    alignas(16) unsigned char rows[8][16];
+    for (int i = 0; i < 8; i++) {
+        _mm_store_si128((__m128i*)rows[i], _mm_xor_si128(p[i], h[i]));
+    }
+    for (int j = 0; j < 8; j++) {
+        for (int i = 0; i < 8; i++) {
+            out[8 * j + i] = rows[i][8 + j];
+        }
+    }
+}
+
+} // namespace groestl
+
+/** SHAvite-3-512 */
+namespace shavite {
+
+const uint32_t IV[16] = {
+    0x72FCCDD8, 0x79CA4727, 0x128A077B, 0x40D55AEC,
+    0xD1901A06, 0x430AE307, 0xB29F5CD1, 0xDF07FBFC,
+    0x8E45D73D, 0x681AB538, 0xBDE86578, 0xDD577E47,
+    0xE275EADE, 0x502D9FCD, 0xB9357178, 0x022A4B9A
+};
+
+void Hash(unsigned char* out, const unsigned char* in)
+{
+    // Single padded block: data, 0x80, the bit count (512) as a 128-bit
+    // little-endian number at offset 110 and the digest size at offset 126.
+    unsigned char block[128] = {0};
+    memcpy(block, in, 64);
+    block[64] = 0x80;
+    block[111] = 0x02;
+    block[127] = 0x02;
+    const uint32_t count0 = 512, count1 = 0, count2 = 0, count3 = 0;
+
+    // Message expansion into 112 round keys of four words each.
+    const __m128i zero = _mm_setzero_si128();
+    __m128i rk[112];
+    for (int j = 0; j < 8; j++) {
+        rk[j] = _mm_loadu_si128((const __m128i*)(block + 16 * j));
+    }
+    int j = 8;
+    for (;;) {
+        for (int s = 0; s < 8; s++) {
+            __m128i x = _mm_aesenc_si128(_mm_shuffle_epi32(rk[j - 8], 0x39), zero);
+            rk[j] = _mm_xor_si128(x, rk[j - 1]);
+            if (j == 8) {
+                rk[j] = _mm_xor_si128(rk[j], _mm_setr_epi32(count0, count1, count2, ~count3));
+            } else if (j == 41) {
+                rk[j] = _mm_xor_si128(rk[j], _mm_setr_epi32(count3, count2, count1, ~count0));
+            } else if (j == 79) {
+                rk[j] = _mm_xor_si128(rk[j], _mm_setr_epi32(count2, count3, count0, ~count1));
+            } else if (j == 110) {
+                rk[j] = _mm_xor_si128(rk[j], _mm_setr_epi32(count1, count0, count3, ~count2));
+            }
+            j++;
+        }
+        if (j == 112) break;
+        for (int s = 0; s < 8; s++) {
+            rk[j] = _mm_xor_si128(rk[j - 8], _mm_alignr_epi8(rk[j - 1], rk[j - 2], 4));
+            j++;
+        }
+    }
+
+    __m128i h[4], p[4];
+    for (int i = 0; i < 4; i++) {
+        h[i] = _mm_loadu_si128((const __m128i*)(IV + 4 * i));
+        p[i] = h[i];
+    }
+    const __m128i* k = rk;
+    for (int r = 0; r < 14; r++) {
+        __m128i x = _mm_xor_si128(p[1], k[0]);
+        x = _mm_aesenc_si128(x, k[1]);
+        x = _mm_aesenc_si128(x, k[2]);
+        x = _mm_aesenc_si128(x, k[3]);
+        p[0] = _mm_xor_si128(p[0], _mm_aesenc_si128(x, zero));
+        x = _mm_xor_si128(p[3], k[4]);
+        x = _mm_aesenc_si128(x, k[5]);
+        x = _mm_aesenc_si128(x, k[6]);
+        x = _mm_aesenc_si128(x, k[7]);
+        p[2] = _mm_xor_si128(p[2], _mm_aesenc_si128(x, zero));
+        k += 8;
+        __m128i t = p[3];
+        p[3] = p[2];
+        p[2] = p[1];
+        p[1] = p[0];
+        p[0] = t;
+    }
+    for (int i = 0; i < 4; i++) {
+        _mm_storeu_si128((__m128i*)(out + 16 * i), _mm_xor_si128(h[i], p[i]));
+    }
+}
+
+} // namespace shavite
+
+/** ECHO-512 */
+namespace echo {
+
+inline void MixColumn(__m128i& a, __m128i& b, __m128i& c, __m128i& d)
+{
+    __m128i ab = _mm_xor_si128(a, b);
+    __m128i bc = _mm_xor_si128(b, c);
+    __m128i cd = _mm_xor_si128(c, d);
+    __m128i abx = XTime(ab);
+    __m128i bcx = XTime(bc);
+    __m128i cdx = XTime(cd);
+    __m128i na = _mm_xor_si128(abx, _mm_xor_si128(bc, d));
+    __m128i nb = _mm_xor_si128(bcx, _mm_xor_si128(a, cd));
+    __m128i nc = _mm_xor_si128(cdx, _mm_xor_si128(ab, d));
+    d = _mm_xor_si128(_mm_xor_si128(abx, bcx), _mm_xor_si128(cdx, _mm_xor_si128(ab, c)));
+    a = na;
+    b = nb;
+    c = nc;
+}
+
+void Hash(unsigned char* out, const unsigned char* in)
+{
+    // Single padded block: data, 0x80, the digest size at offset 110 and the
+    // bit count (512) as a 128-bit little-endian number at offset 112.
+    unsigned char block[128] = {0};
+    memcpy(block, in, 64);
+    block[64] = 0x80;
+    block[111] = 0x02;
+    block[113] = 0x02;
+
+    __m128i w[16], m[8];
+    for (int i = 0; i < 8; i++) {
+        w[i] = _mm_set_epi64x(0, 512);
+        m[i] = _mm_loadu_si128((const __m128i*)(block + 16 * i));
+        w[i + 8] = m[i];
+    }
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set_epi64x(0, 1);
+    __m128i k = _mm_set_epi64x(0, 512);
+    for (int r = 0; r < 10; r++) {
+        // BigSubWords; the counter cannot carry out of the low word here.
+        for (int i = 0; i < 16; i++) {
+            w[i] = _mm_aesenc_si128(_mm_aesenc_si128(w[i], k), zero);
+            k = _mm_add_epi64(k, one);
+        }
+        // BigShiftRows
+        __m128i t = w[1];
+        w[1] = w[5];
+        w[5] = w[9];
+        w[9] = w[13];
+        w[13] = t;
+        t = w[2];
+        w[2] = w[10];
+        w[10] = t;
+        t = w[6];
+        w[6] = w[14];
+        w[14] = t;
+        t = w[15];
+        w[15] = w[11];
+        w[11] = w[7];
+        w[7] = w[3];
+        w[3] = t;
+        // BigMixColumns
+        for (int c = 0; c < 16; c += 4) {
+            MixColumn(w[c], w[c + 1], w[c + 2], w[c + 3]);
+        }
+    }
+
+    // BigFinal; the digest is the first four words of the new chaining value.
+    for (int i = 0; i < 4; i++) {
+        __m128i v = _mm_xor_si128(_mm_set_epi64x(0, 512), m[i]);
+        v = _mm_xor_si128(v, _mm_xor_si128(w[i], w[i + 8]));
+        _mm_storeu_si128((__m128i*)(out + 16 * i), v);
+    }
+}
+
+} // namespace echo
+
+} // namespace
+
+void Groestl512_64(unsigned char* out, const unsigned char* in) { groestl::Hash(out, in); }
+void Shavite512_64(unsigned char* out, const unsigned char* in) { shavite::Hash(out, in); }
+void Echo512_64(unsigned char* out, const unsigned char* in) { echo::Hash(out, in); }
+
+} // namespace x11_aesni
+
+#endif // ENABLE_AESNI
@@ -0,0 +1,500 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// This is a 4-way multi-buffer implementation of the X11 stages that map well onto
+// AVX2 (BLAKE, BMW, Skein, Keccak and CubeHash). Every function hashes four
+// independent messages of a fixed length at once and produces output that is
+// bit-identical to the corresponding sph_* function.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "crypto/common.h"
+
+namespace x11_avx2 {
+namespace {
+
+/** Four 64-bit lanes. */
+struct W64
+{
+    __m256i v;
+    W64() {}
+    explicit W64(__m256i x) : v(x) {}
+    explicit W64(uint64_t x) : v(_mm256_set1_epi64x(x)) {}
+};
+
+inline W64 operator+(W64 a, W64 b) { return W64(_mm256_add_epi64(a.v, b.v)); }
+inline W64 operator-(W64 a, W64 b) { return W64(_mm256_sub_epi64(a.v, b.v)); }
+inline W64 operator^(W64 a, W64 b) { return W64(_mm256_xor_si256(a.v, b.v)); }
+inline W64 operator&(W64 a, W64 b) { return W64(_mm256_and_si256(a.v, b.v)); }
+inline W64 operator|(W64 a, W64 b) { return W64(_mm256_or_si256(a.v, b.v)); }
+/** ~a & b */
+inline W64 AndNot(W64 a, W64 b) { return W64(_mm256_andnot_si256(a.v, b.v)); }
+template<int n> inline W64 Shl(W64 a) { return W64(_mm256_slli_epi64(a.v, n)); }
+template<int n> inline W64 Shr(W64 a) { return W64(_mm256_srli_epi64(a.v, n)); }
+template<int n> inline W64 Rotl(W64 a) { return W64(_mm256_or_si256(_mm256_slli_epi64(a.v, n), _mm256_srli_epi64(a.v, 64 - n))); }
+template<int n> inline W64 Rotr(W64 a) { return W64(_mm256_or_si256(_mm256_srli_epi64(a.v, n), _mm256_slli_epi64(a.v, 64 - n))); }
+
+/** Load 64-bit word i (little endian) of four messages of length len laid out back to back. */
+inline W64 LoadLE(const unsigned char* in, size_t len, int i)
+{
+    return W64(_mm256_set_epi64x(ReadLE64(in + 3 * len + 8 * i), ReadLE64(in + 2 * len + 8 * i),
+                                 ReadLE64(in + len + 8 * i), ReadLE64(in + 8 * i)));
+}
+
+inline W64 LoadBE(const unsigned char* in, size_t len, int i)
+{
+    return W64(_mm256_set_epi64x(ReadBE64(in + 3 * len + 8 * i), ReadBE64(in + 2 * len + 8 * i),
+                                 ReadBE64(in + len + 8 * i), ReadBE64(in + 8 * i)));
+}
+
+/** Store word i of four 64-byte digests laid out back to back. */
+inline void StoreLE(unsigned char* out, int i, W64 w)
+{
+    alignas(32) uint64_t lanes[4];
+    _mm256_store_si256((__m256i*)lanes, w.v);
+    for (int l = 0; l < 4; l++) WriteLE64(out + 64 * l + 8 * i, lanes[l]);
+}
+
+inline void StoreBE(unsigned char* out, int i, W64 w)
+{
+    alignas(32) uint64_t lanes[4];
+    _mm256_store_si256((__m256i*)lanes, w.v);
+    for (int l = 0; l < 4; l++) WriteBE64(out + 64 * l + 8 * i, lanes[l]);
+}
+
+/** BLAKE-512 */
+namespace blake {
+
+const uint64_t IV[8] = {
+    0x6A09E667F3BCC908ULL, 0xBB67AE8584CAA73BULL, 0x3C6EF372FE94F82BULL, 0xA54FF53A5F1D36F1ULL,
+    0x510E527FADE682D1ULL, 0x9B05688C2B3E6C1FULL, 0x1F83D9ABFB41BD6BULL, 0x5BE0CD19137E2179ULL
+};
+
+const uint64_t C[16] = {
+    0x243F6A8885A308D3ULL, 0x13198A2E03707344ULL, 0xA4093822299F31D0ULL, 0x082EFA98EC4E6C89ULL,
+    0x452821E638D01377ULL, 0xBE5466CF34E90C6CULL, 0xC0AC29B7C97C50DDULL, 0x3F84D5B5B5470917ULL,
+    0x9216D5D98979FB1BULL, 0xD1310BA698DFB5ACULL, 0x2FFD72DBD01ADFB7ULL, 0xB8E1AFED6A267E96ULL,
+    0xBA7C9045F12C7F99ULL, 0x24A19947B3916CF7ULL, 0x0801F2E2858EFC16ULL, 0x636920D871574E69ULL
+};
+
+const unsigned char SIGMA[16][16] = {
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+    { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+    {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+    {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+    {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+    { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+    { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+    {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+    { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+    { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+    {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+    {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+    {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 }
+};
+
+inline void G(const W64* m, int r, int i, W64& a, W64& b, W64& c, W64& d)
+{
+    const int s0 = SIGMA[r][2 * i], s1 = SIGMA[r][2 * i + 1];
+    a = a + b + (m[s0] ^ W64(C[s1]));
+    d = Rotr<32>(d ^ a);
+    c = c + d;
+    b = Rotr<25>(b ^ c);
+    a = a + b + (m[s1] ^ W64(C[s0]));
+    d = Rotr<16>(d ^ a);
+    c = c + d;
+    b = Rotr<11>(b ^ c);
+}
+
+} // namespace blake
+
+/** BMW-512 */
+namespace bmw {
+
+const uint64_t IV[16] = {
+    0x8081828384858687ULL, 0x88898A8B8C8D8E8FULL, 0x9091929394959697ULL, 0x98999A9B9C9D9E9FULL,
+    0xA0A1A2A3A4A5A6A7ULL, 0xA8A9AAABACADAEAFULL, 0xB0B1B2B3B4B5B6B7ULL, 0xB8B9BABBBCBDBEBFULL,
+    0xC0C1C2C3C4C5C6C7ULL, 0xC8C9CACBCCCDCECFULL, 0xD0D1D2D3D4D5D6D7ULL, 0xD8D9DADBDCDDDEDFULL,
+    0xE0E1E2E3E4E5E6E7ULL, 0xE8E9EAEBECEDEEEFULL, 0xF0F1F2F3F4F5F6F7ULL, 0xF8F9FAFBFCFDFEFFULL
+};
+
+inline W64 S0(W64 x) { return Shr<1>(x) ^ Shl<3>(x) ^ Rotl<4>(x) ^ Rotl<37>(x); }
+inline W64 S1(W64 x) { return Shr<1>(x) ^ Shl<2>(x) ^ Rotl<13>(x) ^ Rotl<43>(x); }
+inline W64 S2(W64 x) { return Shr<2>(x) ^ Shl<1>(x) ^ Rotl<19>(x) ^ Rotl<53>(x); }
+inline W64 S3(W64 x) { return Shr<2>(x) ^ Shl<2>(x) ^ Rotl<28>(x) ^ Rotl<59>(x); }
+inline W64 S4(W64 x) { return Shr<1>(x) ^ x; }
+inline W64 S5(W64 x) { return Shr<2>(x) ^ x; }
+
+inline W64 S(int i, W64 x)
+{
+    switch (i) {
+    case 0: return S0(x);
+    case 1: return S1(x);
+    case 2: return S2(x);
+    case 3: return S3(x);
+    default: return S4(x);
+    }
+}
+
+inline W64 RotlVar(W64 x, int n)
+{
+    return W64(_mm256_or_si256(_mm256_sll_epi64(x.v, _mm_cvtsi32_si128(n)), _mm256_srl_epi64(x.v, _mm_cvtsi32_si128(64 - n))));
+}
+
+inline W64 AddElement(const W64* m, const W64* h, int j)
+{
+    const int a = j % 16, b = (j + 3) % 16, c = (j + 10) % 16;
+    return (RotlVar(m[a], a + 1) + RotlVar(m[b], b + 1) - RotlVar(m[c], c + 1) + W64((uint64_t)(j + 16) * 0x0555555555555555ULL)) ^ h[(j + 7) % 16];
+}
+
+/** Compress one 128-byte block m into the chaining value h. */
+void Compress(W64* h, const W64* m)
+{
+    W64 t[16], q[32];
+    for (int i = 0; i < 16; i++) t[i] = m[i] ^ h[i];
+
+    q[0] = t[5] - t[7] + t[10] + t[13] + t[14];
+    q[1] = t[6] - t[8] + t[11] + t[14] - t[15];
+    q[2] = t[0] + t[7] + t[9] - t[12] + t[15];
+    q[3] = t[0] - t[1] + t[8] - t[10] + t[13];
+    q[4] = t[1] + t[2] + t[9] - t[11] - t[14];
+    q[5] = t[3] - t[2] + t[10] - t[12] + t[15];
+    q[6] = t[4] - t[0] - t[3] - t[11] + t[13];
+    q[7] = t[1] - t[4] - t[5] - t[12] - t[14];
+    q[8] = t[2] - t[5] - t[6] + t[13] - t[15];
+    q[9] = t[0] - t[3] + t[6] - t[7] + t[14];
+    q[10] = t[8] - t[1] - t[4] - t[7] + t[15];
+    q[11] = t[8] - t[0] - t[2] - t[5] + t[9];
+    q[12] = t[1] + t[3] - t[6] - t[9] + t[10];
+    q[13] = t[2] + t[4] + t[7] + t[10] + t[11];
+    q[14] = t[3] - t[5] + t[8] - t[11] - t[12];
+    q[15] = t[12] - t[4] - t[6] - t[9] + t[13];
+    for (int i = 0; i < 16; i++) q[i] = S(i % 5, q[i]) + h[(i + 1) % 16];
+
+    for (int j = 16; j < 18; j++) {
+        q[j] = S1(q[j - 16]) + S2(q[j - 15]) + S3(q[j - 14]) + S0(q[j - 13])
+             + S1(q[j - 12]) + S2(q[j - 11]) + S3(q[j - 10]) + S0(q[j - 9])
+             + S1(q[j - 8]) + S2(q[j - 7]) + S3(q[j - 6]) + S0(q[j - 5])
+             + S1(q[j - 4]) + S2(q[j - 3]) + S3(q[j - 2]) + S0(q[j - 1])
+             + AddElement(m, h, j - 16);
+    }
+    for (int j = 18; j < 32; j++) {
+        q[j] = q[j - 16] + Rotl<5>(q[j - 15]) + q[j - 14] + Rotl<11>(q[j - 13])
+             + q[j - 12] + Rotl<27>(q[j - 11]) + q[j - 10] + Rotl<32>(q[j - 9])
+             + q[j - 8] + Rotl<37>(q[j - 7]) + q[j - 6] + Rotl<43>(q[j - 5])
+             + q[j - 4] + Rotl<53>(q[j - 3]) + S4(q[j - 2]) + S5(q[j - 1])
+             + AddElement(m, h, j - 16);
+    }
+
+    W64 xl = q[16] ^ q[17] ^ q[18] ^ q[19] ^ q[20] ^ q[21] ^ q[22] ^ q[23];
+    W64 xh = xl ^ q[24] ^ q[25] ^ q[26] ^ q[27] ^ q[28] ^ q[29] ^ q[30] ^ q[31];
+
+    h[0] = (Shl<5>(xh) ^ Shr<5>(q[16]) ^ m[0]) + (xl ^ q[24] ^ q[0]);
+    h[1] = (Shr<7>(xh) ^ Shl<8>(q[17]) ^ m[1]) + (xl ^ q[25] ^ q[1]);
+    h[2] = (Shr<5>(xh) ^ Shl<5>(q[18]) ^ m[2]) + (xl ^ q[26] ^ q[2]);
+    h[3] = (Shr<1>(xh) ^ Shl<5>(q[19]) ^ m[3]) + (xl ^ q[27] ^ q[3]);
+    h[4] = (Shr<3>(xh) ^ q[20] ^ m[4]) + (xl ^ q[28] ^ q[4]);
+    h[5] = (Shl<6>(xh) ^ Shr<6>(q[21]) ^ m[5]) + (xl ^ q[29] ^ q[5]);
+    h[6] = (Shr<4>(xh) ^ Shl<6>(q[22]) ^ m[6]) + (xl ^ q[30] ^ q[6]);
+    h[7] = (Shr<11>(xh) ^ Shl<2>(q[23]) ^ m[7]) + (xl ^ q[31] ^ q[7]);
+    h[8] = Rotl<9>(h[4]) + (xh ^ q[24] ^ m[8]) + (Shl<8>(xl) ^ q[23] ^ q[8]);
+    h[9] = Rotl<10>(h[5]) + (xh ^ q[25] ^ m[9]) + (Shr<6>(xl) ^ q[16] ^ q[9]);
+    h[10] = Rotl<11>(h[6]) + (xh ^ q[26] ^ m[10]) + (Shl<6>(xl) ^ q[17] ^ q[10]);
+    h[11] = Rotl<12>(h[7]) + (xh ^ q[27] ^ m[11]) + (Shl<4>(xl) ^ q[18] ^ q[11]);
+    h[12] = Rotl<13>(h[0]) + (xh ^ q[28] ^ m[12]) + (Shr<3>(xl) ^ q[19] ^ q[12]);
+    h[13] = Rotl<14>(h[1]) + (xh ^ q[29] ^ m[13]) + (Shr<4>(xl) ^ q[20] ^ q[13]);
+    h[14] = Rotl<15>(h[2]) + (xh ^ q[30] ^ m[14]) + (Shr<7>(xl) ^ q[21] ^ q[14]);
+    h[15] = Rotl<16>(h[3]) + (xh ^ q[31] ^ m[15]) + (Shr<2>(xl) ^ q[22] ^ q[15]);
+}
+
+} // namespace bmw
+
+/** Skein-512-512 */
+namespace skein {
+
+const uint64_t IV[8] = {
+    0x4903ADFF749C51CEULL, 0x0D95DE399746DF03ULL, 0x8FD1934127C79BCEULL, 0x9A255629FF352CB1ULL,
+    0x5DB62599DF6CA7B0ULL, 0xEABE394CA9D5C3F4ULL, 0x991112C71A75B523ULL, 0xAE18A40B660FCC33ULL
+};
+
+template<int r> inline void Mix(W64& x0, W64& x1)
+{
+    x0 = x0 + x1;
+    x1 = Rotl<r>(x1) ^ x0;
+}
+
+inline void AddKey(W64* p, const W64* k, const uint64_t* t, int s)
+{
+    for (int i = 0; i < 5; i++) p[i] = p[i] + k[(s + i) % 9];
+    p[5] = p[5] + k[(s + 5) % 9] + W64(t[s % 3]);
+    p[6] = p[6] + k[(s + 6) % 9] + W64(t[(s + 1) % 3]);
+    p[7] = p[7] + k[(s + 7) % 9] + W64((uint64_t)s);
+}
+
+/** One UBI block: h = Threefish_h,t(m) ^ m. */
+void Ubi(W64* h, const W64* m, uint64_t t0, uint64_t t1)
+{
+    W64 k[9], p[8];
+    const uint64_t t[3] = {t0, t1, t0 ^ t1};
+    k[8] = W64(0x1BD11BDAA9FC1A22ULL);
+    for (int i = 0; i < 8; i++) {
+        k[i] = h[i];
+        k[8] = k[8] ^ h[i];
+        p[i] = m[i];
+    }
+    for (int s = 0; s < 18; s += 2) {
+        AddKey(p, k, t, s);
+        Mix<46>(p[0], p[1]); Mix<36>(p[2], p[3]); Mix<19>(p[4], p[5]); Mix<37>(p[6], p[7]);
+        Mix<33>(p[2], p[1]); Mix<27>(p[4], p[7]); Mix<14>(p[6], p[5]); Mix<42>(p[0], p[3]);
+        Mix<17>(p[4], p[1]); Mix<49>(p[6], p[3]); Mix<36>(p[0], p[5]); Mix<39>(p[2], p[7]);
+        Mix<44>(p[6], p[1]); Mix< 9>(p[0], p[7]); Mix<54>(p[2], p[5]); Mix<56>(p[4], p[3]);
+        AddKey(p, k, t, s + 1);
+        Mix<39>(p[0], p[1]); Mix<30>(p[2], p[3]); Mix<34>(p[4], p[5]); Mix<24>(p[6], p[7]);
+        Mix<13>(p[2], p[1]); Mix<50>(p[4], p[7]); Mix<10>(p[6], p[5]); Mix<17>(p[0], p[3]);
+        Mix<25>(p[4], p[1]); Mix<29>(p[6], p[3]); Mix<39>(p[0], p[5]); Mix<43>(p[2], p[7]);
+        Mix< 8>(p[6], p[1]); Mix<35>(p[0], p[7]); Mix<56>(p[2], p[5]); Mix<22>(p[4], p[3]);
+    }
+    AddKey(p, k, t, 18);
+    for (int i = 0; i < 8; i++) h[i] = p[i] ^ m[i];
+}
+
+} // namespace skein
+
+/** Keccak-512 (original padding, as in sph_keccak). */
+namespace keccak {
+
+const uint64_t RC[24] = {
+    0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808AULL, 0x8000000080008000ULL,
+    0x000000000000808BULL, 0x0000000080000001ULL, 0x8000000080008081ULL, 0x8000000000008009ULL,
+    0x000000000000008AULL, 0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000AULL,
+    0x000000008000808BULL, 0x800000000000008BULL, 0x8000000000008089ULL, 0x8000000000008003ULL,
+    0x8000000000008002ULL, 0x8000000000000080ULL, 0x000000000000800AULL, 0x800000008000000AULL,
+    0x8000000080008081ULL, 0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL
+};
+
+void Permute(W64* a)
+{
+    for (int round = 0; round < 24; round++) {
+        W64 c0 = a[0] ^ a[5] ^ a[10] ^ a[15] ^ a[20];
+        W64 c1 = a[1] ^ a[6] ^ a[11] ^ a[16] ^ a[21];
+        W64 c2 = a[2] ^ a[7] ^ a[12] ^ a[17] ^ a[22];
+        W64 c3 = a[3] ^ a[8] ^ a[13] ^ a[18] ^ a[23];
+        W64 c4 = a[4] ^ a[9] ^ a[14] ^ a[19] ^ a[24];
+        W64 d0 = c4 ^ Rotl<1>(c1);
+        W64 d1 = c0 ^ Rotl<1>(c2);
+        W64 d2 = c1 ^ Rotl<1>(c3);
+        W64 d3 = c2 ^ Rotl<1>(c4);
+        W64 d4 = c3 ^ Rotl<1>(c0);
+        for (int y = 0; y < 25; y += 5) {
+            a[y] = a[y] ^ d0;
+            a[y + 1] = a[y + 1] ^ d1;
+            a[y + 2] = a[y + 2] ^ d2;
+            a[y + 3] = a[y + 3] ^ d3;
+            a[y + 4] = a[y + 4] ^ d4;
+        }
+
+        W64 b[25];
+        // rho and pi: b[y, 2x + 3y] = rot(a[x, y], r[x, y])
+        b[0]  = a[0];
+        b[10] = Rotl<1>(a[1]);
+        b[20] = Rotl<62>(a[2]);
+        b[5]  = Rotl<28>(a[3]);
+        b[15] = Rotl<27>(a[4]);
+        b[16] = Rotl<36>(a[5]);
+        b[1]  = Rotl<44>(a[6]);
+        b[11] = Rotl<6>(a[7]);
+        b[21] = Rotl<55>(a[8]);
+        b[6]  = Rotl<20>(a[9]);
+        b[7]  = Rotl<3>(a[10]);
+        b[17] = Rotl<10>(a[11]);
+        b[2]  = Rotl<43>(a[12]);
+        b[12] = Rotl<25>(a[13]);
+        b[22] = Rotl<39>(a[14]);
+        b[23] = Rotl<41>(a[15]);
+        b[8]  = Rotl<45>(a[16]);
+        b[18] = Rotl<15>(a[17]);
+        b[3]  = Rotl<21>(a[18]);
+        b[13] = Rotl<8>(a[19]);
+        b[14] = Rotl<18>(a[20]);
+        b[24] = Rotl<2>(a[21]);
+        b[9]  = Rotl<61>(a[22]);
+        b[19] = Rotl<56>(a[23]);
+        b[4]  = Rotl<14>(a[24]);
+
+        for (int y = 0; y < 25; y += 5) {
+            a[y] = b[y] ^ AndNot(b[y + 1], b[y + 2]);
+            a[y + 1] = b[y + 1] ^ AndNot(b[y + 2], b[y + 3]);
+            a[y + 2] = b[y + 2] ^ AndNot(b[y + 3], b[y + 4]);
+            a[y + 3] = b[y + 3] ^ AndNot(b[y + 4], b[y]);
+            a[y + 4] = b[y + 4] ^ AndNot(b[y], b[y + 1]);
+        }
+        a[0] = a[0] ^ W64(RC[round]);
+    }
+}
+
+} // namespace keccak
+
+/** CubeHash16/32-512. Unlike the other stages the state of a single message is kept
+ *  in eight vectors of four words, so that the word swaps of a round become register
+ *  renames and in-lane shuffles; each 256-bit register holds two messages. */
+namespace cubehash {
+
+const uint32_t IV[32] = {
+    0x2AEA2A61, 0x50F494D4, 0x2D538B8B, 0x4167D83E, 0x3FEE2313, 0xC701CF8C, 0xCC39968E, 0x50AC5695,
+    0x4D42C787, 0xA647A8B3, 0x97CF0BEF, 0x825B4537, 0xEEF864D2, 0xF22090C4, 0xD0E5CD33, 0xA23911AE,
+    0xFCD398D9, 0x148FE485, 0x1B017BEF, 0xB6444532, 0x6A536159, 0x2FF5781C, 0x91FA7934, 0x0DBADEA9,
+    0xD65C8A2B, 0xA5A70E75, 0xB1C62456, 0xBC796576, 0x1921C8F7, 0xE7989AF1, 0x7795D246, 0xD43E3B44
+};
+
+template<int n> inline __m256i Rotl32x8(__m256i a) { return _mm256_or_si256(_mm256_slli_epi32(a, n), _mm256_srli_epi32(a, 32 - n)); }
+
+inline void Rounds(__m256i* x, int rounds)
+{
+    __m256i x0 = x[0], x1 = x[1], x2 = x[2], x3 = x[3], x4 = x[4], x5 = x[5], x6 = x[6], x7 = x[7];
+    for (int r = 0; r < rounds; r++) {
+        x4 = _mm256_add_epi32(x0, x4); x5 = _mm256_add_epi32(x1, x5);
+        x6 = _mm256_add_epi32(x2, x6); x7 = _mm256_add_epi32(x3, x7);
+        // Rotate by 7, then swap x_00klm with x_01klm (x0 <-> x2, x1 <-> x3).
+        __m256i y0 = Rotl32x8<7>(x2), y1 = Rotl32x8<7>(x3), y2 = Rotl32x8<7>(x0), y3 = Rotl32x8<7>(x1);
+        x0 = _mm256_xor_si256(y0, x4); x1 = _mm256_xor_si256(y1, x5);
+        x2 = _mm256_xor_si256(y2, x6); x3 = _mm256_xor_si256(y3, x7);
+        // Swap x_1jk0m with x_1jk1m.
+        x4 = _mm256_shuffle_epi32(x4, 0x4e); x5 = _mm256_shuffle_epi32(x5, 0x4e);
+        x6 = _mm256_shuffle_epi32(x6, 0x4e); x7 = _mm256_shuffle_epi32(x7, 0x4e);
+        x4 = _mm256_add_epi32(x0, x4); x5 = _mm256_add_epi32(x1, x5);
+        x6 = _mm256_add_epi32(x2, x6); x7 = _mm256_add_epi32(x3, x7);
+        // Rotate by 11, then swap x_0j0lm with x_0j1lm (x0 <-> x1, x2 <-> x3).
+        y0 = Rotl32x8<11>(x1); y1 = Rotl32x8<11>(x0); y2 = Rotl32x8<11>(x3); y3 = Rotl32x8<11>(x2);
+        x0 = _mm256_xor_si256(y0, x4); x1 = _mm256_xor_si256(y1, x5);
+        x2 = _mm256_xor_si256(y2, x6); x3 = _mm256_xor_si256(y3, x7);
+        // Swap x_1jkl0 with x_1jkl1.
+        x4 = _mm256_shuffle_epi32(x4, 0xb1); x5 = _mm256_shuffle_epi32(x5, 0xb1);
+        x6 = _mm256_shuffle_epi32(x6, 0xb1); x7 = _mm256_shuffle_epi32(x7, 0xb1);
+    }
+    x[0] = x0; x[1] = x1; x[2] = x2; x[3] = x3; x[4] = x4; x[5] = x5; x[6] = x6; x[7] = x7;
+}
+
+/** Hash two 64-byte messages a and b. */
+void Hash2(unsigned char* outa, unsigned char* outb, const unsigned char* a, const unsigned char* b)
+{
+    __m256i x[8];
+    for (int i = 0; i < 8; i++) {
+        __m128i iv = _mm_loadu_si128((const __m128i*)(IV + 4 * i));
+        x[i] = _mm256_inserti128_si256(_mm256_castsi128_si256(iv), iv, 1);
+    }
+    for (int block = 0; block < 2; block++) {
+        for (int i = 0; i < 2; i++) {
+            __m256i m = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(a + 32 * block + 16 * i))),
+                                                _mm_loadu_si128((const __m128i*)(b + 32 * block + 16 * i)), 1);
+            x[i] = _mm256_xor_si256(x[i], m);
+        }
+        Rounds(x, 16);
+    }
+    x[0] = _mm256_xor_si256(x[0], _mm256_set_epi32(0, 0, 0, 0x80, 0, 0, 0, 0x80));
+    Rounds(x, 16);
+    x[7] = _mm256_xor_si256(x[7], _mm256_set_epi32(1, 0, 0, 0, 1, 0, 0, 0));
+    Rounds(x, 160);
+    for (int i = 0; i < 4; i++) {
+        _mm_storeu_si128((__m128i*)(outa + 16 * i), _mm256_castsi256_si128(x[i]));
+        _mm_storeu_si128((__m128i*)(outb + 16 * i), _mm256_extracti128_si256(x[i], 1));
+    }
+}
+
+} // namespace cubehash
+
+} // namespace
+
+void Blake512_80_4way(unsigned char* out, const unsigned char* in)
+{
+    using namespace blake;
+    W64 m[16], v[16], h[8];
+    for (int i = 0; i < 10; i++) m[i] = LoadBE(in, 80, i);
+    // Padding of an 80-byte message: a single final block with a 640-bit counter.
+    m[10] = W64(0x8000000000000000ULL);
+    for (int i = 11; i < 13; i++) m[i] = W64((uint64_t)0);
+    m[13] = W64((uint64_t)1);
+    m[14] = W64((uint64_t)0);
+    m[15] = W64((uint64_t)640);
+    for (int i = 0; i < 8; i++) {
+        h[i] = W64(IV[i]);
+        v[i] = h[i];
+    }
+    for (int i = 0; i < 4; i++) v[8 + i] = W64(C[i]);
+    v[12] = W64(640 ^ C[4]);
+    v[13] = W64(640 ^ C[5]);
+    v[14] = W64(C[6]);
+    v[15] = W64(C[7]);
+    for (int r = 0; r < 16; r++) {
+        G(m, r, 0, v[0], v[4], v[8], v[12]);
+        G(m, r, 1, v[1], v[5], v[9], v[13]);
+        G(m, r, 2, v[2], v[6], v[10], v[14]);
+        G(m, r, 3, v[3], v[7], v[11], v[15]);
+        G(m, r, 4, v[0], v[5], v[10], v[15]);
+        G(m, r, 5, v[1], v[6], v[11], v[12]);
+        G(m, r, 6, v[2], v[7], v[8], v[13]);
+        G(m, r, 7, v[3], v[4], v[9], v[14]);
+    }
+    for (int i = 0; i < 8; i++) StoreBE(out, i, h[i] ^ v[i] ^ v[i + 8]);
+}
+
+void Bmw512_64_4way(unsigned char* out, const unsigned char* in)
+{
+    using namespace bmw;
+    W64 h[16], m[16];
+    for (int i = 0; i < 16; i++) h[i] = W64(IV[i]);
+    for (int i = 0; i < 8; i++) m[i] = LoadLE(in, 64, i);
+    m[8] = W64((uint64_t)0x80);
+    for (int i = 9; i < 15; i++) m[i] = W64((uint64_t)0);
+    m[15] = W64((uint64_t)512);
+    Compress(h, m);
+    // Final compression with the constant chaining value.
+    for (int i = 0; i < 16; i++) {
+        m[i] = h[i];
+        h[i] = W64(0xAAAAAAAAAAAAAAA0ULL + i);
+    }
+    Compress(h, m);
+    for (int i = 0; i < 8; i++) StoreLE(out, i, h[i + 8]);
+}
+
+void Skein512_64_4way(unsigned char* out, const unsigned char* in)
+{
+    using namespace skein;
+    W64 h[8], m[8];
+    for (int i = 0; i < 8; i++) {
+        h[i] = W64(IV[i]);
+        m[i] = LoadLE(in, 64, i);
+    }
+    // Message block (first | final | type msg), then the output block (counter 0).
+    Ubi(h, m, 64, 0xF000000000000000ULL);
+    for (int i = 0; i < 8; i++) m[i] = W64((uint64_t)0);
+    Ubi(h, m, 8, 0xFF00000000000000ULL);
+    for (int i = 0; i < 8; i++) StoreLE(out, i, h[i]);
+}
+
+void Keccak512_64_4way(unsigned char* out, const unsigned char* in)
+{
+    using namespace keccak;
+    W64 a[25];
+    for (int i = 0; i < 8; i++) a[i] = LoadLE(in, 64, i);
+    a[8] = W64(0x8000000000000001ULL);
+    for (int i = 9; i < 25; i++) a[i] = W64((uint64_t)0);
+    Permute(a);
+    for (int i = 0; i < 8; i++) StoreLE(out, i, a[i]);
+}
+
+void CubeHash512_64_4way(unsigned char* out, const unsigned char* in)
+{
+    cubehash::Hash2(out, out + 64, in, in + 64);
+    cubehash::Hash2(out + 128, out + 192, in + 128, in + 192);
+}
+
+} // namespace x11_avx2
+
+#endif
@@ -43,6 +43,15 @@ const std::vector<unsigned char>& GetObfuscateKey(const CDBWrapper &w);
 
 };
 
+/** LevelDB settings of a database besides its cache size */
+struct CDBTuning
+{
+    //! Size of the memtable, 0 for a quarter of the cache
+    size_t nWriteBufferSize = 0;
+    //! Bits per key of the bloom filter, 0 for none
+    int nBloomBitsPerKey = 10;
+};
+
 /** Batch of changes queued to be written to a CDBWrapper */
 class CDBBatch
 {
@@ -217,8 +226,9 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
+     * @param[in] tuning      Further leveldb settings.
      */
-    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, const CDBTuning& tuning = CDBTuning());
     ~CDBWrapper();
 
     template <typename K, typename V>
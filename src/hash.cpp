@@ -7,6 +7,32 @@
 #include "crypto/hmac_sha512.h"
 #include "pubkey.h"
 
+#include <assert.h>
+#include <string.h>
+
+#if defined(ENABLE_AVX2) || defined(ENABLE_AESNI)
+#include <cpuid.h>
+#endif
+
+#if defined(ENABLE_AVX2)
+namespace x11_avx2
+{
+void Blake512_80_4way(unsigned char* out, const unsigned char* in);
+void Bmw512_64_4way(unsigned char* out, const unsigned char* in);
+void Skein512_64_4way(unsigned char* out, const unsigned char* in);
+void Keccak512_64_4way(unsigned char* out, const unsigned char* in);
+void CubeHash512_64_4way(unsigned char* out, const unsigned char* in);
+}
+#endif
+
+#if defined(ENABLE_AESNI)
+namespace x11_aesni
+{
+void Groestl512_64(unsigned char* out, const unsigned char* in);
+void Shavite512_64(unsigned char* out, const unsigned char* in);
+void Echo512_64(unsigned char* out, const unsigned char* in);
+}
+#endif
 
 inline uint32_t ROTL32(uint32_t x, int8_t r)
 {
@@ -246,3 +272,213 @@ uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint3
     SIPROUND;
     return v0 ^ v1 ^ v2 ^ v3;
 }
+
+namespace
+{
+/** Whether HashX11Batch80 may use the 4-way AVX2 kernels. */
+bool fX11Avx2 = false;
+
+/** One scalar sph stage over a 64-byte chaining value. */
+template<typename Context, void (*Init)(void*), void (*Write)(void*, const void*, size_t), void (*Close)(void*, void*)>
+void inline Stage64(unsigned char* out, const unsigned char* in)
+{
+    Context ctx;
+    Init(&ctx);
+    Write(&ctx, in, 64);
+    Close(&ctx, out);
+}
+
+typedef void (*X11StageFn)(unsigned char* out, const unsigned char* in);
+
+const X11StageFn Groestl512Sph = Stage64<sph_groestl512_context, sph_groestl512_init, sph_groestl512, sph_groestl512_close>;
+const X11StageFn Shavite512Sph = Stage64<sph_shavite512_context, sph_shavite512_init, sph_shavite512, sph_shavite512_close>;
+const X11StageFn Echo512Sph = Stage64<sph_echo512_context, sph_echo512_init, sph_echo512, sph_echo512_close>;
+
+/** Implementations of the AES based stages selected by X11AutoDetect(). */
+X11StageFn X11Groestl512Impl = Groestl512Sph;
+X11StageFn X11Shavite512Impl = Shavite512Sph;
+X11StageFn X11Echo512Impl = Echo512Sph;
+
+#if defined(ENABLE_AESNI)
+/** Check that the CPU supports AES-NI and SSSE3. */
+bool AESNIEnabled()
+{
+    uint32_t eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+    return ((ecx >> 25) & 1) && ((ecx >> 9) & 1);
+}
+
+bool SelfTestX11AESNI()
+{
+    unsigned char in[64], out1[64], out2[64];
+    for (size_t i = 0; i < sizeof(in); i++) {
+        in[i] = (unsigned char)(i * 13 + 5);
+    }
+    static const X11StageFn stages[3][2] = {
+        {x11_aesni::Groestl512_64, Groestl512Sph},
+        {x11_aesni::Shavite512_64, Shavite512Sph},
+        {x11_aesni::Echo512_64, Echo512Sph},
+    };
+    for (int i = 0; i < 3; i++) {
+        stages[i][0](out1, in);
+        stages[i][1](out2, in);
+        if (memcmp(out1, out2, sizeof(out1))) return false;
+    }
+    return true;
+}
+#endif
+
+#if defined(ENABLE_AVX2)
+
+/** Apply a scalar stage to each of four 64-byte lanes. */
+template<void (*Stage)(unsigned char*, const unsigned char*)>
+void inline Lanes4(unsigned char* out, const unsigned char* in)
+{
+    for (int i = 0; i < 4; i++) {
+        Stage(out + 64 * i, in + 64 * i);
+    }
+}
+
+/** X11 of four 80-byte messages: the stages with a 4-way kernel run on all lanes
+ *  at once, the remaining ones fall back to sph per lane. */
+void HashX11_4way(const unsigned char* in, uint256* out)
+{
+    unsigned char a[4 * 64], b[4 * 64];
+    x11_avx2::Blake512_80_4way(a, in);
+    x11_avx2::Bmw512_64_4way(b, a);
+    Lanes4<X11Groestl512>(a, b);
+    x11_avx2::Skein512_64_4way(b, a);
+    Lanes4<Stage64<sph_jh512_context, sph_jh512_init, sph_jh512, sph_jh512_close>>(a, b);
+    x11_avx2::Keccak512_64_4way(b, a);
+    Lanes4<Stage64<sph_luffa512_context, sph_luffa512_init, sph_luffa512, sph_luffa512_close>>(a, b);
+    x11_avx2::CubeHash512_64_4way(b, a);
+    Lanes4<X11Shavite512>(a, b);
+    Lanes4<Stage64<sph_simd512_context, sph_simd512_init, sph_simd512, sph_simd512_close>>(b, a);
+    Lanes4<X11Echo512>(a, b);
+    for (int i = 0; i < 4; i++) {
+        memcpy(out[i].begin(), a + 64 * i, 32);
+    }
+}
+
+/** Check that the OS saves the YMM registers and the CPU supports AVX2. */
+bool AVX2Enabled()
+{
+    uint32_t eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !((ecx >> 27) & 1)) return false;
+    uint32_t xcr0_lo, xcr0_hi;
+    __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 6) != 6) return false;
+    if (__get_cpuid_max(0, nullptr) < 7) return false;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ebx >> 5) & 1;
+}
+
+bool SelfTestX11_4way()
+{
+    unsigned char in[4 * 80];
+    uint256 out[4];
+    for (size_t i = 0; i < sizeof(in); i++) {
+        in[i] = (unsigned char)(i * 7 + 1);
+    }
+    HashX11_4way(in, out);
+    for (int i = 0; i < 4; i++) {
+        if (out[i] != HashX11(in + 80 * i, in + 80 * (i + 1))) return false;
+    }
+    return true;
+}
+#endif
+
+} // namespace
+
+std::string X11AutoDetect()
+{
+    std::string ret = "standard";
+    X11Groestl512Impl = Groestl512Sph;
+    X11Shavite512Impl = Shavite512Sph;
+    X11Echo512Impl = Echo512Sph;
+    fX11Avx2 = false;
+#if defined(ENABLE_AESNI)
+    if (AESNIEnabled()) {
+        assert(SelfTestX11AESNI());
+        X11Groestl512Impl = x11_aesni::Groestl512_64;
+        X11Shavite512Impl = x11_aesni::Shavite512_64;
+        X11Echo512Impl = x11_aesni::Echo512_64;
+        ret = "aesni";
+    }
+#endif
+#if defined(ENABLE_AVX2)
+    if (AVX2Enabled()) {
+        fX11Avx2 = true;
+        assert(SelfTestX11_4way());
+        ret = (ret == "standard") ? "avx2(4way)" : ret + ",avx2(4way)";
+    }
+#endif
+    return ret;
+}
+
+void X11Groestl512(unsigned char* out, const unsigned char* in)
+{
+    X11Groestl512Impl(out, in);
+}
+
+void X11Shavite512(unsigned char* out, const unsigned char* in)
+{
+    X11Shavite512Impl(out, in);
+}
+
+void X11Echo512(unsigned char* out, const unsigned char* in)
+{
+    X11Echo512Impl(out, in);
+}
+
+bool X11Stage4Lanes(X11Stage4Way stage, bool fAvx2, unsigned char* out, const unsigned char* in)
+{
+    if (fAvx2) {
+#if defined(ENABLE_AVX2)
+        if (!fX11Avx2) return false;
+        switch (stage) {
+        case X11Stage4Way::BLAKE512: x11_avx2::Blake512_80_4way(out, in); break;
+        case X11Stage4Way::BMW512: x11_avx2::Bmw512_64_4way(out, in); break;
+        case X11Stage4Way::SKEIN512: x11_avx2::Skein512_64_4way(out, in); break;
+        case X11Stage4Way::KECCAK512: x11_avx2::Keccak512_64_4way(out, in); break;
+        case X11Stage4Way::CUBEHASH512: x11_avx2::CubeHash512_64_4way(out, in); break;
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+    for (int i = 0; i < 4; i++) {
+        switch (stage) {
+        case X11Stage4Way::BLAKE512: {
+            sph_blake512_context ctx;
+            sph_blake512_init(&ctx);
+            sph_blake512(&ctx, in + 80 * i, 80);
+            sph_blake512_close(&ctx, out + 64 * i);
+            break;
+        }
+        case X11Stage4Way::BMW512: Stage64<sph_bmw512_context, sph_bmw512_init, sph_bmw512, sph_bmw512_close>(out + 64 * i, in + 64 * i); break;
+        case X11Stage4Way::SKEIN512: Stage64<sph_skein512_context, sph_skein512_init, sph_skein512, sph_skein512_close>(out + 64 * i, in + 64 * i); break;
+        case X11Stage4Way::KECCAK512: Stage64<sph_keccak512_context, sph_keccak512_init, sph_keccak512, sph_keccak512_close>(out + 64 * i, in + 64 * i); break;
+        case X11Stage4Way::CUBEHASH512: Stage64<sph_cubehash512_context, sph_cubehash512_init, sph_cubehash512, sph_cubehash512_close>(out + 64 * i, in + 64 * i); break;
+        }
+    }
+    return true;
+}
+
+void HashX11Batch80(const unsigned char* in, size_t n, uint256* out)
+{
+#if defined(ENABLE_AVX2)
+    if (fX11Avx2) {
+        while (n >= 4) {
+            HashX11_4way(in, out);
+            in += 4 * 80;
+            out += 4;
+            n -= 4;
+        }
+    }
+#endif
+    for (size_t i = 0; i < n; i++) {
+        out[i] = HashX11(in + 80 * i, in + 80 * (i + 1));
+    }
+}
@@ -13,6 +13,7 @@
 #include "uint256.h"
 #include "version.h"
 
+#include <string>
 #include <vector>
 
 #include "crypto/sph_blake.h"
@@ -255,21 +256,33 @@ public:
 uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val);
 uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint32_t extra);
 
+/** The Groestl, SHAvite and ECHO stages of X11 over a 64-byte intermediate hash.
+ *  These use AES-NI once X11AutoDetect() has found it, and sph otherwise. */
+void X11Groestl512(unsigned char* out, const unsigned char* in);
+void X11Shavite512(unsigned char* out, const unsigned char* in);
+void X11Echo512(unsigned char* out, const unsigned char* in);
+
+/** The X11 stages that have a 4-way AVX2 kernel. */
+enum class X11Stage4Way { BLAKE512, BMW512, SKEIN512, KECCAK512, CUBEHASH512 };
+
+/** Run one of those stages on four lanes, to measure it on its own: through the
+ *  4-way kernel if fAvx2 (returns false when X11AutoDetect() did not enable it),
+ *  otherwise through sph on each lane. BLAKE512 reads four 80-byte messages, the
+ *  other stages four 64-byte hashes; out receives four 64-byte hashes. */
+bool X11Stage4Lanes(X11Stage4Way stage, bool fAvx2, unsigned char* out, const unsigned char* in);
+
 template<typename T1>
 inline uint256 HashX11(const T1 pbegin, const T1 pend)
 
 {
     sph_blake512_context     ctx_blake;
     sph_bmw512_context       ctx_bmw;
-    sph_groestl512_context   ctx_groestl;
     sph_jh512_context        ctx_jh;
     sph_keccak512_context    ctx_keccak;
     sph_skein512_context     ctx_skein;
     sph_luffa512_context     ctx_luffa;
     sph_cubehash512_context  ctx_cubehash;
-    sph_shavite512_context   ctx_shavite;
     sph_simd512_context      ctx_simd;
-    sph_echo512_context      ctx_echo;
     static unsigned char pblank[1];
 
     uint512 hash[11];
@@ -282,9 +295,7 @@ inline uint256 HashX11(const T1 pbegin, const T1 pend)
     sph_bmw512 (&ctx_bmw, static_cast<const void*>(&hash[0]), 64);
     sph_bmw512_close(&ctx_bmw, static_cast<void*>(&hash[1]));
 
-    sph_groestl512_init(&ctx_groestl);
-    sph_groestl512 (&ctx_groestl, static_cast<const void*>(&hash[1]), 64);
-    sph_groestl512_close(&ctx_groestl, static_cast<void*>(&hash[2]));
+    X11Groestl512(hash[2].begin(), hash[1].begin());
 
     sph_skein512_init(&ctx_skein);
     sph_skein512 (&ctx_skein, static_cast<const void*>(&hash[2]), 64);
@@ -306,19 +317,26 @@ inline uint256 HashX11(const T1 pbegin, const T1 pend)
     sph_cubehash512 (&ctx_cubehash, static_cast<const void*>(&hash[6]), 64);
     sph_cubehash512_close(&ctx_cubehash, static_cast<void*>(&hash[7]));
 
-    sph_shavite512_init(&ctx_shavite);
-    sph_shavite512(&ctx_shavite, static_cast<const void*>(&hash[7]), 64);
-    sph_shavite512_close(&ctx_shavite, static_cast<void*>(&hash[8]));
+    X11Shavite512(hash[8].begin(), hash[7].begin());
 
     sph_simd512_init(&ctx_simd);
     sph_simd512 (&ctx_simd, static_cast<const void*>(&hash[8]), 64);
     sph_simd512_close(&ctx_simd, static_cast<void*>(&hash[9]));
 
-    sph_echo512_init(&ctx_echo);
-    sph_echo512 (&ctx_echo, static_cast<const void*>(&hash[9]), 64);
-    sph_echo512_close(&ctx_echo, static_cast<void*>(&hash[10]));
+    X11Echo512(hash[10].begin(), hash[9].begin());
 
     return hash[10].trim256();
 }
 
+/** Autodetect the best available X11 batch implementation. Returns its name. */
+std::string X11AutoDetect();
+
+/** Compute the X11 hashes of n 80-byte messages stored back to back.
+ *
+ * The result is identical to calling HashX11 on each message, but when
+ * X11AutoDetect() found a multi-lane implementation several messages are
+ * hashed per pass.
+ */
+void HashX11Batch80(const unsigned char* in, size_t n, uint256* out);
+
 #endif // BITCOIN_HASH_H
@@ -9,6 +9,7 @@
 
 #include "init.h"
 
+#include "addressindexer.h"
 #include "addrman.h"
 #include "amount.h"
 #include "chain.h"
@@ -18,6 +19,7 @@
 #include "consensus/validation.h"
 #include "fs.h"
 #include "httpserver.h"
+#include "hash.h"
 #include "httprpc.h"
 #include "key.h"
 #include "validation.h"
@@ -241,12 +243,16 @@ void Shutdown()
         }
         delete pcoinsTip;
         pcoinsTip = nullptr;
+        delete pcoinsflusher;
+        pcoinsflusher = nullptr;
         delete pcoinscatcher;
         pcoinscatcher = nullptr;
         delete pcoinsdbview;
         pcoinsdbview = nullptr;
         delete pblocktree;
         pblocktree = nullptr;
+        delete pindexdb;
+        pindexdb = nullptr;
     }
 #ifdef ENABLE_WALLET
     for (CWalletRef pwallet : vpwallets) {
@@ -362,7 +368,14 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
     if (showDebug)
         strUsage += HelpMessageOpt("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER));
+    strUsage += HelpMessageOpt("-indexdbcache=<n>", strprintf(_("Set the cache size of the address and spent index database in megabytes, on top of -dbcache (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultIndexDBCache));
+    if (showDebug) {
+        strUsage += HelpMessageOpt("-indexdbwritebuffer=<n>", strprintf("Write buffer size of the index database in megabytes, 0 for a quarter of -indexdbcache (default: %u)", nDefaultIndexDBWriteBuffer));
+        strUsage += HelpMessageOpt("-indexdbbloombits=<n>", strprintf("Bloom filter bits per key of the index database, 0 for none (default: %u)", DEFAULT_INDEXDB_BLOOM_BITS));
+    }
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
+    strUsage += HelpMessageOpt("-loadutxosnapshot=<file>", _("Start an empty chain state from a UTXO set snapshot written by dumptxoutset, instead of connecting every block up to its base block. "
+            "The block index must already have the base block and its ancestors, with their data. Requires -utxosnapshothash"));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
@@ -381,9 +394,11 @@ std::string HelpMessage(HelpMessageMode mode)
             "(default: 0 = disable pruning blocks, 1 = allow manual pruning via RPC, >%u = automatically prune block files to stay under the specified target size in MiB)"), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
     strUsage += HelpMessageOpt("-reindex-chainstate", _("Rebuild chain state from the currently indexed blocks"));
     strUsage += HelpMessageOpt("-reindex", _("Rebuild chain state and block index from the blk*.dat files on disk"));
+    strUsage += HelpMessageOpt("-utxosnapshothash=<hash>", _("The hash_serialized_2 that the UTXO set of -loadutxosnapshot must have, as gettxoutsetinfo shows it at the base block of the snapshot"));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
+    strUsage += HelpMessageOpt("-addrindex", _("Maintain the address and spent indexes, used by the getaddress* rpc calls. Built in the background when enabled on an existing node (default: 0)"));
     strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), DEFAULT_TXINDEX));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
@@ -446,6 +461,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), DEFAULT_CHECKBLOCKS));
         strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), DEFAULT_CHECKLEVEL));
         strUsage += HelpMessageOpt("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. Also sets -checkmempool (default: %u)", defaultChainParams->DefaultConsistencyChecks()));
+        strUsage += HelpMessageOpt("-verifyblockindexhashes", strprintf("Recompute every block header hash when loading the block index, instead of trusting the hash it is stored under (default: %u)", DEFAULT_VERIFY_BLOCK_INDEX_HASHES));
         strUsage += HelpMessageOpt("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u)", defaultChainParams->DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkpoints", strprintf("Disable expensive verification for known chain history (default: %u)", DEFAULT_CHECKPOINTS_ENABLED));
         strUsage += HelpMessageOpt("-disablesafemode", strprintf("Disable safemode, override a real safe mode event (default: %u)", DEFAULT_DISABLE_SAFEMODE));
@@ -503,6 +519,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageGroup(_("Block creation options:"));
     strUsage += HelpMessageOpt("-blockmaxweight=<n>", strprintf(_("Set maximum BIP141 block weight (default: %d)"), DEFAULT_BLOCK_MAX_WEIGHT));
     strUsage += HelpMessageOpt("-blockmaxsize=<n>", _("Set maximum BIP141 block weight to this * 4. Deprecated, use blockmaxweight"));
+    strUsage += HelpMessageOpt("-genproclimit=<n>", strprintf(_("Number of threads used by generate and generatetoaddress, 0 for one per core (default: %d)"), DEFAULT_GENERATE_THREADS));
     strUsage += HelpMessageOpt("-blockmintxfee=<amt>", strprintf(_("Set lowest fee rate (in %s/kB) for transactions to be included in block creation. (default: %s)"), CURRENCY_UNIT, FormatMoney(DEFAULT_BLOCK_MIN_TX_FEE)));
     if (showDebug)
         strUsage += HelpMessageOpt("-blockversion=<n>", "Override block version to test forking scenarios");
@@ -915,6 +932,15 @@ bool AppInitParameterInteraction()
             return InitError(_("Prune mode is incompatible with -txindex."));
     }
 
+    // a UTXO snapshot is loaded into the chain state of the block index on disk
+    if (gArgs.IsArgSet("-loadutxosnapshot")) {
+        const std::string strHash = gArgs.GetArg("-utxosnapshothash", "");
+        if (strHash.size() != 64 || !IsHex(strHash))
+            return InitError(_("-loadutxosnapshot requires the hash of the snapshot in -utxosnapshothash."));
+        if (gArgs.GetBoolArg("-reindex", false))
+            return InitError(_("-loadutxosnapshot is incompatible with -reindex."));
+    }
+
     // -bind and -whitebind can't be set when not listening
     size_t nUserBind = gArgs.GetArgs("-bind").size() + gArgs.GetArgs("-whitebind").size();
     if (nUserBind != 0 && !gArgs.GetBoolArg("-listen", DEFAULT_LISTEN)) {
@@ -1196,6 +1222,8 @@ bool AppInitSanityChecks()
     // Initialize elliptic curve code
     std::string sha256_algo = SHA256AutoDetect();
     LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+    std::string x11_algo = X11AutoDetect();
+    LogPrintf("Using the '%s' X11 implementation\n", x11_algo);
     RandomInit();
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1248,10 +1276,13 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     InitSignatureCache();
     InitScriptExecutionCache();
 
-    LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
+    LogPrintf("Using %u threads for script verification, reading ahead coins and hashing headers\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
-        for (int i=0; i<nScriptCheckThreads-1; i++)
+        for (int i=0; i<nScriptCheckThreads-1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadCoinsPrefetch);
+            threadGroup.create_thread(&ThreadHeaderHashCheck);
+        }
     }
 
     // Start the lightweight task scheduler thread
@@ -1410,10 +1441,18 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
     nCoinCacheUsage = nTotalCache; // the rest goes to in-memory cache
+    // The index database is sized on its own, on top of -dbcache
+    int64_t nIndexDBCache = gArgs.GetArg("-indexdbcache", nDefaultIndexDBCache) << 20;
+    nIndexDBCache = std::max(nIndexDBCache, nMinDbCache << 20);
+    nIndexDBCache = std::min(nIndexDBCache, nMaxDbCache << 20);
+    CDBTuning indexDBTuning;
+    indexDBTuning.nWriteBufferSize = std::max<int64_t>(0, gArgs.GetArg("-indexdbwritebuffer", nDefaultIndexDBWriteBuffer)) << 20;
+    indexDBTuning.nBloomBitsPerKey = std::max<int64_t>(0, gArgs.GetArg("-indexdbbloombits", DEFAULT_INDEXDB_BLOOM_BITS));
     int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1fMiB for index database\n", nIndexDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
 
     bool fLoaded = false;
@@ -1428,11 +1467,24 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
             try {
                 UnloadBlockIndex();
                 delete pcoinsTip;
-                delete pcoinsdbview;
+                delete pcoinsflusher;
                 delete pcoinscatcher;
+                delete pcoinsdbview;
                 delete pblocktree;
+                delete pindexdb;
 
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReset);
+                pindexdb = new CIndexDB(nIndexDBCache, false, fReset, indexDBTuning);
+
+                // The indexes used to live in the block database
+                if (!fReset && !pindexdb->MigrateFromBlockTree(*pblocktree)) {
+                    strLoadError = _("Error moving the indexes to the index database");
+                    break;
+                }
+                if (!pindexdb->DropTimestampIndex(*pblocktree)) {
+                    strLoadError = _("Error erasing the old timestamp index");
+                    break;
+                }
 
                 if (fReset) {
                     pblocktree->WriteReindexing(true);
@@ -1485,6 +1537,7 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
 
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReset || fReindexChainState);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
+                pcoinsflusher = new CCoinsViewFlusher(pcoinscatcher, pcoinsdbview);
 
                 // If necessary, upgrade from older database format.
                 // This is a no-op if we cleared the coinsviewdb with -reindex or -reindex-chainstate
@@ -1493,6 +1546,23 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                     break;
                 }
 
+                // Fill the empty coinsviewdb from a snapshot, which leaves it at
+                // the snapshot's base block, even with -reindex-chainstate
+                bool fLoadedSnapshot = false;
+                if (gArgs.IsArgSet("-loadutxosnapshot")) {
+                    if (fAddressIndex) {
+                        strLoadError = _("A UTXO snapshot does not hold the address index. Rebuild the chain state without -loadutxosnapshot");
+                        break;
+                    }
+                    uiInterface.InitMessage(_("Loading UTXO snapshot..."));
+                    fs::path pathSnapshot = fs::absolute(gArgs.GetArg("-loadutxosnapshot", ""), GetDataDir());
+                    if (!LoadUTXOSnapshot(pcoinsdbview, pathSnapshot, uint256S(gArgs.GetArg("-utxosnapshothash", "")))) {
+                        strLoadError = _("Error loading the UTXO snapshot");
+                        break;
+                    }
+                    fLoadedSnapshot = true;
+                }
+
                 // ReplayBlocks is a no-op if we cleared the coinsviewdb with -reindex or -reindex-chainstate
                 if (!ReplayBlocks(chainparams, pcoinsdbview)) {
                     strLoadError = _("Unable to replay blocks. You will need to rebuild the database using -reindex-chainstate.");
@@ -1500,9 +1570,9 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                 }
 
                 // The on-disk coinsdb is now in a good state, create the cache
-                pcoinsTip = new CCoinsViewCache(pcoinscatcher);
+                pcoinsTip = new CCoinsViewCache(pcoinsflusher);
 
-                bool is_coinsview_empty = fReset || fReindexChainState || pcoinsTip->GetBestBlock().IsNull();
+                bool is_coinsview_empty = ((fReset || fReindexChainState) && !fLoadedSnapshot) || pcoinsTip->GetBestBlock().IsNull();
                 if (!is_coinsview_empty) {
                     // LoadChainTip sets chainActive based on pcoinsTip's best block
                     if (!LoadChainTip(chainparams)) {
@@ -1547,6 +1617,11 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                         strLoadError = _("Corrupted block database detected");
                         break;
                     }
+
+                    {
+                        LOCK(cs_main);
+                        LoadActiveAddresses(chainparams);
+                    }
                 }
             } catch (const std::exception& e) {
                 LogPrintf("%s\n", e.what());
@@ -1661,6 +1736,8 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
         uiInterface.NotifyBlockTip.disconnect(BlockNotifyGenesisWait);
     }
 
+    StartAddressIndexer(threadGroup, chainparams);
+
     // ********************************************************* Step 11: start node
 
     //// debug print
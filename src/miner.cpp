@@ -6,6 +6,7 @@
 #include "miner.h"
 
 #include "amount.h"
+#include "arith_uint256.h"
 #include "chain.h"
 #include "base58.h"
 #include "chainparams.h"
@@ -14,6 +15,8 @@
 #include "consensus/tx_verify.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "crypto/common.h"
+#include "crypto/sha256.h"
 #include "hash.h"
 #include "validation.h"
 #include "net.h"
@@ -26,10 +29,14 @@
 #include "txmempool.h"
 #include "util.h"
 #include "utilmoneystr.h"
+#include "utilstrencodings.h"
 #include "validationinterface.h"
 
 #include <algorithm>
+#include <atomic>
+#include <limits>
 #include <queue>
+#include <thread>
 #include <utility>
 
 //////////////////////////////////////////////////////////////////////////////
@@ -470,3 +477,180 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
     pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
+
+namespace {
+
+/** Nonces a thread takes from the shared counter at a time. */
+static const uint32_t NONCE_CHUNK = 256;
+
+std::atomic<double> dHashesPerSec(0);
+
+/**
+ * Hashes nonces of one header template. The part of the header in front of the
+ * nonce never changes: for SHA256d blocks the state after its first 64 bytes is
+ * computed once, for X11 blocks the header is kept serialized for four lanes
+ * and hashed through HashX11Batch80.
+ */
+class NonceHasher
+{
+public:
+    explicit NonceHasher(const CBlockHeader& header) : fX11(header.IsBitcoinX())
+    {
+        const unsigned char* pheader = (const unsigned char*)BEGIN(header.nVersion);
+        for (int i = 0; i < LANES; i++) {
+            memcpy(vchHeaders + i * BLOCK_HEADER_HASHED_SIZE, pheader, BLOCK_HEADER_HASHED_SIZE);
+        }
+        sha256Midstate.Write(pheader, 64);
+    }
+
+    /** Hash the LANES nonces starting at nNonce. */
+    void Hash(uint32_t nNonce, uint256* out)
+    {
+        for (int i = 0; i < LANES; i++) {
+            WriteLE32(vchHeaders + i * BLOCK_HEADER_HASHED_SIZE + NONCE_OFFSET, nNonce + i);
+        }
+        if (fX11) {
+            HashX11Batch80(vchHeaders, LANES, out);
+            return;
+        }
+        for (int i = 0; i < LANES; i++) {
+            unsigned char hash[CSHA256::OUTPUT_SIZE];
+            CSHA256(sha256Midstate).Write(vchHeaders + i * BLOCK_HEADER_HASHED_SIZE + 64, BLOCK_HEADER_HASHED_SIZE - 64).Finalize(hash);
+            CSHA256().Write(hash, sizeof(hash)).Finalize(out[i].begin());
+        }
+    }
+
+    static const int LANES = 4;
+
+private:
+    static const size_t NONCE_OFFSET = BLOCK_HEADER_HASHED_SIZE - 4;
+    const bool fX11;
+    unsigned char vchHeaders[LANES * BLOCK_HEADER_HASHED_SIZE];
+    CSHA256 sha256Midstate;
+};
+
+} // namespace
+
+CNonceScanner::CNonceScanner(int nThreads) : nWorkSeq(0), nWorkersBusy(0), fStop(false)
+{
+    for (int i = 1; i < nThreads; i++) {
+        threads.emplace_back(&CNonceScanner::ThreadWork, this);
+    }
+}
+
+CNonceScanner::~CNonceScanner()
+{
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        fStop = true;
+    }
+    condWork.notify_all();
+    for (std::thread& t : threads) {
+        t.join();
+    }
+}
+
+void CNonceScanner::ThreadWork()
+{
+    RenameThread("bitcoin-nonce");
+    uint64_t nSeqDone = 0;
+    while (true) {
+        std::function<void()> workNow;
+        {
+            std::unique_lock<std::mutex> lock(mut);
+            condWork.wait(lock, [&] { return fStop || nWorkSeq != nSeqDone; });
+            if (fStop)
+                return;
+            nSeqDone = nWorkSeq;
+            workNow = work;
+        }
+        workNow();
+        {
+            std::lock_guard<std::mutex> lock(mut);
+            if (--nWorkersBusy == 0)
+                condDone.notify_one();
+        }
+    }
+}
+
+bool CNonceScanner::ScanNonces(CBlock* pblock, uint32_t nEndNonce, const Consensus::Params& consensusParams)
+{
+    const uint32_t nStartNonce = pblock->nNonce;
+    if (nEndNonce <= nStartNonce)
+        return false;
+
+    bool fNegative, fOverflow;
+    arith_uint256 bnTarget;
+    bnTarget.SetCompact(pblock->nBits, &fNegative, &fOverflow);
+    if (fNegative || bnTarget == 0 || fOverflow || bnTarget > UintToArith256(consensusParams.powLimit)) {
+        pblock->nNonce = nEndNonce;
+        return false;
+    }
+
+    // Chunks are handed out in increasing order and always scanned completely,
+    // so once no chunk below the best nonce found so far is left, that nonce
+    // is the lowest valid one.
+    std::atomic<uint64_t> nNextNonce(nStartNonce);
+    std::atomic<uint64_t> nBestNonce(std::numeric_limits<uint64_t>::max());
+    std::atomic<uint64_t> nHashes(0);
+    const CBlockHeader header = pblock->GetBlockHeader();
+
+    auto scan = [&]() {
+        NonceHasher hasher(header);
+        uint256 hashes[NonceHasher::LANES];
+        uint64_t nDone = 0;
+        while (true) {
+            const uint64_t nChunk = nNextNonce.fetch_add(NONCE_CHUNK);
+            if (nChunk >= nEndNonce || nChunk > nBestNonce)
+                break;
+            const uint64_t nChunkEnd = std::min<uint64_t>(nChunk + NONCE_CHUNK, nEndNonce);
+            bool fFound = false;
+            for (uint64_t nNonce = nChunk; nNonce < nChunkEnd && !fFound; nNonce += NonceHasher::LANES) {
+                hasher.Hash((uint32_t)nNonce, hashes);
+                nDone += NonceHasher::LANES;
+                for (int i = 0; i < NonceHasher::LANES && nNonce + i < nChunkEnd; i++) {
+                    if (UintToArith256(hashes[i]) <= bnTarget) {
+                        uint64_t nBest = nBestNonce;
+                        while (nNonce + i < nBest && !nBestNonce.compare_exchange_weak(nBest, nNonce + i)) {}
+                        fFound = true;
+                        break;
+                    }
+                }
+            }
+        }
+        nHashes += nDone;
+    };
+
+    int64_t nStart = GetTimeMicros();
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        work = scan;
+        nWorkersBusy = threads.size();
+        nWorkSeq++;
+    }
+    condWork.notify_all();
+    scan();
+    {
+        std::unique_lock<std::mutex> lock(mut);
+        condDone.wait(lock, [&] { return nWorkersBusy == 0; });
+        work = nullptr;
+    }
+    int64_t nElapsed = GetTimeMicros() - nStart;
+    if (nElapsed > 0)
+        dHashesPerSec = nHashes * 1000000.0 / nElapsed;
+
+    if (nBestNonce == std::numeric_limits<uint64_t>::max()) {
+        pblock->nNonce = nEndNonce;
+        return false;
+    }
+    pblock->nNonce = (uint32_t)nBestNonce;
+    // A hash cached before the scan is for another nonce, and would keep the
+    // solved header from being cached.
+    pblock->hashCache.Reset();
+    return true;
+}
+
+double GetMinerHashesPerSec()
+{
+    return dHashesPerSec;
+}
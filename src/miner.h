@@ -10,7 +10,11 @@
 #include "txmempool.h"
 
 #include <stdint.h>
+#include <condition_variable>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include "boost/multi_index_container.hpp"
 #include "boost/multi_index/ordered_index.hpp"
 
@@ -21,6 +25,8 @@ class CScript;
 namespace Consensus { struct Params; };
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+/** Default for -genproclimit, the number of threads generate uses (0 = one per core) */
+static const int DEFAULT_GENERATE_THREADS = 0;
 
 struct CBlockTemplate
 {
@@ -206,4 +212,44 @@ private:
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
 
+/**
+ * Proof of work nonce search on a fixed set of threads, which are started once
+ * and reused by every ScanNonces call, so that a generate loop does not create
+ * threads per block.
+ */
+class CNonceScanner
+{
+public:
+    /** Search on nThreads threads: the calling one and nThreads - 1 workers. */
+    explicit CNonceScanner(int nThreads);
+    ~CNonceScanner();
+
+    CNonceScanner(const CNonceScanner&) = delete;
+    CNonceScanner& operator=(const CNonceScanner&) = delete;
+
+    /**
+     * Search the nonces [pblock->nNonce, nEndNonce) for one that meets the block's
+     * proof of work target. On success pblock->nNonce is set to the lowest such
+     * nonce (the one a sequential search would find) and true is returned;
+     * otherwise pblock->nNonce is set to nEndNonce.
+     */
+    bool ScanNonces(CBlock* pblock, uint32_t nEndNonce, const Consensus::Params& consensusParams);
+
+private:
+    void ThreadWork();
+
+    std::mutex mut;
+    std::condition_variable condWork;
+    std::condition_variable condDone;
+    //! The search every thread runs, and how many workers have yet to finish it
+    std::function<void()> work;
+    uint64_t nWorkSeq;
+    int nWorkersBusy;
+    bool fStop;
+    std::vector<std::thread> threads;
+};
+
+/** Hash rate of the most recent ScanNonces call, in hashes per second. */
+double GetMinerHashesPerSec();
+
 #endif // BITCOIN_MINER_H
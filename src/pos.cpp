@@ -3,11 +3,26 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "pos.h"
+#include "validationinterface.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+CStakingStats stakingStats;
 
 bool fStakeRun = false;
 int64_t nLastCoinStakeSearchInterval = 0;
 unsigned int nModifierInterval = 10 * 60;
 
+void CStakingStats::RecordSignLatency(int64_t nMicros)
+{
+    size_t nBucket = 0;
+    while (nBucket < STAKE_LATENCY_BUCKETS - 1 && nMicros >= STAKE_LATENCY_BUCKETS_MS[nBucket] * 1000)
+        nBucket++;
+    vSignLatency[nBucket]++;
+}
+
 #ifdef ENABLE_WALLET
 // novacoin: attempt to generate suitable proof-of-stake
 bool SignBlock(CBlock& block, CWallet& wallet)
@@ -22,8 +37,13 @@ bool SignBlock(CBlock& block, CWallet& wallet)
 
     if (nSearchTime > nLastCoinStakeSearchTime)
     {
-        if (wallet.CreateCoinStake(wallet, block.nBits, block.nTime, txCoinStake, key))
+        // Every slot since the last search, but not at or before the median
+        // time past, which the block time has to exceed.
+        uint32_t nSearchFrom = std::max(nLastCoinStakeSearchTime, chainActive.Tip()->GetMedianTimePast());
+        uint32_t nStakeTime = block.nTime;
+        if (wallet.CreateCoinStake(wallet, block.nBits, nSearchFrom, nStakeTime, txCoinStake, key))
         {
+            block.nTime = nStakeTime;
             block.vtx.insert(block.vtx.begin() + 1, MakeTransactionRef(std::move(txCoinStake)));
             CMutableTransaction tx(*block.vtx[0]);
             tx.vout.pop_back();
@@ -44,7 +64,87 @@ bool SignBlock(CBlock& block, CWallet& wallet)
 }
 #endif
 
-void ThreadStakeMiner(CWallet *pwallet)
+namespace {
+
+/**
+ * Wakes the staking thread up whenever something that can make a kernel
+ * search worthwhile happens: a new tip, or the wallet changing its lock
+ * state. Events are latched, so one that arrives while the thread is busy
+ * is seen by its next Wait().
+ */
+class CStakeMinerWaker final : public CValidationInterface
+{
+public:
+    explicit CStakeMinerWaker(CWallet* pwallet) : nTipUpdateMicros(GetTimeMicros()), fNotified(false), fInterrupted(false)
+    {
+        connWalletStatus = pwallet->NotifyStatusChanged.connect(boost::bind(&CStakeMinerWaker::Notify, this));
+        RegisterValidationInterface(this);
+    }
+
+    ~CStakeMinerWaker()
+    {
+        UnregisterValidationInterface(this);
+    }
+
+    /** Block until notified, interrupted or the timeout expires. Returns false once interrupted. */
+    bool Wait(std::chrono::milliseconds timeout)
+    {
+        std::unique_lock<std::mutex> lock(mut);
+        cond.wait_for(lock, timeout, [this] { return fNotified || fInterrupted; });
+        fNotified = false;
+        return !fInterrupted;
+    }
+
+    void Interrupt()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mut);
+            fInterrupted = true;
+        }
+        cond.notify_all();
+    }
+
+    bool Interrupted()
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        return fInterrupted;
+    }
+
+    /** When the last tip update arrived, in GetTimeMicros() time */
+    std::atomic<int64_t> nTipUpdateMicros;
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload) override
+    {
+        nTipUpdateMicros = GetTimeMicros();
+        Notify();
+    }
+
+private:
+    void Notify()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mut);
+            fNotified = true;
+        }
+        cond.notify_all();
+    }
+
+    std::mutex mut;
+    std::condition_variable cond;
+    bool fNotified;
+    bool fInterrupted;
+    boost::signals2::scoped_connection connWalletStatus;
+};
+
+/** Waits for notifications that do not come with a timeout of their own (a new tip, an unlock). */
+const std::chrono::milliseconds STAKE_IDLE_WAIT(60 * 1000);
+/** The kernel hash commits to the block time, so a failed search is worth repeating one second later. */
+const std::chrono::milliseconds STAKE_RETRY_WAIT(1000);
+
+} // namespace
+
+static void ThreadStakeMiner(CWallet *pwallet, CStakeMinerWaker* waker)
 {
 
     // Make this thread recognisable as the mining thread
@@ -52,17 +152,24 @@ void ThreadStakeMiner(CWallet *pwallet)
     std::shared_ptr<CReserveScript> coinbase_script;
     pwallet->GetScriptForMining(coinbase_script);
 
-    while (fStakeRun)
+    while (!waker->Interrupted())
     {
-        while (pwallet->IsLocked()) {
+        if (pwallet->IsLocked()) {
             nLastCoinStakeSearchInterval = 0;
-            LogPrint(BCLog::STAKE, "%s: Wallet locked, waitig\n", __func__);
-            MilliSleep(10000);
+            LogPrint(BCLog::STAKE, "%s: Wallet locked, waiting\n", __func__);
+            waker->Wait(STAKE_IDLE_WAIT);
+            continue;
         }
 
-        while ((chainActive.Height() + 1) % 10 || (chainActive.Height() < Params().GetConsensus().posHeight)) {
+        int nHeight;
+        {
+            LOCK(cs_main);
+            nHeight = chainActive.Height();
+        }
+        if ((nHeight + 1) % 10 || (nHeight < Params().GetConsensus().posHeight)) {
             LogPrint(BCLog::STAKE, "%s: Waiting for PoS\n", __func__);
-            MilliSleep(10000);
+            waker->Wait(STAKE_IDLE_WAIT);
+            continue;
         }
 
         // while (IsInitialBlockDownload()) {
@@ -77,6 +184,7 @@ void ThreadStakeMiner(CWallet *pwallet)
         //     continue;
         // }
 
+        const int64_t nTipUpdateMicros = waker->nTipUpdateMicros;
         auto pblocktemplate(BlockAssembler(Params()).CreateNewBlock(coinbase_script->reserveScript));
         
         if (!pblocktemplate.get()) {
@@ -87,8 +195,11 @@ void ThreadStakeMiner(CWallet *pwallet)
         std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>(pblocktemplate->block);
 
         if (CreatePoSBlock(pblock, *pwallet)) {
+                stakingStats.nBlocksSigned++;
+                stakingStats.RecordSignLatency(GetTimeMicros() - nTipUpdateMicros);
                 LOCK(cs_main);
                 if (pblock->hashPrevBlock != chainActive.Tip()->GetBlockHash()) {
+                    stakingStats.nBlocksStale++;
                     LogPrint(BCLog::STAKE, "%s: Generated block is stale, starting over\n", __func__);
                 }
                 // Track how many getdata requests this block gets
@@ -98,14 +209,14 @@ void ThreadStakeMiner(CWallet *pwallet)
                 }
                 // Process this block the same as if we had received it from another node
                 if (!ProcessNewBlock(Params(), pblock, true, nullptr)) {
+                    stakingStats.nBlocksRejected++;
                     LogPrint(BCLog::STAKE, "%s: block not accepted, starting over\n", __func__);
                 }
         }
         else {
             LogPrint(BCLog::STAKE, "%s: Failed to create PoS block, waiting\n", __func__);
-            MilliSleep(10000);
+            waker->Wait(STAKE_RETRY_WAIT);
         }
-        MilliSleep(500);
     }
 }
 
@@ -125,18 +236,31 @@ bool CreatePoSBlock(std::shared_ptr<CBlock> pblock, CWallet& wallet) {
 void StakeB2X(bool fStake, CWallet *pwallet)
 {
     static boost::thread_group* stakeThread = NULL;
+    static CStakeMinerWaker* stakeWaker = NULL;
 
     if (stakeThread != NULL)
     {
+        stakeWaker->Interrupt();
         stakeThread->interrupt_all();
+        stakeThread->join_all();
         delete stakeThread;
         stakeThread = NULL;
+        delete stakeWaker;
+        stakeWaker = NULL;
     }
 
     if(fStake && pwallet)
 	{
+	    stakeWaker = new CStakeMinerWaker(pwallet);
 	    stakeThread = new boost::thread_group();
-	    stakeThread->create_thread(boost::bind(&ThreadStakeMiner, pwallet));
+	    stakeThread->create_thread(boost::bind(&ThreadStakeMiner, pwallet, stakeWaker));
+	    // The staker searches for kernels too, next to these
+	    int nThreads = gArgs.GetArg("-stakethreads", DEFAULT_STAKE_THREADS);
+	    if (nThreads <= 0)
+	        nThreads = GetNumCores();
+	    for (int i = 1; i < nThreads; i++) {
+	        stakeThread->create_thread(&ThreadStakeKernelSearch);
+	    }
 	}
     fStakeRun = fStake;
 }
@@ -18,6 +18,8 @@
 #include "txdb.h"
 #include "versionbits.h"
 
+#include <atomic>
+
 #include <boost/thread.hpp>
 
 class CBlock;
@@ -35,6 +37,40 @@ static const int MODIFIER_INTERVAL_RATIO = 3;
 static const int STAKE_TIMESTAMP_MASK = 15;
 static const int STAKE_MIN_AGE = 8 * 60 * 60; //8 hours
 static const bool DEFAULT_STAKING = false;
+/** Threads searching for stake kernels, 0 for one per core */
+static const int DEFAULT_STAKE_THREADS = 0;
+
+/** Upper bounds (in milliseconds) of the getstakinginfo sign latency buckets; the last bucket has none. */
+static const int64_t STAKE_LATENCY_BUCKETS_MS[] = {100, 1000, 10000, 60000};
+static const size_t STAKE_LATENCY_BUCKETS = sizeof(STAKE_LATENCY_BUCKETS_MS) / sizeof(STAKE_LATENCY_BUCKETS_MS[0]) + 1;
+
+/** Staking counters reported by getstakinginfo, kept since startup. */
+struct CStakingStats
+{
+    /** Kernel searches, and the time they took */
+    std::atomic<uint64_t> nSearches{0};
+    std::atomic<uint64_t> nSearchMicros{0};
+    /** Kernel hashes computed */
+    std::atomic<uint64_t> nKernels{0};
+    /** Candidates left out of a search for being too shallow or too young */
+    std::atomic<uint64_t> nSkippedMaturity{0};
+    std::atomic<uint64_t> nSkippedAge{0};
+    /** Blocks signed, and what became of them */
+    std::atomic<uint64_t> nBlocksSigned{0};
+    std::atomic<uint64_t> nBlocksStale{0};
+    std::atomic<uint64_t> nBlocksRejected{0};
+    /** Signed blocks by time from the tip update they build on, see STAKE_LATENCY_BUCKETS_MS */
+    std::atomic<uint64_t> vSignLatency[STAKE_LATENCY_BUCKETS];
+
+    CStakingStats()
+    {
+        for (std::atomic<uint64_t>& n : vSignLatency) n = 0;
+    }
+
+    void RecordSignLatency(int64_t nMicros);
+};
+
+extern CStakingStats stakingStats;
 
 extern bool fStakeRun;
 extern int64_t nLastCoinStakeSearchInterval;
@@ -11,11 +11,102 @@
 #include "crypto/common.h"
 #include "versionbits.h"
 
+#include <string.h>
+
+static_assert(sizeof(CBlockHeader::nVersion) + sizeof(CBlockHeader::hashPrevBlock) + sizeof(CBlockHeader::hashMerkleRoot) +
+              sizeof(CBlockHeader::nTime) + sizeof(CBlockHeader::nBits) + sizeof(CBlockHeader::nNonce) == BLOCK_HEADER_HASHED_SIZE,
+              "the hashed header fields must be BLOCK_HEADER_HASHED_SIZE bytes");
+
+CBlockHeaderHashCache::CBlockHeaderHashCache(const CBlockHeaderHashCache& other) : nState(EMPTY)
+{
+    *this = other;
+}
+
+CBlockHeaderHashCache& CBlockHeaderHashCache::operator=(const CBlockHeaderHashCache& other)
+{
+    if (this == &other)
+        return *this;
+
+    // The target is being overwritten, so nobody else may be using it. The
+    // source may be getting filled by another thread, in which case the
+    // entry is just not copied.
+    if (other.nState.load(std::memory_order_acquire) == READY) {
+        memcpy(vchHeader, other.vchHeader, sizeof(vchHeader));
+        hash = other.hash;
+        nState.store(READY, std::memory_order_relaxed);
+    } else {
+        nState.store(EMPTY, std::memory_order_relaxed);
+    }
+    return *this;
+}
+
+bool CBlockHeaderHashCache::Get(const unsigned char* pheader, uint256& hashOut) const
+{
+    if (nState.load(std::memory_order_acquire) != READY || memcmp(vchHeader, pheader, sizeof(vchHeader)) != 0)
+        return false;
+    hashOut = hash;
+    return true;
+}
+
+void CBlockHeaderHashCache::Set(const unsigned char* pheader, const uint256& hashIn)
+{
+    uint8_t nExpected = EMPTY;
+    if (!nState.compare_exchange_strong(nExpected, WRITING, std::memory_order_acquire))
+        return;
+    memcpy(vchHeader, pheader, sizeof(vchHeader));
+    hash = hashIn;
+    nState.store(READY, std::memory_order_release);
+}
+
 uint256 CBlockHeader::GetHash() const
 {
-    return IsBitcoinX()
+    const unsigned char* pheader = (const unsigned char*)BEGIN(nVersion);
+
+    uint256 hash;
+    if (hashCache.Get(pheader, hash))
+        return hash;
+
+    hash = IsBitcoinX()
         ? HashX11(BEGIN(nVersion), END(nNonce))
         : Hash(BEGIN(nVersion), END(nNonce));
+    hashCache.Set(pheader, hash);
+    return hash;
+}
+
+void HashX11Batch(const CBlockHeader* headers, size_t n, uint256* out)
+{
+    std::vector<unsigned char> buf(n * BLOCK_HEADER_HASHED_SIZE);
+    for (size_t i = 0; i < n; i++) {
+        memcpy(&buf[i * BLOCK_HEADER_HASHED_SIZE], BEGIN(headers[i].nVersion), BLOCK_HEADER_HASHED_SIZE);
+    }
+    HashX11Batch80(buf.data(), n, out);
+    for (size_t i = 0; i < n; i++) {
+        if (headers[i].IsBitcoinX()) {
+            headers[i].hashCache.Set(&buf[i * BLOCK_HEADER_HASHED_SIZE], out[i]);
+        }
+    }
+}
+
+void GetBlockHeaderHashes(const CBlockHeader* headers, size_t n, uint256* out)
+{
+    std::vector<unsigned char> buf;
+    std::vector<size_t> vX11;
+    buf.reserve(n * BLOCK_HEADER_HASHED_SIZE);
+    for (size_t i = 0; i < n; i++) {
+        if (headers[i].IsBitcoinX()) {
+            const unsigned char* pheader = (const unsigned char*)BEGIN(headers[i].nVersion);
+            buf.insert(buf.end(), pheader, pheader + BLOCK_HEADER_HASHED_SIZE);
+            vX11.push_back(i);
+        } else {
+            out[i] = headers[i].GetHash();
+        }
+    }
+    std::vector<uint256> vHash(vX11.size());
+    HashX11Batch80(buf.data(), vX11.size(), vHash.data());
+    for (size_t j = 0; j < vX11.size(); j++) {
+        out[vX11[j]] = vHash[j];
+        headers[vX11[j]].hashCache.Set(&buf[j * BLOCK_HEADER_HASHED_SIZE], vHash[j]);
+    }
 }
 
 bool CBlockHeader::IsBitcoinX() const
@@ -11,6 +11,44 @@
 #include "uint256.h"
 #include "arith_uint256.h"
 
+#include <atomic>
+
+/** Size of the serialized header fields covered by the block hash
+ *  (nVersion, hashPrevBlock, hashMerkleRoot, nTime, nBits, nNonce). */
+static const size_t BLOCK_HEADER_HASHED_SIZE = 80;
+
+/** Memory-only cache of the hash computed for a block header.
+ *
+ * The header fields are public and get modified in place (mining, deserialization),
+ * so rather than requiring every writer to invalidate the cache, the entry is keyed
+ * by a copy of the hashed header bytes: a lookup is a memcmp of 80 bytes instead of
+ * a full X11 evaluation. The entry is filled once, by whichever thread hashes the
+ * header first, and published through an atomic state so that readers on other
+ * threads (validation, net, ZMQ, RPC) take no lock. A header modified after that
+ * still hashes correctly but is not cached again until Reset() (SetNull() does it).
+ */
+class CBlockHeaderHashCache
+{
+private:
+    enum : uint8_t { EMPTY, WRITING, READY };
+
+    mutable std::atomic<uint8_t> nState;
+    unsigned char vchHeader[BLOCK_HEADER_HASHED_SIZE];
+    uint256 hash;
+
+public:
+    CBlockHeaderHashCache() : nState(EMPTY) {}
+    CBlockHeaderHashCache(const CBlockHeaderHashCache& other);
+    CBlockHeaderHashCache& operator=(const CBlockHeaderHashCache& other);
+
+    /** Return true and set hashOut if pheader matches the cached header bytes. */
+    bool Get(const unsigned char* pheader, uint256& hashOut) const;
+    /** Fill the entry, unless it already holds a hash (or is being filled). */
+    void Set(const unsigned char* pheader, const uint256& hashIn);
+    /** Drop the entry. Only for the owner of a header it is about to overwrite. */
+    void Reset() { nState.store(EMPTY, std::memory_order_relaxed); }
+};
+
 /** Nodes collect new transactions into a block, hash them into a hash tree,
  * and scan through nonce values to make the block's hash satisfy proof-of-work
  * requirements.  When they solve the proof-of-work, they broadcast the block
@@ -31,6 +69,9 @@ public:
     std::vector<unsigned char> vchBlockSig;
     COutPoint prevoutStake;
 
+    // memory only
+    mutable CBlockHeaderHashCache hashCache;
+
     CBlockHeader()
     {
         SetNull();
@@ -62,6 +103,7 @@ public:
         nNonce = 0;
         vchBlockSig.clear();
         prevoutStake.SetNull();
+        hashCache.Reset();
     }
 
     bool IsNull() const
@@ -164,12 +206,23 @@ public:
         block.nNonce         = nNonce;
         block.vchBlockSig    = vchBlockSig;
         block.prevoutStake   = prevoutStake;
+        block.hashCache      = hashCache;
         return block;
     }
 
     std::string ToString() const;
 };
 
+/** Compute the X11 hashes of an array of n headers, several per pass when a
+ * multi-lane X11 implementation is available (see HashX11Batch80). For headers
+ * that GetHash() would X11-hash, the result is also stored in their hash cache.
+ */
+void HashX11Batch(const CBlockHeader* headers, size_t n, uint256* out);
+
+/** Compute GetHash() of an array of n headers. The ones that need X11 are hashed
+ *  together through HashX11Batch80; all results end up in the hash caches. */
+void GetBlockHeaderHashes(const CBlockHeader* headers, size_t n, uint256* out);
+
 /** Describes a place in the block chain to another node such that if the
  * other node doesn't have the same branch, it can find a recent common trunk.
  * The further back it is, the further before the fork it may be.
@@ -5,6 +5,7 @@
 
 #include "base58.h"
 #include "amount.h"
+#include "arith_uint256.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "consensus/consensus.h"
@@ -27,6 +28,7 @@
 #include "validationinterface.h"
 #include "warnings.h"
 
+#include <cmath>
 #include <memory>
 #include <stdint.h>
 
@@ -118,6 +120,10 @@ UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGen
         nHeightEnd = nHeight+nGenerate;
     }
     unsigned int nExtraNonce = 0;
+    int nThreads = gArgs.GetArg("-genproclimit", DEFAULT_GENERATE_THREADS);
+    if (nThreads <= 0)
+        nThreads = std::max(1, GetNumCores());
+    CNonceScanner scanner(nThreads);
     UniValue blockHashes(UniValue::VARR);
     while (nHeight < nHeightEnd)
     {
@@ -138,10 +144,10 @@ UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGen
                 continue;
             }
         } else {
-            while (nMaxTries > 0 && pblock->nNonce < nInnerLoopCount && !CheckProofOfWork(pblock->GetHash(), pblock->nBits, Params().GetConsensus())) {
-                ++pblock->nNonce;
-                --nMaxTries;
-            }
+            uint32_t nStartNonce = pblock->nNonce;
+            uint32_t nEndNonce = (uint32_t)std::min<uint64_t>(nInnerLoopCount, nStartNonce + nMaxTries);
+            scanner.ScanNonces(pblock.get(), nEndNonce, Params().GetConsensus());
+            nMaxTries -= pblock->nNonce - nStartNonce;
         }
 
         
@@ -219,6 +225,91 @@ UniValue setstaking(const JSONRPCRequest& request)
     return "";
 }
 
+UniValue getstakinginfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getstakinginfo\n"
+            "\nReturns staking health counters, kept since startup."
+            "\nResult:\n"
+            "{\n"
+            "  \"enabled\": true|false,      (boolean) Whether the staking thread is running\n"
+            "  \"weight\": nnn,              (numeric) The stake weight of the wallets, in satoshis\n"
+            "  \"difficulty\": xxx.xxxxx     (numeric) The difficulty of the last proof-of-stake block\n"
+            "  \"expectedtime\": nnn,        (numeric) Expected seconds of kernel search at proof-of-stake heights before finding a kernel\n"
+            "  \"searchinterval\": nnn,      (numeric) Seconds covered by the last unsuccessful search\n"
+            "  \"searches\": nnn,            (numeric) Kernel searches\n"
+            "  \"kernels\": nnn,             (numeric) Kernel hashes computed\n"
+            "  \"kernelspersec\": xxx.xxx,   (numeric) Kernel hashes per second of search\n"
+            "  \"skippedmaturity\": nnn,     (numeric) Candidates left out of a search for being too shallow\n"
+            "  \"skippedage\": nnn,          (numeric) Candidates left out of a search for being too young\n"
+            "  \"blocks\": {\n"
+            "    \"signed\": nnn,            (numeric) Blocks staked and signed\n"
+            "    \"stale\": nnn,             (numeric) Signed blocks whose parent was no longer the tip\n"
+            "    \"rejected\": nnn,          (numeric) Signed blocks that were not accepted\n"
+            "    \"stalerate\": x.xxx        (numeric) stale / signed\n"
+            "  },\n"
+            "  \"signlatency\": {            (json object) Signed blocks by time from the tip update they build on\n"
+            "    \"<100ms\": nnn,\n"
+            "    ...\n"
+            "    \">=60000ms\": nnn\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getstakinginfo", "")
+            + HelpExampleRpc("getstakinginfo", "")
+        );
+
+    uint64_t nWeight = 0;
+    for (CWalletRef pwallet : vpwallets)
+        nWeight += pwallet->GetStakeWeight();
+
+    LOCK(cs_main);
+
+    const CBlockIndex* pindexPoS = chainActive.Tip();
+    while (pindexPoS && !pindexPoS->IsProofOfStake())
+        pindexPoS = pindexPoS->pprev;
+    arith_uint256 bnTarget = UintToArith256(Params().GetConsensus().posLimit);
+    if (pindexPoS)
+        bnTarget.SetCompact(pindexPoS->nBits);
+
+    // Each timestamp slot succeeds with probability target * weight / 2^256.
+    double dExpectedTime = 0;
+    if (nWeight > 0 && bnTarget != 0)
+        dExpectedTime = (STAKE_TIMESTAMP_MASK + 1) / (bnTarget.getdouble() * nWeight / std::pow(2.0, 256));
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("enabled",          fStakeRun));
+    obj.push_back(Pair("weight",           nWeight));
+    obj.push_back(Pair("difficulty",       pindexPoS ? GetDifficulty(pindexPoS) : 0.0));
+    obj.push_back(Pair("expectedtime",     (int64_t)dExpectedTime));
+    obj.push_back(Pair("searchinterval",   nLastCoinStakeSearchInterval));
+    const uint64_t nSearchMicros = stakingStats.nSearchMicros;
+    const uint64_t nKernels = stakingStats.nKernels;
+    obj.push_back(Pair("searches",         (uint64_t)stakingStats.nSearches));
+    obj.push_back(Pair("kernels",          nKernels));
+    obj.push_back(Pair("kernelspersec",    nSearchMicros ? nKernels * 1000000.0 / nSearchMicros : 0.0));
+    obj.push_back(Pair("skippedmaturity",  (uint64_t)stakingStats.nSkippedMaturity));
+    obj.push_back(Pair("skippedage",       (uint64_t)stakingStats.nSkippedAge));
+
+    const uint64_t nSigned = stakingStats.nBlocksSigned;
+    const uint64_t nStale = stakingStats.nBlocksStale;
+    UniValue blocks(UniValue::VOBJ);
+    blocks.push_back(Pair("signed",        nSigned));
+    blocks.push_back(Pair("stale",         nStale));
+    blocks.push_back(Pair("rejected",      (uint64_t)stakingStats.nBlocksRejected));
+    blocks.push_back(Pair("stalerate",     nSigned ? (double)nStale / nSigned : 0.0));
+    obj.push_back(Pair("blocks",           blocks));
+
+    UniValue latency(UniValue::VOBJ);
+    for (size_t i = 0; i < STAKE_LATENCY_BUCKETS; i++) {
+        std::string strBucket = i < STAKE_LATENCY_BUCKETS - 1 ? strprintf("<%dms", STAKE_LATENCY_BUCKETS_MS[i]) : strprintf(">=%dms", STAKE_LATENCY_BUCKETS_MS[i - 1]);
+        latency.push_back(Pair(strBucket, (uint64_t)stakingStats.vSignLatency[i]));
+    }
+    obj.push_back(Pair("signlatency",      latency));
+    return obj;
+}
+
 UniValue getmininginfo(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0)
@@ -233,6 +324,7 @@ UniValue getmininginfo(const JSONRPCRequest& request)
             "  \"difficulty\": xxx.xxxxx    (numeric) The current difficulty\n"
             "  \"errors\": \"...\"            (string) Current errors\n"
             "  \"networkhashps\": nnn,      (numeric) The network hashes per second\n"
+            "  \"hashespersec\": nnn,       (numeric) The hash rate of the last generate call, in hashes per second\n"
             "  \"pooledtx\": n              (numeric) The size of the mempool\n"
             "  \"chain\": \"xxxx\",           (string) current network name as defined in BIP70 (main, test, regtest)\n"
             "}\n"
@@ -251,6 +343,7 @@ UniValue getmininginfo(const JSONRPCRequest& request)
     obj.push_back(Pair("difficulty",       (double)GetDifficulty()));
     obj.push_back(Pair("errors",           GetWarnings("statusbar")));
     obj.push_back(Pair("networkhashps",    getnetworkhashps(request)));
+    obj.push_back(Pair("hashespersec",     GetMinerHashesPerSec()));
     obj.push_back(Pair("pooledtx",         (uint64_t)mempool.size()));
     obj.push_back(Pair("chain",            Params().NetworkIDString()));
     return obj;
@@ -1008,6 +1101,7 @@ static const CRPCCommand commands[] =
 
     { "generating",         "generatetoaddress",      &generatetoaddress,      true,  {"nblocks","address","maxtries"} },
     { "generating",         "setstaking",             &setstaking,             true,  {"enable"} },
+    { "generating",         "getstakinginfo",         &getstakinginfo,         true,  {} },
 
     { "util",               "estimatefee",            &estimatefee,            true,  {"nblocks"} },
     { "util",               "estimatesmartfee",       &estimatesmartfee,       true,  {"conf_target", "estimate_mode"} },
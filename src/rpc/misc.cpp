@@ -3,6 +3,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "addressindexer.h"
 #include "base58.h"
 #include "chain.h"
 #include "clientversion.h"
@@ -16,6 +17,7 @@
 #include "rpc/blockchain.h"
 #include "rpc/server.h"
 #include "timedata.h"
+#include "txdb.h"
 #include "util.h"
 #include "utilstrencodings.h"
 #ifdef ENABLE_WALLET
@@ -355,6 +357,61 @@ bool getAddressesFromParams(const JSONRPCRequest& request, std::vector<std::pair
     return true;
 }
 
+/** Refuse index queries while the address index is still being built in the background. */
+void checkAddressIndexSynced()
+{
+    int height;
+    if (IsAddressIndexSyncing(height)) {
+        LOCK(cs_main);
+        throw JSONRPCError(RPC_IN_WARMUP, strprintf("Address index is syncing (at block %d of %d)", height, chainActive.Height()));
+    }
+}
+
+/** Page size of a paginated address index query that only gives a cursor */
+static const int DEFAULT_ADDRESS_PAGE_SIZE = 1000;
+
+/**
+ * Read the "limit" and "cursor" fields of an address index query. Returns
+ * false if it gives neither, i.e. wants all the results at once.
+ */
+bool getPageFromParams(const JSONRPCRequest& request, const std::string &emptyPosition, int &limit, std::string &position)
+{
+    if (!request.params[0].isObject())
+        return false;
+
+    UniValue limitValue = find_value(request.params[0].get_obj(), "limit");
+    UniValue cursorValue = find_value(request.params[0].get_obj(), "cursor");
+    if (limitValue.isNull() && cursorValue.isNull())
+        return false;
+
+    limit = DEFAULT_ADDRESS_PAGE_SIZE;
+    if (!limitValue.isNull()) {
+        limit = limitValue.get_int();
+        if (limit <= 0) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Limit is expected to be greater than zero");
+        }
+    }
+
+    position.clear();
+    if (!cursorValue.isNull()) {
+        const std::string cursor = cursorValue.get_str();
+        std::vector<unsigned char> data(ParseHex(cursor));
+        if (!IsHex(cursor) || data.size() != emptyPosition.size()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+        }
+        position.assign(data.begin(), data.end());
+    }
+    return true;
+}
+
+/** Cursor to resume a paginated query after the entry at position, or null if there is nothing after it. */
+UniValue cursorToJSON(bool more, const std::string &position)
+{
+    if (!more)
+        return NullUniValue;
+    return HexStr(position.begin(), position.end());
+}
+
 bool heightSort(std::pair<CAddressUnspentKey, CAddressUnspentValue> a,
                 std::pair<CAddressUnspentKey, CAddressUnspentValue> b) {
     return a.second.blockHeight < b.second.blockHeight;
@@ -377,6 +434,39 @@ bool getAddressFromIndex(const int &type, const uint160 &hash, std::string &addr
     return true;
 }
 
+UniValue addressDeltaToJSON(const CAddressIndexKey &key, CAmount amount)
+{
+    std::string address;
+    if (!getAddressFromIndex(key.type, key.hashBytes, address)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
+    }
+
+    UniValue delta(UniValue::VOBJ);
+    delta.push_back(Pair("satoshis", amount));
+    delta.push_back(Pair("txid", key.txhash.GetHex()));
+    delta.push_back(Pair("index", (int)key.index));
+    delta.push_back(Pair("blockindex", (int)key.txindex));
+    delta.push_back(Pair("height", key.blockHeight));
+    delta.push_back(Pair("address", address));
+    return delta;
+}
+
+UniValue addressUtxoToJSON(const CAddressUnspentKey &key, const CAddressUnspentValue &value)
+{
+    std::string address;
+    if (!getAddressFromIndex(key.type, key.hashBytes, address)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
+    }
+
+    UniValue output(UniValue::VOBJ);
+    output.push_back(Pair("address", address));
+    output.push_back(Pair("txid", key.txhash.GetHex()));
+    output.push_back(Pair("outputIndex", (int)key.index));
+    output.push_back(Pair("script", HexStr(value.script.begin(), value.script.end())));
+    output.push_back(Pair("satoshis", value.satoshis));
+    output.push_back(Pair("height", value.blockHeight));
+    return output;
+}
 
 UniValue getaddressdeltas(const JSONRPCRequest& request)
 {
@@ -394,6 +484,8 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
             "  \"chainInfo\" (boolean) Include chain info in results, only applies if start and end specified\n"
+            "  \"limit\" (number) Return at most this many deltas, with a cursor to the next page\n"
+            "  \"cursor\" (string) Continue from the cursor returned with the previous page\n"
             "}\n"
             "\nResult:\n"
             "[\n"
@@ -405,11 +497,17 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
             "    \"address\"  (string) The base58check encoded address\n"
             "  }\n"
             "]\n"
+            "\nResult (with limit or cursor):\n"
+            "{\n"
+            "  \"deltas\"  (array) The deltas as above, in block order across all the addresses\n"
+            "  \"cursor\"  (string) Cursor to the next page, null on the last one\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'")
             + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}")
         );
 
+    checkAddressIndexSynced();
 
     UniValue startValue = find_value(request.params[0].get_obj(), "start");
     UniValue endValue = find_value(request.params[0].get_obj(), "end");
@@ -440,36 +538,50 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    int limit = 0;
+    std::string position;
+    bool paged = getPageFromParams(request, CIndexDB::GetAddressKeyPosition(CAddressIndexKey()), limit, position);
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    UniValue deltas(UniValue::VARR);
+    UniValue cursor;
+
+    if (paged) {
+        // Stream the merged index up to one entry past the page, which tells
+        // whether there is a next page.
+        bool more = false;
+        auto addDelta = [&](const CAddressIndexKey &key, CAmount amount) {
+            if (end > 0 && key.blockHeight > end)
+                return false;
+            if ((int)deltas.size() == limit) {
+                more = true;
+                return false;
             }
+            deltas.push_back(addressDeltaToJSON(key, amount));
+            position = CIndexDB::GetAddressKeyPosition(key);
+            return true;
+        };
+        if (!ScanAddressIndex(addresses, start, position, addDelta)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
         }
-    }
-
-    UniValue deltas(UniValue::VARR);
+        cursor = cursorToJSON(more, position);
+    } else {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        std::string address;
-        if (!getAddressFromIndex(it->first.type, it->first.hashBytes, address)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
+        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+            if (start > 0 && end > 0) {
+                if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+                }
+            } else {
+                if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+                }
+            }
         }
 
-        UniValue delta(UniValue::VOBJ);
-        delta.push_back(Pair("satoshis", it->second));
-        delta.push_back(Pair("txid", it->first.txhash.GetHex()));
-        delta.push_back(Pair("index", (int)it->first.index));
-        delta.push_back(Pair("blockindex", (int)it->first.txindex));
-        delta.push_back(Pair("height", it->first.blockHeight));
-        delta.push_back(Pair("address", address));
-        deltas.push_back(delta);
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
+            deltas.push_back(addressDeltaToJSON(it->first, it->second));
+        }
     }
 
     UniValue result(UniValue::VOBJ);
@@ -494,9 +606,15 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
         endInfo.push_back(Pair("height", end));
 
         result.push_back(Pair("deltas", deltas));
+        if (paged)
+            result.push_back(Pair("cursor", cursor));
         result.push_back(Pair("start", startInfo));
         result.push_back(Pair("end", endInfo));
 
+        return result;
+    } else if (paged) {
+        result.push_back(Pair("deltas", deltas));
+        result.push_back(Pair("cursor", cursor));
         return result;
     } else {
         return deltas;
@@ -521,39 +639,57 @@ UniValue getaddressbalance(const JSONRPCRequest& request)
             "{\n"
             "  \"balance\"  (string) The current balance in satoshis\n"
             "  \"received\"  (string) The total number of satoshis received (including change)\n"
+            "  \"txcount\"  (numeric) The number of transactions involving the address(es), each counted once\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'")
             + HelpExampleRpc("getaddressbalance", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}")
         );
 
+    checkAddressIndexSynced();
+
     std::vector<std::pair<uint160, int> > addresses;
 
     if (!getAddressesFromParams(request, addresses)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    CAmount balance = 0;
+    CAmount received = 0;
+    int64_t txCount = 0;
 
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
+        CAddressBalanceValue value;
+        if (!GetAddressBalance((*it).first, (*it).second, value)) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
         }
+        balance += value.balance;
+        received += value.received;
+        txCount += value.txCount;
     }
 
-    CAmount balance = 0;
-    CAmount received = 0;
-
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        if (it->second > 0) {
-            received += it->second;
+    // A transaction can touch several of the addresses, so their records'
+    // counts do not add up. Their entries are next to each other in block
+    // order, so counting the distinct ones needs no more than a scan.
+    if (addresses.size() > 1) {
+        txCount = 0;
+        uint256 last;
+        auto countTx = [&](const CAddressIndexKey &key, CAmount amount) {
+            if (txCount == 0 || key.txhash != last) {
+                last = key.txhash;
+                txCount++;
+            }
+            return true;
+        };
+        if (!ScanAddressIndex(addresses, 0, std::string(), countTx)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
         }
-        balance += it->second;
     }
 
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("balance", balance));
     result.push_back(Pair("received", received));
+    result.push_back(Pair("txcount", txCount));
 
     return result;
 }
@@ -572,6 +708,8 @@ UniValue getaddressutxos(const JSONRPCRequest& request)
             "      ,...\n"
             "    ],\n"
             "  \"chainInfo\"  (boolean) Include chain info with results\n"
+            "  \"limit\"  (number) Return at most this many outputs, with a cursor to the next page\n"
+            "  \"cursor\"  (string) Continue from the cursor returned with the previous page\n"
             "}\n"
             "\nResult\n"
             "[\n"
@@ -584,11 +722,20 @@ UniValue getaddressutxos(const JSONRPCRequest& request)
             "    \"satoshis\"  (number) The number of satoshis of the output\n"
             "  }\n"
             "]\n"
+            "\nResult (with chainInfo, limit or cursor):\n"
+            "{\n"
+            "  \"utxos\"  (array) The outputs as above; ordered by txid instead of height when paginated\n"
+            "  \"cursor\"  (string) Cursor to the next page, null on the last one (only when paginated)\n"
+            "  \"hash\"  (string) The tip block hash (only with chainInfo)\n"
+            "  \"height\"  (number) The tip block height (only with chainInfo)\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'")
             + HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}")
             );
 
+    checkAddressIndexSynced();
+
     bool includeChainInfo = false;
     if (request.params[0].isObject()) {
         UniValue chainInfo = find_value(request.params[0].get_obj(), "chainInfo");
@@ -603,41 +750,57 @@ UniValue getaddressutxos(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    int limit = 0;
+    std::string position;
+    bool paged = getPageFromParams(request, CIndexDB::GetAddressKeyPosition(CAddressUnspentKey()), limit, position);
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
+    UniValue utxos(UniValue::VARR);
+    UniValue cursor;
+
+    if (paged) {
+        // The index is keyed by txid after the address, so pages come in
+        // txid order; sorting by height would need the whole set.
+        bool more = false;
+        auto addUtxo = [&](const CAddressUnspentKey &key, const CAddressUnspentValue &value) {
+            if ((int)utxos.size() == limit) {
+                more = true;
+                return false;
+            }
+            utxos.push_back(addressUtxoToJSON(key, value));
+            position = CIndexDB::GetAddressKeyPosition(key);
+            return true;
+        };
+        if (!ScanAddressUnspent(addresses, position, addUtxo)) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
         }
-    }
+        cursor = cursorToJSON(more, position);
+    } else {
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
 
-    std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
+        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+            if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
+        }
 
-    UniValue utxos(UniValue::VARR);
+        std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
 
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++) {
-        UniValue output(UniValue::VOBJ);
-        std::string address;
-        if (!getAddressFromIndex(it->first.type, it->first.hashBytes, address)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
+        for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++) {
+            utxos.push_back(addressUtxoToJSON(it->first, it->second));
         }
-
-        output.push_back(Pair("address", address));
-        output.push_back(Pair("txid", it->first.txhash.GetHex()));
-        output.push_back(Pair("outputIndex", (int)it->first.index));
-        output.push_back(Pair("script", HexStr(it->second.script.begin(), it->second.script.end())));
-        output.push_back(Pair("satoshis", it->second.satoshis));
-        output.push_back(Pair("height", it->second.blockHeight));
-        utxos.push_back(output);
     }
 
-    if (includeChainInfo) {
+    if (includeChainInfo || paged) {
         UniValue result(UniValue::VOBJ);
         result.push_back(Pair("utxos", utxos));
+        if (paged)
+            result.push_back(Pair("cursor", cursor));
 
-        LOCK(cs_main);
-        result.push_back(Pair("hash", chainActive.Tip()->GetBlockHash().GetHex()));
-        result.push_back(Pair("height", (int)chainActive.Height()));
+        if (includeChainInfo) {
+            LOCK(cs_main);
+            result.push_back(Pair("hash", chainActive.Tip()->GetBlockHash().GetHex()));
+            result.push_back(Pair("height", (int)chainActive.Height()));
+        }
         return result;
     } else {
         return utxos;
@@ -675,6 +838,8 @@ UniValue getaddressmempool(const JSONRPCRequest& request)
             + HelpExampleRpc("getaddressmempool", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}")
         );
 
+    checkAddressIndexSynced();
+
     std::vector<std::pair<uint160, int> > addresses;
 
     if (!getAddressesFromParams(request, addresses)) {
@@ -745,6 +910,8 @@ UniValue getblockhashes(const JSONRPCRequest& request)
             + HelpExampleCli("getblockhashes", "1231614698 1231024505 '{\"noOrphans\":false, \"logicalTimes\":true}'")
             );
 
+    checkAddressIndexSynced();
+
     unsigned int high = request.params[0].get_int();
     unsigned int low = request.params[1].get_int();
     bool fActiveOnly = false;
@@ -765,9 +932,6 @@ UniValue getblockhashes(const JSONRPCRequest& request)
 
     std::vector<std::pair<uint256, unsigned int> > blockHashes;
 
-    if (fActiveOnly)
-        LOCK(cs_main);
-
     if (!GetTimestampIndex(high, low, fActiveOnly, blockHashes)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for block hashes");
     }
@@ -811,6 +975,8 @@ UniValue getspentinfo(const JSONRPCRequest& request)
             + HelpExampleRpc("getspentinfo", "{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}")
         );
 
+    checkAddressIndexSynced();
+
     UniValue txidValue = find_value(request.params[0].get_obj(), "txid");
     UniValue indexValue = find_value(request.params[0].get_obj(), "index");
 
@@ -851,17 +1017,26 @@ UniValue getaddresstxids(const JSONRPCRequest& request)
             "    ]\n"
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
+            "  \"limit\" (number) Return at most this many txids, with a cursor to the next page\n"
+            "  \"cursor\" (string) Continue from the cursor returned with the previous page\n"
             "}\n"
             "\nResult:\n"
             "[\n"
             "  \"transactionid\"  (string) The transaction id\n"
             "  ,...\n"
             "]\n"
+            "\nResult (with limit or cursor):\n"
+            "{\n"
+            "  \"txids\"  (array) The txids as above, in block order\n"
+            "  \"cursor\"  (string) Cursor to the next page, null on the last one\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'")
             + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}")
         );
 
+    checkAddressIndexSynced();
+
     std::vector<std::pair<uint160, int> > addresses;
 
     if (!getAddressesFromParams(request, addresses)) {
@@ -879,6 +1054,38 @@ UniValue getaddresstxids(const JSONRPCRequest& request)
         }
     }
 
+    int limit = 0;
+    std::string position;
+    if (getPageFromParams(request, CIndexDB::GetAddressKeyPosition(CAddressIndexKey()), limit, position)) {
+        // The entries of a transaction are next to each other in block
+        // order, so a page only ends between two transactions.
+        UniValue txids(UniValue::VARR);
+        uint256 last;
+        bool more = false;
+        auto addTxid = [&](const CAddressIndexKey &key, CAmount amount) {
+            if (end > 0 && key.blockHeight > end)
+                return false;
+            if (txids.size() == 0 || key.txhash != last) {
+                if ((int)txids.size() == limit) {
+                    more = true;
+                    return false;
+                }
+                last = key.txhash;
+                txids.push_back(last.GetHex());
+            }
+            position = CIndexDB::GetAddressKeyPosition(key);
+            return true;
+        };
+        if (!ScanAddressIndex(addresses, start, position, addTxid)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        }
+
+        UniValue result(UniValue::VOBJ);
+        result.push_back(Pair("txids", txids));
+        result.push_back(Pair("cursor", cursorToJSON(more, position)));
+        return result;
+    }
+
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
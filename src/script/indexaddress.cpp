@@ -0,0 +1,56 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "script/indexaddress.h"
+
+#include "hash.h"
+#include "script/script.h"
+
+#include <string.h>
+
+bool ExtractIndexAddress(const CScript& script, int& addressType, uint160& hash)
+{
+    if (script.IsPayToScriptHash()) {
+        memcpy(hash.begin(), &script[2], 20);
+        addressType = 2;
+    } else if (script.IsPayToPubkeyHash()) {
+        memcpy(hash.begin(), &script[3], 20);
+        addressType = 1;
+    } else if (script.IsPayToPubkey()) {
+        hash = Hash160(&script[1], &script[script.size() - 1]);
+        addressType = 1;
+    } else {
+        hash.SetNull();
+        addressType = 0;
+        return false;
+    }
+    return true;
+}
+
+CIndexAddressExtractor::CIndexAddressExtractor()
+{
+    for (PubKeySlot& slot : slots) {
+        slot.nSize = 0;
+    }
+}
+
+bool CIndexAddressExtractor::Extract(const CScript& script, int& addressType, uint160& hash)
+{
+    if (!script.IsPayToPubkey())
+        return ExtractIndexAddress(script, addressType, hash);
+
+    // The pubkey's x coordinate is as good as random, so its first byte
+    // picks the slot.
+    const unsigned char* pubkey = &script[1];
+    const unsigned char nSize = script.size() - 2;
+    PubKeySlot& slot = slots[pubkey[1] % PUBKEY_SLOTS];
+    if (slot.nSize != nSize || memcmp(slot.vch, pubkey, nSize) != 0) {
+        slot.nSize = nSize;
+        memcpy(slot.vch, pubkey, nSize);
+        slot.hash = Hash160(pubkey, pubkey + nSize);
+    }
+    hash = slot.hash;
+    addressType = 1;
+    return true;
+}
@@ -0,0 +1,44 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SCRIPT_INDEXADDRESS_H
+#define BITCOIN_SCRIPT_INDEXADDRESS_H
+
+#include "uint256.h"
+
+class CScript;
+
+/**
+ * The address index key of a script that pays to an address: type 1 and
+ * the key hash for pay to pubkey hash and pay to pubkey, type 2 and the
+ * script hash for pay to script hash. Any other script gives false, type 0
+ * and a null hash. Does not allocate.
+ */
+bool ExtractIndexAddress(const CScript& script, int& addressType, uint160& hash);
+
+/**
+ * ExtractIndexAddress, remembering the key hashes of the last pay to pubkey
+ * scripts seen. Meant to live for a block or a transaction, where stakers
+ * spend and pay to the same pubkey over and over.
+ */
+class CIndexAddressExtractor
+{
+public:
+    CIndexAddressExtractor();
+
+    bool Extract(const CScript& script, int& addressType, uint160& hash);
+
+private:
+    static const unsigned int PUBKEY_SLOTS = 16;
+
+    struct PubKeySlot {
+        unsigned char nSize;
+        unsigned char vch[65];
+        uint160 hash;
+    };
+
+    PubKeySlot slots[PUBKEY_SLOTS];
+};
+
+#endif // BITCOIN_SCRIPT_INDEXADDRESS_H
@@ -0,0 +1,193 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <vector>
+
+/**
+ * Memory resource for node based containers, which allocate one node at a
+ * time. Blocks of up to MAX_BLOCK_SIZE_BYTES are cut out of large chunks,
+ * and freed blocks go to a free list per size to be handed out again, so
+ * a node costs neither a malloc header nor malloc's rounding. Chunks are
+ * only given back when the resource is destroyed.
+ *
+ * Larger or more aligned allocations, such as the bucket array of a hash
+ * map, go to operator new.
+ */
+template <size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+class PoolResource
+{
+private:
+    /** A free block, linked to the next free block of its size */
+    struct ListNode {
+        ListNode* next;
+    };
+
+    static const size_t ELEM_ALIGN_BYTES = ALIGN_BYTES > sizeof(ListNode) ? ALIGN_BYTES : sizeof(ListNode);
+    static_assert((ELEM_ALIGN_BYTES & (ELEM_ALIGN_BYTES - 1)) == 0, "ELEM_ALIGN_BYTES must be a power of two");
+    static_assert(ELEM_ALIGN_BYTES <= alignof(std::max_align_t), "chunks from operator new must be aligned for the blocks");
+
+    static const size_t CHUNK_SIZE_BYTES = 256 * 1024;
+    static_assert(CHUNK_SIZE_BYTES % ELEM_ALIGN_BYTES == 0, "chunks must hold whole blocks");
+    static_assert(MAX_BLOCK_SIZE_BYTES <= CHUNK_SIZE_BYTES, "blocks must fit in a chunk");
+
+    //! Free lists, indexed by block size in units of ELEM_ALIGN_BYTES
+    std::array<ListNode*, MAX_BLOCK_SIZE_BYTES / ELEM_ALIGN_BYTES + 1> vFreeLists;
+    std::vector<char*> vChunks;
+    //! What is left of the last chunk
+    char* pAvailable;
+    char* pAvailableEnd;
+
+    static bool IsPooled(size_t nBytes, size_t nAlignment)
+    {
+        return nBytes <= MAX_BLOCK_SIZE_BYTES && nAlignment <= ELEM_ALIGN_BYTES;
+    }
+
+    static size_t NumElemAlign(size_t nBytes)
+    {
+        return (nBytes + ELEM_ALIGN_BYTES - 1) / ELEM_ALIGN_BYTES;
+    }
+
+    void PushFree(void* p, size_t nIndex)
+    {
+        ListNode* node = new (p) ListNode;
+        node->next = vFreeLists[nIndex];
+        vFreeLists[nIndex] = node;
+    }
+
+    void AllocateChunk()
+    {
+        // The rest of the last chunk is a whole number of blocks, one block
+        // of which goes to the free list of its size.
+        const size_t nLeft = pAvailableEnd - pAvailable;
+        if (nLeft > 0) {
+            PushFree(pAvailable, NumElemAlign(nLeft));
+        }
+        vChunks.reserve(vChunks.size() + 1);
+        pAvailable = static_cast<char*>(::operator new(CHUNK_SIZE_BYTES));
+        pAvailableEnd = pAvailable + CHUNK_SIZE_BYTES;
+        vChunks.push_back(pAvailable);
+    }
+
+public:
+    PoolResource() : pAvailable(nullptr), pAvailableEnd(nullptr)
+    {
+        vFreeLists.fill(nullptr);
+    }
+
+    ~PoolResource()
+    {
+        for (char* pChunk : vChunks) {
+            ::operator delete(pChunk);
+        }
+    }
+
+    PoolResource(const PoolResource&) = delete;
+    PoolResource& operator=(const PoolResource&) = delete;
+
+    void* Allocate(size_t nBytes, size_t nAlignment)
+    {
+        if (!IsPooled(nBytes, nAlignment)) {
+            return ::operator new(nBytes);
+        }
+        const size_t nIndex = NumElemAlign(nBytes);
+        if (vFreeLists[nIndex] != nullptr) {
+            ListNode* node = vFreeLists[nIndex];
+            vFreeLists[nIndex] = node->next;
+            node->~ListNode();
+            return node;
+        }
+        const size_t nRoundBytes = nIndex * ELEM_ALIGN_BYTES;
+        if (size_t(pAvailableEnd - pAvailable) < nRoundBytes) {
+            AllocateChunk();
+        }
+        void* p = pAvailable;
+        pAvailable += nRoundBytes;
+        return p;
+    }
+
+    void Deallocate(void* p, size_t nBytes, size_t nAlignment) noexcept
+    {
+        if (!IsPooled(nBytes, nAlignment)) {
+            ::operator delete(p);
+            return;
+        }
+        PushFree(p, NumElemAlign(nBytes));
+    }
+
+    size_t NumAllocatedChunks() const { return vChunks.size(); }
+    size_t ChunkSizeBytes() const { return CHUNK_SIZE_BYTES; }
+};
+
+/**
+ * Allocator taking its memory from a PoolResource, which has to outlive the
+ * container. Without a resource, it allocates with operator new as
+ * std::allocator does, so containers using it can still be default
+ * constructed.
+ */
+template <typename T, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES = alignof(T)>
+class PoolAllocator
+{
+public:
+    typedef T value_type;
+    typedef PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> ResourceType;
+
+    template <typename U>
+    struct rebind {
+        typedef PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> other;
+    };
+
+    PoolAllocator() noexcept : pResource(nullptr) {}
+    explicit PoolAllocator(ResourceType* pResourceIn) noexcept : pResource(pResourceIn) {}
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& other) noexcept : pResource(other.resource())
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+        if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+            throw std::bad_alloc();
+        }
+        if (pResource == nullptr) {
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+        return static_cast<T*>(pResource->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, size_t n) noexcept
+    {
+        if (pResource == nullptr) {
+            ::operator delete(p);
+            return;
+        }
+        pResource->Deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    ResourceType* resource() const noexcept { return pResource; }
+
+private:
+    ResourceType* pResource;
+};
+
+template <typename T, typename U, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+bool operator==(const PoolAllocator<T, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a, const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) noexcept
+{
+    return a.resource() == b.resource();
+}
+
+template <typename T, typename U, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+bool operator!=(const PoolAllocator<T, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a, const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) noexcept
+{
+    return !(a == b);
+}
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOL_H
@@ -0,0 +1,64 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "activeaddresses.h"
+
+#include "arith_uint256.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(activeaddresses_tests, BasicTestingSetup)
+
+static uint160 Address(int n)
+{
+    return uint160(std::vector<unsigned char>(20, (unsigned char)n));
+}
+
+static uint256 BlockHash(int nHeight)
+{
+    return ArithToUint256(arith_uint256(nHeight + 1));
+}
+
+BOOST_AUTO_TEST_CASE(window_follows_tip)
+{
+    CActiveAddresses active(100);
+    BOOST_CHECK(active.IsEmpty());
+    BOOST_CHECK_EQUAL(active.Count(), 0U);
+    BOOST_CHECK_EQUAL(active.FrontHeight(), -1);
+
+    // Addresses repeated within and across blocks count once.
+    active.PushBack(BlockHash(0), 0, 1000, {Address(1), Address(2), Address(1)});
+    active.PushBack(BlockHash(1), 1, 1050, {Address(2), Address(3)});
+    BOOST_CHECK_EQUAL(active.Count(), 3U);
+    BOOST_CHECK(active.TipHash() == BlockHash(1));
+
+    // Block 0 is exactly one window behind and drops out, address 2 stays.
+    active.PushBack(BlockHash(2), 2, 1100, {Address(4)});
+    BOOST_CHECK_EQUAL(active.Count(), 3U);
+    BOOST_CHECK_EQUAL(active.FrontHeight(), 1);
+    BOOST_CHECK(!active.InWindow(1000));
+    BOOST_CHECK(active.InWindow(1001));
+
+    // Disconnecting the tip lets block 0 back in.
+    BOOST_CHECK(active.PopBack());
+    BOOST_CHECK_EQUAL(active.Count(), 2U);
+    BOOST_CHECK(active.InWindow(1000));
+    BOOST_CHECK(active.PushFront(BlockHash(0), 0, 1000, {Address(1), Address(2)}));
+    BOOST_CHECK_EQUAL(active.Count(), 3U);
+    BOOST_CHECK(!active.PushFront(BlockHash(5), 5, 950, {Address(5)}));
+    BOOST_CHECK_EQUAL(active.Count(), 3U);
+
+    BOOST_CHECK(active.PopBack());
+    BOOST_CHECK(active.PopBack());
+    BOOST_CHECK(!active.PopBack());
+    BOOST_CHECK_EQUAL(active.Count(), 0U);
+
+    active.PushBack(BlockHash(0), 0, 1000, {Address(1)});
+    active.Clear();
+    BOOST_CHECK(active.IsEmpty());
+    BOOST_CHECK_EQUAL(active.Count(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
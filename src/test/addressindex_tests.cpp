@@ -0,0 +1,95 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "script/standard.h"
+#include "test/test_bitcoin.h"
+#include "txdb.h"
+#include "validation.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+/** A chain of 100 blocks, with the address index enabled from the next block on. */
+struct AddressIndexSetup : public TestChain100Setup {
+    AddressIndexSetup() { fAddressIndex = true; }
+    ~AddressIndexSetup() { fAddressIndex = false; }
+};
+
+/** The balance record of a pay to pubkey hash address, and the active address count. */
+struct IndexState {
+    CAddressBalanceValue value;
+    uint64_t nCount = 0;
+};
+
+IndexState ReadIndexState(const CKeyID& keyid)
+{
+    IndexState state;
+    pindexdb->ReadAddressBalance(CAddressBalanceKey(1, keyid), state.value);
+    pindexdb->ReadAddressCounter(state.nCount);
+    return state;
+}
+
+void CheckIndexState(const IndexState& state, const IndexState& expected)
+{
+    BOOST_CHECK_EQUAL(state.value.balance, expected.value.balance);
+    BOOST_CHECK_EQUAL(state.value.received, expected.value.received);
+    BOOST_CHECK_EQUAL(state.value.txCount, expected.value.txCount);
+    BOOST_CHECK_EQUAL(state.nCount, expected.nCount);
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_tests, AddressIndexSetup)
+
+BOOST_AUTO_TEST_CASE(addressindex_replay_after_crash)
+{
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    const CKeyID keyid = coinbaseKey.GetPubKey().GetID();
+    const CScript scriptPubKey = GetScriptForDestination(keyid);
+    CreateAndProcessBlock({}, scriptPubKey);
+    CreateAndProcessBlock({}, scriptPubKey);
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    const IndexState expected = ReadIndexState(keyid);
+    BOOST_CHECK_EQUAL(expected.value.txCount, 2);
+    BOOST_CHECK(expected.value.balance > 0);
+
+    // The index writes reach the disk, then the node crashes before the
+    // chain state does: the blocks connected again find them written.
+    BOOST_CHECK(pindexdb->Flush());
+    BOOST_CHECK(IndexBlockFromDisk(pindexTip->pprev, false, consensusParams));
+    BOOST_CHECK(IndexBlockFromDisk(pindexTip, false, consensusParams));
+    CheckIndexState(ReadIndexState(keyid), expected);
+
+    // Taking out a block below the tip of the indexes takes out the tip
+    // first, and blocks taken out already are not taken out again.
+    BOOST_CHECK(IndexBlockFromDisk(pindexTip->pprev, true, consensusParams));
+    BOOST_CHECK(IndexBlockFromDisk(pindexTip, true, consensusParams));
+    const IndexState empty = ReadIndexState(keyid);
+    BOOST_CHECK_EQUAL(empty.value.balance, 0);
+    BOOST_CHECK_EQUAL(empty.value.txCount, 0);
+    BOOST_CHECK_EQUAL(empty.nCount, expected.nCount - 1);
+    BOOST_CHECK(IndexBlockFromDisk(pindexTip->pprev, false, consensusParams));
+    BOOST_CHECK(IndexBlockFromDisk(pindexTip, false, consensusParams));
+    CheckIndexState(ReadIndexState(keyid), expected);
+
+    // The chain state comes back one block behind, and a block of another
+    // branch is connected on it: the indexes drop the old tip for it.
+    CValidationState state;
+    BOOST_CHECK(InvalidateBlock(state, Params(), mapBlockIndex[pindexTip->GetBlockHash()]));
+    CKey key;
+    key.MakeNewKey(true);
+    const CKeyID keyidFork = key.GetPubKey().GetID();
+    CreateAndProcessBlock({}, GetScriptForDestination(keyidFork));
+    BOOST_CHECK(chainActive.Tip()->pprev == pindexTip->pprev);
+    BOOST_CHECK_EQUAL(ReadIndexState(keyidFork).value.txCount, 1);
+    BOOST_CHECK(pindexdb->Flush());
+    BOOST_CHECK(IndexBlockFromDisk(pindexTip, false, consensusParams));
+    BOOST_CHECK_EQUAL(ReadIndexState(keyidFork).value.txCount, 0);
+    CheckIndexState(ReadIndexState(keyid), expected);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
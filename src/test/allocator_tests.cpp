@@ -2,11 +2,15 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "memusage.h"
 #include "util.h"
 
+#include "support/allocators/pool.h"
 #include "support/allocators/secure.h"
 #include "test/test_bitcoin.h"
 
+#include <unordered_map>
+
 #include <boost/test/unit_test.hpp>
 
 BOOST_FIXTURE_TEST_SUITE(allocator_tests, BasicTestingSetup)
@@ -204,6 +208,74 @@ BOOST_AUTO_TEST_CASE(lockedpool_tests_mock)
     BOOST_CHECK(pool.stats().used == 0);
 }
 
+BOOST_AUTO_TEST_CASE(pool_resource_tests)
+{
+    PoolResource<64, 8> resource;
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 0U);
+
+    // Blocks of one size come one after the other out of the first chunk
+    void *a0 = resource.Allocate(24, 8);
+    void *a1 = resource.Allocate(24, 8);
+    BOOST_CHECK_EQUAL(static_cast<char*>(a1) - static_cast<char*>(a0), 24);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+
+    // A freed block is the next one of its size handed out, not of another size
+    resource.Deallocate(a0, 24, 8);
+    void *a2 = resource.Allocate(32, 8);
+    BOOST_CHECK(a2 != a0);
+    void *a3 = resource.Allocate(20, 8);
+    BOOST_CHECK(a3 == a0);
+
+    // Larger allocations are not pooled
+    void *a4 = resource.Allocate(128, 8);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+    resource.Deallocate(a4, 128, 8);
+
+    // Filling the chunk takes another one
+    const size_t nBlocks = resource.ChunkSizeBytes() / 64;
+    for (size_t i = 0; i < nBlocks; i++) {
+        resource.Allocate(64, 8);
+    }
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+    resource.Deallocate(a1, 24, 8);
+    resource.Deallocate(a2, 32, 8);
+    resource.Deallocate(a3, 24, 8);
+}
+
+BOOST_AUTO_TEST_CASE(pool_allocator_tests)
+{
+    typedef PoolAllocator<std::pair<const int, int>, 64, 8> Allocator;
+    typedef std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, Allocator> Map;
+
+    Allocator::ResourceType resource;
+    {
+        Map map(0, std::hash<int>(), std::equal_to<int>(), Allocator(&resource));
+        for (int i = 0; i < 10000; i++) {
+            map.emplace(i, i);
+        }
+        for (int i = 0; i < 10000; i += 2) {
+            map.erase(i);
+        }
+        for (int i = 0; i < 10000; i++) {
+            BOOST_CHECK_EQUAL(map.count(i), size_t(i % 2));
+        }
+        const size_t nChunks = resource.NumAllocatedChunks();
+        BOOST_CHECK(nChunks > 0);
+        // The erased nodes are reused
+        for (int i = 0; i < 10000; i += 2) {
+            map.emplace(i, i);
+        }
+        BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), nChunks);
+        BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), memusage::MallocUsage(resource.ChunkSizeBytes()) * nChunks + memusage::MallocUsage(sizeof(void*) * map.bucket_count()));
+    }
+
+    // Without a resource, the map allocates as with std::allocator
+    Map map;
+    map.emplace(1, 1);
+    BOOST_CHECK(map.get_allocator().resource() == nullptr);
+    BOOST_CHECK_EQUAL(map.at(1), 1);
+}
+
 // These tests used the live LockedPoolManager object, this is also used
 // by other tests so the conditions are somewhat less controllable and thus the
 // tests are somewhat more error-prone.
@@ -0,0 +1,123 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blocktimeindex.h"
+
+#include "arith_uint256.h"
+#include "chain.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blocktimeindex_tests, BasicTestingSetup)
+
+typedef std::vector<std::pair<uint256, unsigned int> > BlockHashes;
+
+/** A chain of fake block indexes with the given times, branching off pprev. */
+struct FakeChain {
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex> vBlocks;
+
+    FakeChain(const CBlockIndex* pprev, const std::vector<unsigned int>& vTimes, int nSeed)
+        : vHashes(vTimes.size()), vBlocks(vTimes.size())
+    {
+        for (size_t i = 0; i < vTimes.size(); i++) {
+            vHashes[i] = ArithToUint256(arith_uint256(nSeed * 1000 + i));
+            vBlocks[i].phashBlock = &vHashes[i];
+            vBlocks[i].pprev = i == 0 ? const_cast<CBlockIndex*>(pprev) : &vBlocks[i - 1];
+            vBlocks[i].nHeight = vBlocks[i].pprev ? vBlocks[i].pprev->nHeight + 1 : 0;
+            vBlocks[i].nTime = vTimes[i];
+        }
+    }
+};
+
+BOOST_AUTO_TEST_CASE(logical_times_follow_tip)
+{
+    // Block 2 is older than block 1, and takes one second after it.
+    FakeChain chain(nullptr, {1000, 1010, 1005, 1020}, 1);
+    CBlockTimeIndex index;
+    for (const CBlockIndex& block : chain.vBlocks) {
+        BOOST_CHECK(index.Connect(&block));
+    }
+    BOOST_CHECK(!index.Connect(&chain.vBlocks[1]));
+
+    BlockHashes hashes;
+    index.Find(1020, 1005, false, hashes);
+    BOOST_REQUIRE_EQUAL(hashes.size(), 2U);
+    BOOST_CHECK(hashes[0] == std::make_pair(chain.vHashes[1], 1010U));
+    BOOST_CHECK(hashes[1] == std::make_pair(chain.vHashes[2], 1011U));
+
+    // Reorganise onto a fork after block 1. The blocks disconnected stay as
+    // stale blocks, unless the active chain only is asked for.
+    FakeChain fork(&chain.vBlocks[1], {1015, 1030}, 2);
+    BOOST_CHECK(!index.Disconnect(&chain.vBlocks[2]));
+    BOOST_CHECK(index.Disconnect(&chain.vBlocks[3]));
+    BOOST_CHECK(index.Disconnect(&chain.vBlocks[2]));
+    BOOST_CHECK(index.Connect(&fork.vBlocks[0]));
+    BOOST_CHECK(index.Connect(&fork.vBlocks[1]));
+
+    hashes.clear();
+    index.Find(2000, 1011, false, hashes);
+    BOOST_REQUIRE_EQUAL(hashes.size(), 4U);
+    BOOST_CHECK(hashes[0] == std::make_pair(chain.vHashes[2], 1011U));
+    BOOST_CHECK(hashes[1] == std::make_pair(fork.vHashes[0], 1015U));
+    BOOST_CHECK(hashes[2] == std::make_pair(chain.vHashes[3], 1020U));
+    BOOST_CHECK(hashes[3] == std::make_pair(fork.vHashes[1], 1030U));
+
+    hashes.clear();
+    index.Find(2000, 1011, true, hashes);
+    BOOST_REQUIRE_EQUAL(hashes.size(), 2U);
+    BOOST_CHECK(hashes[0].first == fork.vHashes[0]);
+    BOOST_CHECK(hashes[1].first == fork.vHashes[1]);
+
+    // Going back to the original chain takes its blocks out of the stale ones.
+    BOOST_CHECK(index.Disconnect(&fork.vBlocks[1]));
+    BOOST_CHECK(index.Disconnect(&fork.vBlocks[0]));
+    BOOST_CHECK(index.Connect(&chain.vBlocks[2]));
+    BOOST_CHECK(index.Connect(&chain.vBlocks[3]));
+    hashes.clear();
+    index.Find(2000, 0, false, hashes);
+    BOOST_CHECK_EQUAL(hashes.size(), 6U);
+    hashes.clear();
+    index.Find(2000, 0, true, hashes);
+    BOOST_CHECK_EQUAL(hashes.size(), 4U);
+}
+
+BOOST_AUTO_TEST_CASE(load_matches_connect)
+{
+    FakeChain chain(nullptr, {1000, 1010, 1005, 1020, 1040}, 1);
+    FakeChain fork(&chain.vBlocks[2], {1003, 1004}, 2);
+
+    CBlockTimeIndex connected;
+    for (size_t i = 0; i < 3; i++) {
+        BOOST_CHECK(connected.Connect(&chain.vBlocks[i]));
+    }
+    BOOST_CHECK(connected.Connect(&fork.vBlocks[0]));
+    BOOST_CHECK(connected.Connect(&fork.vBlocks[1]));
+    BOOST_CHECK(connected.Disconnect(&fork.vBlocks[1]));
+    BOOST_CHECK(connected.Disconnect(&fork.vBlocks[0]));
+    for (size_t i = 3; i < chain.vBlocks.size(); i++) {
+        BOOST_CHECK(connected.Connect(&chain.vBlocks[i]));
+    }
+
+    // Stale blocks given children first still get their parents' times.
+    CBlockTimeIndex loaded;
+    loaded.Load(&chain.vBlocks.back(), {&fork.vBlocks[1], &fork.vBlocks[0]});
+
+    BlockHashes hashesConnected, hashesLoaded;
+    connected.Find(2000, 0, false, hashesConnected);
+    loaded.Find(2000, 0, false, hashesLoaded);
+    BOOST_CHECK_EQUAL(hashesLoaded.size(), 7U);
+    BOOST_CHECK(hashesConnected == hashesLoaded);
+    BOOST_CHECK(hashesLoaded[3] == std::make_pair(fork.vHashes[0], 1012U));
+    BOOST_CHECK(hashesLoaded[4] == std::make_pair(fork.vHashes[1], 1013U));
+
+    loaded.Clear();
+    hashesLoaded.clear();
+    loaded.Find(2000, 0, false, hashesLoaded);
+    BOOST_CHECK(hashesLoaded.empty());
+    BOOST_CHECK(loaded.Connect(&chain.vBlocks[0]));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -707,6 +707,74 @@ BOOST_AUTO_TEST_CASE(ccoins_spend)
     CheckSpendCoins(VALUE1, VALUE2, ABSENT, DIRTY|FRESH, NO_ENTRY   );
 }
 
+void CheckAddFetchedCoin(CAmount cache_value, CAmount expected_value, char cache_flags, char expected_flags)
+{
+    SingleEntryCacheTest test(ABSENT, cache_value, cache_flags);
+    Coin coin;
+    SetCoinsValue(VALUE3, coin);
+    test.cache.AddFetchedCoin(OUTPOINT, std::move(coin));
+    test.cache.SelfTest();
+
+    CAmount result_value;
+    char result_flags;
+    GetCoinsMapEntry(test.cache.map(), result_value, result_flags);
+    BOOST_CHECK_EQUAL(result_value, expected_value);
+    BOOST_CHECK_EQUAL(result_flags, expected_flags);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_add_fetched)
+{
+    /* Check AddFetchedCoin behavior, adding a coin read from the base view
+     * ahead of time: it is added as a clean entry, as AccessCoin would have,
+     * and never replaces what the cache already has.
+     *
+     *                   Cache   Result  Cache        Result
+     *                   Value   Value   Flags        Flags
+     */
+    CheckAddFetchedCoin(ABSENT, VALUE3, NO_ENTRY   , 0          );
+    CheckAddFetchedCoin(PRUNED, PRUNED, 0          , 0          );
+    CheckAddFetchedCoin(PRUNED, PRUNED, DIRTY      , DIRTY      );
+    CheckAddFetchedCoin(PRUNED, PRUNED, DIRTY|FRESH, DIRTY|FRESH);
+    CheckAddFetchedCoin(VALUE2, VALUE2, 0          , 0          );
+    CheckAddFetchedCoin(VALUE2, VALUE2, DIRTY      , DIRTY      );
+}
+
+void CheckTakeDirty(CAmount cache_value, char cache_flags, size_t keep_usage, CAmount expected_value, char expected_flags, CAmount expected_dirty_value, char expected_dirty_flags)
+{
+    SingleEntryCacheTest test(ABSENT, cache_value, cache_flags);
+    CCoinsMap mapDirty;
+    test.cache.TakeDirty(mapDirty, keep_usage);
+    test.cache.SelfTest();
+
+    CAmount result_value, dirty_value;
+    char result_flags, dirty_flags;
+    GetCoinsMapEntry(test.cache.map(), result_value, result_flags);
+    GetCoinsMapEntry(mapDirty, dirty_value, dirty_flags);
+    BOOST_CHECK_EQUAL(result_value, expected_value);
+    BOOST_CHECK_EQUAL(result_flags, expected_flags);
+    BOOST_CHECK_EQUAL(dirty_value, expected_dirty_value);
+    BOOST_CHECK_EQUAL(dirty_flags, expected_dirty_flags);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_take_dirty)
+{
+    /* Check TakeDirty behavior, moving the modified coins out for a
+     * background write: dirty entries leave with their flags, and unspent
+     * clean ones stay while they fit in the memory kept.
+     *
+     *             Cache   Cache        Keep    Result  Result    Dirty   Dirty
+     *             Value   Flags        Usage   Value   Flags     Value   Flags
+     */
+    CheckTakeDirty(ABSENT, NO_ENTRY   , 1 << 20, ABSENT, NO_ENTRY, ABSENT, NO_ENTRY   );
+    CheckTakeDirty(PRUNED, 0          , 1 << 20, ABSENT, NO_ENTRY, ABSENT, NO_ENTRY   );
+    CheckTakeDirty(PRUNED, DIRTY      , 1 << 20, ABSENT, NO_ENTRY, PRUNED, DIRTY      );
+    CheckTakeDirty(PRUNED, DIRTY|FRESH, 1 << 20, ABSENT, NO_ENTRY, PRUNED, DIRTY|FRESH);
+    CheckTakeDirty(VALUE1, 0          , 1 << 20, VALUE1, 0       , ABSENT, NO_ENTRY   );
+    CheckTakeDirty(VALUE1, 0          , 0      , ABSENT, NO_ENTRY, ABSENT, NO_ENTRY   );
+    CheckTakeDirty(VALUE1, DIRTY      , 1 << 20, ABSENT, NO_ENTRY, VALUE1, DIRTY      );
+    CheckTakeDirty(VALUE1, DIRTY|FRESH, 0      , ABSENT, NO_ENTRY, VALUE1, DIRTY|FRESH);
+}
+
 void CheckAddCoinBase(CAmount base_value, CAmount cache_value, CAmount modify_value, CAmount expected_value, char cache_flags, char expected_flags, bool coinbase)
 {
     SingleEntryCacheTest test(base_value, cache_value, cache_flags);
@@ -2,7 +2,11 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "clientversion.h"
 #include "compressor.h"
+#include "key.h"
+#include "script/standard.h"
+#include "streams.h"
 #include "util.h"
 #include "test/test_bitcoin.h"
 
@@ -62,4 +66,37 @@ BOOST_AUTO_TEST_CASE(compress_amounts)
         BOOST_CHECK(TestDecode(i));
 }
 
+BOOST_AUTO_TEST_CASE(compress_script_uncompressed_pubkey)
+{
+    std::vector<CScript> vScripts;
+    for (int i = 0; i < 8; i++) {
+        CKey key;
+        key.MakeNewKey(false);
+        vScripts.push_back(GetScriptForRawPubKey(key.GetPubKey()));
+    }
+
+    // The second round is served from the decompressed pubkey cache.
+    for (int nRound = 0; nRound < 2; nRound++) {
+        for (const CScript& script : vScripts) {
+            CDataStream ss(SER_DISK, CLIENT_VERSION);
+            CScript scriptIn(script);
+            ss << CScriptCompressor(scriptIn);
+            BOOST_CHECK_EQUAL(ss.size(), 33U);
+            CScript scriptOut;
+            ss >> REF(CScriptCompressor(scriptOut));
+            BOOST_CHECK(scriptOut == script);
+        }
+    }
+
+    // An x coordinate beyond the field does not decompress, also when asked again.
+    for (int nRound = 0; nRound < 2; nRound++) {
+        std::vector<unsigned char> in(33, 0xff);
+        in[0] = 0x04;
+        CDataStream ss(in, SER_DISK, CLIENT_VERSION);
+        CScript script;
+        ss >> REF(CScriptCompressor(script));
+        BOOST_CHECK(script.empty());
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
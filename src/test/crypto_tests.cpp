@@ -10,10 +10,16 @@
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "hash.h"
+#include "primitives/block.h"
 #include "random.h"
+#include "streams.h"
 #include "utilstrencodings.h"
+#include "version.h"
+#include "versionbits.h"
 #include "test/test_bitcoin.h"
 
+#include <string.h>
 #include <vector>
 
 #include <boost/test/unit_test.hpp>
@@ -483,6 +489,105 @@ BOOST_AUTO_TEST_CASE(chacha20_testvector)
                  "fab78c9");
 }
 
+BOOST_AUTO_TEST_CASE(x11_testvectors)
+{
+    std::string empty;
+    BOOST_CHECK_EQUAL(HashX11(empty.begin(), empty.end()).GetHex(),
+                      "ba4e5867eb17cdc33dccb6cc7175256320e2b4627ec221a26e5783902072b551");
+    std::string fox = "The quick brown fox jumps over the lazy dog";
+    BOOST_CHECK_EQUAL(HashX11(fox.begin(), fox.end()).GetHex(),
+                      "5cbc66e69d1c11fe78983d2e533bf2c29d440072f7027f44326bf1e4a4364553");
+
+    // Dash mainnet genesis header
+    CBlockHeader header;
+    header.nVersion = 1;
+    header.hashMerkleRoot = uint256S("e0028eb9648db56b1ac77cf090b99048a8007e2bb64b68f092c03c7f56a662c7");
+    header.nTime = 1390095618;
+    header.nBits = 0x1e0ffff0;
+    header.nNonce = 28917698;
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << header;
+    BOOST_CHECK_EQUAL(ss.size(), BLOCK_HEADER_HASHED_SIZE);
+    BOOST_CHECK_EQUAL(HashX11(ss.begin(), ss.end()).GetHex(),
+                      "00000ffd590b1485b3caadc19b22e6379c733355108f107a430458cdf3407ab6");
+}
+
+BOOST_AUTO_TEST_CASE(x11_aes_stages)
+{
+    // The Groestl, SHAvite and ECHO stages selected by X11AutoDetect() must
+    // match the portable sph code.
+    unsigned char in[64], out[64], ref[64];
+    for (int n = 0; n < 32; n++) {
+        for (size_t i = 0; i < sizeof(in); i++) {
+            in[i] = InsecureRandBits(8);
+        }
+
+        sph_groestl512_context ctx_groestl;
+        sph_groestl512_init(&ctx_groestl);
+        sph_groestl512(&ctx_groestl, in, sizeof(in));
+        sph_groestl512_close(&ctx_groestl, ref);
+        X11Groestl512(out, in);
+        BOOST_CHECK(memcmp(out, ref, sizeof(out)) == 0);
+
+        sph_shavite512_context ctx_shavite;
+        sph_shavite512_init(&ctx_shavite);
+        sph_shavite512(&ctx_shavite, in, sizeof(in));
+        sph_shavite512_close(&ctx_shavite, ref);
+        X11Shavite512(out, in);
+        BOOST_CHECK(memcmp(out, ref, sizeof(out)) == 0);
+
+        sph_echo512_context ctx_echo;
+        sph_echo512_init(&ctx_echo);
+        sph_echo512(&ctx_echo, in, sizeof(in));
+        sph_echo512_close(&ctx_echo, ref);
+        X11Echo512(out, in);
+        BOOST_CHECK(memcmp(out, ref, sizeof(out)) == 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(x11_batch)
+{
+    // Whatever implementation X11AutoDetect() picked, batches of every size
+    // must agree with the scalar hash, including the tail that does not fill
+    // a whole group of lanes.
+    std::vector<unsigned char> in(80 * 9);
+    for (size_t i = 0; i < in.size(); i++) {
+        in[i] = InsecureRandBits(8);
+    }
+    for (size_t n = 0; n <= 9; n++) {
+        std::vector<uint256> out(n);
+        HashX11Batch80(in.data(), n, out.data());
+        for (size_t i = 0; i < n; i++) {
+            BOOST_CHECK(out[i] == HashX11(in.begin() + 80 * i, in.begin() + 80 * (i + 1)));
+        }
+    }
+
+    std::vector<CBlockHeader> headers(6);
+    std::vector<uint256> hashes(headers.size());
+    for (size_t i = 0; i < headers.size(); i++) {
+        headers[i].nVersion = VERSIONBITS_TOP_BITS | VERSIONBITS_BITCOINX;
+        headers[i].hashPrevBlock = InsecureRand256();
+        headers[i].nTime = 1500000000 + i;
+        headers[i].nNonce = i;
+    }
+    HashX11Batch(headers.data(), headers.size(), hashes.data());
+    for (size_t i = 0; i < headers.size(); i++) {
+        BOOST_CHECK(hashes[i] == HashX11(BEGIN(headers[i].nVersion), END(headers[i].nNonce)));
+        BOOST_CHECK(headers[i].GetHash() == hashes[i]);
+    }
+
+    // GetBlockHeaderHashes only X11-hashes the headers that need it.
+    for (size_t i = 0; i < headers.size(); i += 2) {
+        headers[i].nVersion = VERSIONBITS_TOP_BITS;
+    }
+    GetBlockHeaderHashes(headers.data(), headers.size(), hashes.data());
+    for (size_t i = 0; i < headers.size(); i++) {
+        const CBlockHeader& h = headers[i];
+        BOOST_CHECK(hashes[i] == (i % 2 ? HashX11(BEGIN(h.nVersion), END(h.nNonce)) : Hash(BEGIN(h.nVersion), END(h.nNonce))));
+        BOOST_CHECK(hashes[i] == h.GetHash());
+    }
+}
+
 BOOST_AUTO_TEST_CASE(countbits_tests)
 {
     FastRandomContext ctx;
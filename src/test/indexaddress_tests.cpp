@@ -0,0 +1,96 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "key.h"
+#include "script/indexaddress.h"
+#include "script/script.h"
+#include "script/standard.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(indexaddress_tests, BasicTestingSetup)
+
+static CScript PayToPubKey(const CPubKey& pubkey)
+{
+    return CScript() << ToByteVector(pubkey) << OP_CHECKSIG;
+}
+
+/** Check that both ExtractIndexAddress and an extractor give the type and hash expected. */
+static void CheckExtract(CIndexAddressExtractor& extractor, const CScript& script, int nTypeExpected, const uint160& hashExpected)
+{
+    int addressType = -1;
+    uint160 hash;
+    BOOST_CHECK_EQUAL(ExtractIndexAddress(script, addressType, hash), nTypeExpected != 0);
+    BOOST_CHECK_EQUAL(addressType, nTypeExpected);
+    BOOST_CHECK(hash == hashExpected);
+
+    addressType = -1;
+    hash = uint160();
+    BOOST_CHECK_EQUAL(extractor.Extract(script, addressType, hash), nTypeExpected != 0);
+    BOOST_CHECK_EQUAL(addressType, nTypeExpected);
+    BOOST_CHECK(hash == hashExpected);
+}
+
+BOOST_AUTO_TEST_CASE(indexaddress_script_types)
+{
+    CIndexAddressExtractor extractor;
+    CKey key;
+    key.MakeNewKey(true);
+    const CPubKey pubkey = key.GetPubKey();
+    CKey keyUncompressed;
+    keyUncompressed.MakeNewKey(false);
+    const CPubKey pubkeyUncompressed = keyUncompressed.GetPubKey();
+    BOOST_CHECK(!pubkeyUncompressed.IsCompressed());
+
+    CheckExtract(extractor, GetScriptForDestination(pubkey.GetID()), 1, pubkey.GetID());
+    const CScript redeemScript = GetScriptForMultisig(1, {pubkey, pubkeyUncompressed});
+    const CScriptID scriptid(redeemScript);
+    CheckExtract(extractor, GetScriptForDestination(scriptid), 2, scriptid);
+
+    // Pay to pubkey is indexed under the key hash, as pay to pubkey hash is.
+    CheckExtract(extractor, PayToPubKey(pubkey), 1, pubkey.GetID());
+    CheckExtract(extractor, PayToPubKey(pubkeyUncompressed), 1, pubkeyUncompressed.GetID());
+
+    // Anything else is not indexed.
+    CheckExtract(extractor, redeemScript, 0, uint160());
+    CheckExtract(extractor, CScript() << OP_RETURN << ToByteVector(pubkey), 0, uint160());
+    CheckExtract(extractor, CScript() << OP_1 << OP_DROP, 0, uint160());
+    CheckExtract(extractor, CScript(), 0, uint160());
+}
+
+BOOST_AUTO_TEST_CASE(indexaddress_pubkey_slots)
+{
+    CIndexAddressExtractor extractor;
+
+    // Two keys whose pubkeys fall in the same slot of the extractor.
+    CKey key1, key2;
+    key1.MakeNewKey(true);
+    do {
+        key2.MakeNewKey(true);
+    } while (key2.GetPubKey()[1] % 16 != key1.GetPubKey()[1] % 16 || key2.GetPubKey() == key1.GetPubKey());
+    const CPubKey pubkey1 = key1.GetPubKey();
+    const CPubKey pubkey2 = key2.GetPubKey();
+
+    // The uncompressed pubkey of a key starts with the same x coordinate
+    // as the compressed one, so it falls in the same slot too.
+    CPubKey pubkey1Full = pubkey1;
+    BOOST_CHECK(pubkey1Full.Decompress());
+    BOOST_CHECK(pubkey1Full.GetID() != pubkey1.GetID());
+
+    // Each pubkey takes the slot over from the last, and is never given
+    // the hash of the one before it.
+    for (int i = 0; i < 3; i++) {
+        CheckExtract(extractor, PayToPubKey(pubkey1), 1, pubkey1.GetID());
+        CheckExtract(extractor, PayToPubKey(pubkey1), 1, pubkey1.GetID());
+        CheckExtract(extractor, PayToPubKey(pubkey2), 1, pubkey2.GetID());
+        CheckExtract(extractor, PayToPubKey(pubkey1Full), 1, pubkey1Full.GetID());
+        CheckExtract(extractor, PayToPubKey(pubkey1), 1, pubkey1.GetID());
+        // Other scripts leave the slots alone.
+        CheckExtract(extractor, GetScriptForDestination(pubkey2.GetID()), 1, pubkey2.GetID());
+        CheckExtract(extractor, PayToPubKey(pubkey1), 1, pubkey1.GetID());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,6 +3,8 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "policy/policy.h"
+#include "pubkey.h"
+#include "script/standard.h"
 #include "txmempool.h"
 #include "util.h"
 
@@ -116,6 +118,58 @@ void CheckSort(CTxMemPool &pool, std::vector<std::string> &sortedOrder)
     }
 }
 
+BOOST_AUTO_TEST_CASE(MempoolAddressIndexTest)
+{
+    TestMemPoolEntryHelper entry;
+    CTxMemPool pool;
+    CCoinsView dummy;
+    CCoinsViewCache view(&dummy);
+    uint160 hash1, hash2;
+    *hash1.begin() = 1;
+    *hash2.begin() = 2;
+
+    // A confirmed coin of hash1, spent by tx1 to hash2 and back to hash1.
+    COutPoint prevout(InsecureRand256(), 0);
+    view.AddCoin(prevout, Coin(CTxOut(50000, GetScriptForDestination(CKeyID(hash1))), 1, false), false);
+    CMutableTransaction tx1;
+    tx1.vin.emplace_back(prevout);
+    tx1.vout.emplace_back(30000, GetScriptForDestination(CKeyID(hash2)));
+    tx1.vout.emplace_back(10000, GetScriptForDestination(CKeyID(hash1)));
+
+    pool.addAddressIndex(entry.FromTx(tx1), view);
+    pool.addSpentIndex(entry.FromTx(tx1), view);
+    pool.addUnchecked(tx1.GetHash(), entry.FromTx(tx1));
+    // The indexes count towards the mempool's memory usage.
+    CTxMemPool poolWithout;
+    poolWithout.addUnchecked(tx1.GetHash(), entry.FromTx(tx1));
+    BOOST_CHECK(pool.DynamicMemoryUsage() > poolWithout.DynamicMemoryUsage());
+
+    std::vector<std::pair<uint160, int> > addresses{{hash1, 1}};
+    std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > results;
+    BOOST_CHECK(pool.getAddressIndex(addresses, results));
+    BOOST_REQUIRE_EQUAL(results.size(), 2U);
+    CAmount nTotal = 0;
+    for (const auto& result : results) {
+        BOOST_CHECK(result.first.addressBytes == hash1);
+        BOOST_CHECK(result.first.txhash == tx1.GetHash());
+        nTotal += result.second.amount;
+    }
+    BOOST_CHECK_EQUAL(nTotal, -40000);
+
+    CSpentIndexKey key(prevout.hash, prevout.n);
+    CSpentIndexValue value;
+    BOOST_CHECK(pool.getSpentIndex(key, value));
+    BOOST_CHECK(value.txid == tx1.GetHash());
+
+    // Leaving the mempool takes the transaction out of the indexes.
+    pool.removeRecursive(tx1);
+    results.clear();
+    addresses.emplace_back(hash2, 1);
+    BOOST_CHECK(pool.getAddressIndex(addresses, results));
+    BOOST_CHECK(results.empty());
+    BOOST_CHECK(!pool.getSpentIndex(key, value));
+}
+
 BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
 {
     CTxMemPool pool;
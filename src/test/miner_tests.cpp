@@ -11,12 +11,14 @@
 #include "validation.h"
 #include "miner.h"
 #include "policy/policy.h"
+#include "pow.h"
 #include "pubkey.h"
 #include "script/standard.h"
 #include "txmempool.h"
 #include "uint256.h"
 #include "util.h"
 #include "utilstrencodings.h"
+#include "versionbits.h"
 
 #include "test/test_bitcoin.h"
 
@@ -502,4 +504,42 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+BOOST_AUTO_TEST_CASE(ScanNonces_finds_lowest_nonce)
+{
+    const std::unique_ptr<CChainParams> chainParams = CreateChainParams(CBaseChainParams::REGTEST);
+    const Consensus::Params& params = chainParams->GetConsensus();
+    for (int32_t nVersion : {VERSIONBITS_TOP_BITS, VERSIONBITS_TOP_BITS | VERSIONBITS_BITCOINX}) {
+        CBlock block;
+        block.nVersion = nVersion;
+        block.hashPrevBlock = InsecureRand256();
+        block.hashMerkleRoot = InsecureRand256();
+        block.nTime = 1500000000;
+        block.nBits = 0x1f00ffff;
+
+        // What a sequential search finds.
+        block.nNonce = 0;
+        while (!CheckProofOfWork(block.GetHash(), block.nBits, params)) {
+            ++block.nNonce;
+        }
+        const uint32_t nExpected = block.nNonce;
+
+        for (int nThreads : {1, 4}) {
+            CNonceScanner scanner(nThreads);
+            block.nNonce = 0;
+            BOOST_CHECK(scanner.ScanNonces(&block, nExpected + 1, params));
+            BOOST_CHECK_EQUAL(block.nNonce, nExpected);
+
+            // A range that ends right before the solution finds nothing.
+            block.nNonce = 0;
+            BOOST_CHECK(!scanner.ScanNonces(&block, nExpected, params));
+            BOOST_CHECK_EQUAL(block.nNonce, nExpected);
+
+            // The same threads serve the next search.
+            block.nNonce = 0;
+            BOOST_CHECK(scanner.ScanNonces(&block, nExpected + 1, params));
+            BOOST_CHECK_EQUAL(block.nNonce, nExpected);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
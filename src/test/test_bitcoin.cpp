@@ -9,6 +9,7 @@
 #include "consensus/validation.h"
 #include "crypto/sha256.h"
 #include "fs.h"
+#include "hash.h"
 #include "key.h"
 #include "validation.h"
 #include "miner.h"
@@ -45,6 +46,7 @@ extern void noui_connect();
 BasicTestingSetup::BasicTestingSetup(const std::string& chainName)
 {
         SHA256AutoDetect();
+        X11AutoDetect();
         RandomInit();
         ECC_Start();
         SetupEnvironment();
@@ -81,8 +83,10 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
 
         mempool.setSanityCheck(1.0);
         pblocktree = new CBlockTreeDB(1 << 20, true);
+        pindexdb = new CIndexDB(1 << 20, true);
         pcoinsdbview = new CCoinsViewDB(1 << 23, true);
-        pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+        pcoinsflusher = new CCoinsViewFlusher(pcoinsdbview, pcoinsdbview);
+        pcoinsTip = new CCoinsViewCache(pcoinsflusher);
         if (!LoadGenesisBlock(chainparams)) {
             throw std::runtime_error("LoadGenesisBlock failed.");
         }
@@ -110,8 +114,10 @@ TestingSetup::~TestingSetup()
         peerLogic.reset();
         UnloadBlockIndex();
         delete pcoinsTip;
+        delete pcoinsflusher;
         delete pcoinsdbview;
         delete pblocktree;
+        delete pindexdb;
         fs::remove_all(pathTemp);
 }
 
@@ -0,0 +1,184 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "script/standard.h"
+#include "txdb.h"
+#include "validation.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txdb_tests, BasicTestingSetup)
+
+typedef std::vector<std::pair<CAddressIndexKey, CAmount> > AddressIndex;
+
+static std::pair<CAddressIndexKey, CAmount> AddressEntry(const uint160& hash, int nHeight, unsigned int nTx, CAmount nValue)
+{
+    return std::make_pair(CAddressIndexKey(1, hash, nHeight, nTx, uint256(), 0, false), nValue);
+}
+
+static AddressIndex ReadAddress(CIndexDB& db, const uint160& hash, int start = 0, int end = 0)
+{
+    AddressIndex addressIndex;
+    BOOST_CHECK(db.ReadAddressIndex(hash, 1, addressIndex, start, end));
+    return addressIndex;
+}
+
+BOOST_AUTO_TEST_CASE(buffered_index_writes)
+{
+    CIndexDB db(1 << 20, true);
+    uint160 hash1, hash2;
+    *hash1.begin() = 1;
+    *hash2.begin() = 2;
+
+    AddressIndex entries;
+    for (int i = 0; i < 5; i++) {
+        entries.push_back(AddressEntry(hash1, 10 + i, 0, 100 + i));
+    }
+    entries.push_back(AddressEntry(hash2, 3, 0, 7));
+    BOOST_CHECK(db.WriteAddressIndex(entries));
+    BOOST_CHECK(db.IndexWriteBufferUsage() > 0);
+    BOOST_CHECK_EQUAL(ReadAddress(db, hash1).size(), 5U);
+
+    // A flush empties the buffer into the database.
+    BOOST_CHECK(db.Flush());
+    BOOST_CHECK_EQUAL(db.IndexWriteBufferUsage(), 0U);
+    BOOST_CHECK_EQUAL(ReadAddress(db, hash1).size(), 5U);
+
+    // Buffered erases hide flushed entries, buffered writes go in order.
+    BOOST_CHECK(db.EraseAddressIndex(AddressIndex{AddressEntry(hash1, 12, 0, 0)}));
+    BOOST_CHECK(db.WriteAddressIndex(AddressIndex{AddressEntry(hash1, 11, 1, 55), AddressEntry(hash1, 20, 0, 66), AddressEntry(hash1, 13, 0, 77)}));
+    AddressIndex read = ReadAddress(db, hash1);
+    const int nHeights[] = {10, 11, 11, 13, 14, 20};
+    const CAmount nValues[] = {100, 101, 55, 77, 104, 66};
+    BOOST_REQUIRE_EQUAL(read.size(), 6U);
+    for (size_t i = 0; i < read.size(); i++) {
+        BOOST_CHECK_EQUAL(read[i].first.blockHeight, nHeights[i]);
+        BOOST_CHECK_EQUAL(read[i].second, nValues[i]);
+    }
+    BOOST_CHECK_EQUAL(ReadAddress(db, hash1, 11, 13).size(), 3U);
+    BOOST_CHECK_EQUAL(ReadAddress(db, hash2).size(), 1U);
+
+    BOOST_CHECK(db.EraseAddressIndex(read));
+    BOOST_CHECK(ReadAddress(db, hash1).empty());
+    BOOST_CHECK(db.Flush());
+    BOOST_CHECK(ReadAddress(db, hash1).empty());
+    BOOST_CHECK_EQUAL(ReadAddress(db, hash2).size(), 1U);
+
+    // The counter reads its own buffered writes.
+    uint64_t nCount = 0;
+    BOOST_CHECK(db.ModifyAddressCounter(5));
+    BOOST_CHECK(db.ModifyAddressCounter(-2));
+    BOOST_CHECK(db.ReadAddressCounter(nCount));
+    BOOST_CHECK_EQUAL(nCount, 3U);
+}
+
+BOOST_AUTO_TEST_CASE(scan_address_index_pages)
+{
+    CIndexDB db(1 << 20, true);
+    uint160 hash1, hash2, hash3;
+    *hash1.begin() = 1;
+    *hash2.begin() = 2;
+    *hash3.begin() = 3;
+
+    // Interleaved heights, part flushed and part buffered.
+    BOOST_CHECK(db.WriteAddressIndex(AddressIndex{AddressEntry(hash1, 1, 0, 1), AddressEntry(hash2, 2, 0, 2), AddressEntry(hash1, 4, 0, 4)}));
+    BOOST_CHECK(db.Flush());
+    BOOST_CHECK(db.WriteAddressIndex(AddressIndex{AddressEntry(hash2, 3, 0, 3), AddressEntry(hash1, 5, 0, 5), AddressEntry(hash2, 6, 0, 6), AddressEntry(hash3, 7, 0, 7)}));
+
+    const std::vector<std::pair<uint160, int> > addresses{{hash2, 1}, {hash1, 1}};
+    std::vector<CAmount> values;
+    std::string position;
+    do {
+        int nPage = 0;
+        bool fMore = false;
+        BOOST_CHECK(db.ScanAddressIndex(addresses, 0, position, [&](const CAddressIndexKey& key, CAmount nValue) {
+            if (nPage == 2) {
+                fMore = true;
+                return false;
+            }
+            values.push_back(nValue);
+            position = CIndexDB::GetAddressKeyPosition(key);
+            nPage++;
+            return true;
+        }));
+        if (!fMore)
+            break;
+    } while (values.size() < 100);
+    BOOST_CHECK(values == std::vector<CAmount>({1, 2, 3, 4, 5, 6}));
+
+    values.clear();
+    BOOST_CHECK(db.ScanAddressIndex(addresses, 4, "", [&](const CAddressIndexKey& key, CAmount nValue) {
+        values.push_back(nValue);
+        return true;
+    }));
+    BOOST_CHECK(values == std::vector<CAmount>({4, 5, 6}));
+}
+
+BOOST_AUTO_TEST_CASE(migrate_indexes_from_block_tree)
+{
+    CBlockTreeDB blocktree(1 << 20, true);
+    CIndexDB db(1 << 20, true);
+    uint160 hash;
+    *hash.begin() = 1;
+
+    // Entries as written by nodes that kept the indexes in the block tree ('a' is the address index prefix).
+    for (int i = 0; i < 3; i++) {
+        const std::pair<CAddressIndexKey, CAmount> entry = AddressEntry(hash, 10 + i, 0, 100 + i);
+        BOOST_CHECK(blocktree.Write(std::make_pair('a', entry.first), entry.second));
+    }
+    BOOST_CHECK(blocktree.WriteFlag("addrindex", true));
+
+    BOOST_CHECK(db.MigrateFromBlockTree(blocktree));
+    AddressIndex read = ReadAddress(db, hash);
+    BOOST_REQUIRE_EQUAL(read.size(), 3U);
+    BOOST_CHECK_EQUAL(read[2].second, 102);
+    BOOST_CHECK(!blocktree.Exists(std::make_pair('a', read[0].first)));
+    bool fValue = false;
+    BOOST_CHECK(blocktree.ReadFlag("addrindex", fValue) && fValue);
+
+    // Nothing left to move the second time.
+    BOOST_CHECK(db.MigrateFromBlockTree(blocktree));
+    BOOST_CHECK_EQUAL(ReadAddress(db, hash).size(), 3U);
+}
+
+BOOST_AUTO_TEST_CASE(compact_index_values)
+{
+    CIndexDB db(1 << 20, true);
+    uint160 hash;
+    *hash.begin() = 1;
+    const CScript scriptP2PKH = GetScriptForDestination(CKeyID(hash));
+    const CScript scriptP2PK = CScript() << std::vector<unsigned char>(33, 2) << OP_CHECKSIG;
+
+    // Values from before the compact encoding, next to compact ones ('a' and 'u' are the index prefixes).
+    BOOST_CHECK(db.Write(std::make_pair('a', AddressEntry(hash, 1, 0, 0).first), CAmount(-5 * COIN)));
+    BOOST_CHECK(db.Write(std::make_pair('u', CAddressUnspentKey(1, hash, uint256(), 0)), CAddressUnspentValue(7, scriptP2PKH, 1)));
+    BOOST_CHECK(db.WriteAddressIndex(AddressIndex{AddressEntry(hash, 2, 0, MAX_MONEY), AddressEntry(hash, 3, 0, -123456789), AddressEntry(hash, 4, 0, 0)}));
+    BOOST_CHECK(db.UpdateAddressUnspentIndex({{CAddressUnspentKey(1, hash, uint256(), 1), CAddressUnspentValue(COIN, scriptP2PKH, 2)},
+                                              {CAddressUnspentKey(1, hash, uint256(), 2), CAddressUnspentValue(1234567, scriptP2PK, 300000)}}));
+    BOOST_CHECK(db.Flush());
+
+    AddressIndex read = ReadAddress(db, hash);
+    const CAmount nValues[] = {-5 * COIN, MAX_MONEY, -123456789, 0};
+    BOOST_REQUIRE_EQUAL(read.size(), 4U);
+    for (size_t i = 0; i < read.size(); i++) {
+        BOOST_CHECK_EQUAL(read[i].second, nValues[i]);
+    }
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspent;
+    BOOST_CHECK(db.ReadAddressUnspentIndex(hash, 1, unspent));
+    BOOST_REQUIRE_EQUAL(unspent.size(), 3U);
+    BOOST_CHECK_EQUAL(unspent[0].second.satoshis, 7);
+    BOOST_CHECK(unspent[0].second.script == scriptP2PKH);
+    BOOST_CHECK_EQUAL(unspent[1].second.satoshis, COIN);
+    BOOST_CHECK(unspent[1].second.script == scriptP2PKH);
+    BOOST_CHECK_EQUAL(unspent[1].second.blockHeight, 2);
+    // Scripts that do not follow from the address are kept.
+    BOOST_CHECK_EQUAL(unspent[2].second.satoshis, 1234567);
+    BOOST_CHECK(unspent[2].second.script == scriptP2PK);
+    BOOST_CHECK_EQUAL(unspent[2].second.blockHeight, 300000);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
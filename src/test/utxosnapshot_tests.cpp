@@ -0,0 +1,140 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinstats.h"
+#include "fs.h"
+#include "random.h"
+#include "script/standard.h"
+#include "test/test_bitcoin.h"
+#include "txdb.h"
+#include "util.h"
+#include "validation.h"
+
+#include <memory>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(utxosnapshot_tests, TestChain100Setup)
+
+namespace {
+
+/** The hash_serialized_2 of the coins in view, as gettxoutsetinfo computes it. */
+uint256 GetSerializedHash(CCoinsView* view)
+{
+    CCoinsStats stats;
+    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
+    CCoinsStatsHasher hasher(stats, pcursor->GetBestBlock());
+    while (pcursor->Valid()) {
+        COutPoint key;
+        Coin coin;
+        BOOST_REQUIRE(pcursor->GetKey(key) && pcursor->GetValue(coin));
+        hasher.Add(key, std::move(coin));
+        pcursor->Next();
+    }
+    hasher.Finalize();
+    return stats.hashSerialized;
+}
+
+bool IsEmpty(CCoinsViewDB& view)
+{
+    std::unique_ptr<CCoinsViewCursor> pcursor(view.Cursor());
+    return view.GetBestBlock().IsNull() && view.GetHeadBlocks().empty() && !pcursor->Valid();
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(utxosnapshot_round_trip)
+{
+    const fs::path path = GetDataDir() / "utxo.dat";
+    CCoinsStats stats;
+    BOOST_REQUIRE(DumpUTXOSnapshot(pcoinsdbview, path, stats));
+    BOOST_CHECK(stats.hashBlock == chainActive.Tip()->GetBlockHash());
+    BOOST_CHECK_EQUAL(stats.nHeight, chainActive.Height());
+    BOOST_CHECK(stats.hashSerialized == GetSerializedHash(pcoinsdbview));
+
+    CCoinsViewDB view(1 << 20, true);
+    BOOST_REQUIRE(LoadUTXOSnapshot(&view, path, stats.hashSerialized));
+    BOOST_CHECK(view.GetBestBlock() == stats.hashBlock);
+    BOOST_CHECK(view.GetHeadBlocks().empty());
+    BOOST_CHECK(GetSerializedHash(&view) == stats.hashSerialized);
+}
+
+BOOST_AUTO_TEST_CASE(utxosnapshot_dump_unknown_block)
+{
+    // An empty chain state has no best block to take the height of.
+    const fs::path path = GetDataDir() / "utxo.dat";
+    CCoinsViewDB view(1 << 20, true);
+    CCoinsStats stats;
+    BOOST_CHECK(!DumpUTXOSnapshot(&view, path, stats));
+    BOOST_CHECK(!fs::exists(path));
+}
+
+BOOST_AUTO_TEST_CASE(utxosnapshot_wrong_hash)
+{
+    const fs::path path = GetDataDir() / "utxo.dat";
+    CCoinsStats stats;
+    BOOST_REQUIRE(DumpUTXOSnapshot(pcoinsdbview, path, stats));
+
+    // Nothing of a snapshot with another hash ends up in the database.
+    CCoinsViewDB view(1 << 20, true);
+    BOOST_CHECK(!LoadUTXOSnapshot(&view, path, InsecureRand256()));
+    BOOST_CHECK(IsEmpty(view));
+}
+
+BOOST_AUTO_TEST_CASE(utxosnapshot_resume)
+{
+    const fs::path path = GetDataDir() / "utxo.dat";
+    CCoinsStats stats;
+    BOOST_REQUIRE(DumpUTXOSnapshot(pcoinsdbview, path, stats));
+
+    // A load interrupted after its first batch leaves some of the coins and
+    // the database in transition from nothing to the base block.
+    CCoinsViewDB view(1 << 20, true);
+    CCoinsMap mapCoins;
+    std::unique_ptr<CCoinsViewCursor> pcursor(pcoinsdbview->Cursor());
+    for (int i = 0; i < 10 && pcursor->Valid(); i++, pcursor->Next()) {
+        COutPoint key;
+        BOOST_REQUIRE(pcursor->GetKey(key));
+        CCoinsCacheEntry& entry = mapCoins[key];
+        BOOST_REQUIRE(pcursor->GetValue(entry.coin));
+        entry.flags = CCoinsCacheEntry::DIRTY;
+    }
+    BOOST_REQUIRE(view.WriteCoins(mapCoins, stats.hashBlock, false));
+    BOOST_CHECK(view.GetBestBlock().IsNull());
+    BOOST_CHECK(view.GetHeadBlocks() == std::vector<uint256>({stats.hashBlock, uint256()}));
+
+    BOOST_REQUIRE(LoadUTXOSnapshot(&view, path, stats.hashSerialized));
+    BOOST_CHECK(view.GetBestBlock() == stats.hashBlock);
+    BOOST_CHECK(view.GetHeadBlocks().empty());
+    BOOST_CHECK(GetSerializedHash(&view) == stats.hashSerialized);
+}
+
+BOOST_AUTO_TEST_CASE(utxosnapshot_chain_state_not_empty)
+{
+    const fs::path path = GetDataDir() / "utxo.dat";
+    CCoinsStats stats;
+    BOOST_REQUIRE(DumpUTXOSnapshot(pcoinsdbview, path, stats));
+
+    // A chain state at or past the base block is left alone.
+    BOOST_CHECK(LoadUTXOSnapshot(pcoinsdbview, path, stats.hashSerialized));
+    BOOST_CHECK(pcoinsdbview->GetBestBlock() == stats.hashBlock);
+    const CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CreateAndProcessBlock({}, scriptPubKey);
+    FlushStateToDisk();
+    const uint256 hashBest = pcoinsdbview->GetBestBlock();
+    BOOST_CHECK(hashBest != stats.hashBlock);
+    const uint256 hashSerialized = GetSerializedHash(pcoinsdbview);
+    BOOST_CHECK(LoadUTXOSnapshot(pcoinsdbview, path, stats.hashSerialized));
+    BOOST_CHECK(pcoinsdbview->GetBestBlock() == hashBest);
+    BOOST_CHECK(GetSerializedHash(pcoinsdbview) == hashSerialized);
+
+    // One that does not build on it is refused, and kept.
+    CCoinsViewDB view(1 << 20, true);
+    BOOST_REQUIRE(view.WriteCoins(CCoinsMap(), chainActive[stats.nHeight - 1]->GetBlockHash()));
+    BOOST_CHECK(!LoadUTXOSnapshot(&view, path, stats.hashSerialized));
+    BOOST_CHECK(view.GetBestBlock() == chainActive[stats.nHeight - 1]->GetBlockHash());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -6,10 +6,13 @@
 #include "txdb.h"
 
 #include "chainparams.h"
+#include "compressor.h"
 #include "hash.h"
+#include "memusage.h"
 #include "random.h"
 #include "pow.h"
 #include "pos.h"
+#include "script/standard.h"
 #include "uint256.h"
 #include "util.h"
 #include "ui_interface.h"
@@ -19,6 +22,9 @@
 
 #include <stdint.h>
 
+#include <atomic>
+#include <thread>
+
 #include <boost/thread.hpp>
 
 static const char DB_COIN = 'C';
@@ -37,9 +43,29 @@ static const char DB_ADDRESSINDEX = 'a';
 static const char DB_ADDRESS_COUNTER_INDEX = 'A';
 
 static const char DB_ADDRESSUNSPENTINDEX = 'u';
+static const char DB_ADDRESSBALANCEINDEX = 'x';
+// No longer written: getblockhashes is served from memory, see CBlockTimeIndex
 static const char DB_TIMESTAMPINDEX = 's';
 static const char DB_BLOCKHASHINDEX = 'z';
 static const char DB_SPENTINDEX = 'p';
+static const char DB_ADDRESSINDEX_SYNC = 'X';
+static const char DB_INDEX_BEST_BLOCK = 'I';
+
+/** Serialized size of an address index key's prefix, type and hash */
+static const size_t ADDRESS_KEY_PREFIX_SIZE = 22;
+
+/**
+ * Address and unspent index values are written compactly, with varint
+ * (compressed) amounts and heights and without the scripts that the key's
+ * address type and hash already give. Such values end with one of these
+ * format bytes, which the fixed-width values written before never end
+ * with: those end with the top byte of an amount (0x00 or 0xff) or of a
+ * height (below 0x80), so they are still read as they are.
+ */
+static const unsigned char INDEX_VALUE_CREDIT = 0x80;
+static const unsigned char INDEX_VALUE_DEBIT = 0x81;
+static const unsigned char INDEX_VALUE_KEY_SCRIPT = 0x80;
+static const unsigned char INDEX_VALUE_SCRIPT = 0x81;
 
 namespace {
 
@@ -93,6 +119,12 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
 }
 
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    bool ret = WriteCoins(mapCoins, hashBlock);
+    mapCoins.clear();
+    return ret;
+}
+
+bool CCoinsViewDB::WriteCoins(const CCoinsMap &mapCoins, const uint256 &hashBlock, bool fFinal) {
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
@@ -117,7 +149,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     batch.Erase(DB_BEST_BLOCK);
     batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, old_tip});
 
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
             CoinEntry entry(&it->first);
             if (it->second.coin.IsSpent())
@@ -127,8 +159,6 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             db.WriteBatch(batch);
@@ -144,8 +174,10 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     }
 
     // In the last batch, mark the database as consistent with hashBlock again.
-    batch.Erase(DB_HEAD_BLOCKS);
-    batch.Write(DB_BEST_BLOCK, hashBlock);
+    if (fFinal) {
+        batch.Erase(DB_HEAD_BLOCKS);
+        batch.Write(DB_BEST_BLOCK, hashBlock);
+    }
 
     LogPrint(BCLog::COINDB, "Writing final batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
     bool ret = db.WriteBatch(batch);
@@ -158,9 +190,356 @@ size_t CCoinsViewDB::EstimateSize() const
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
 }
 
+CCoinsViewFlusher::CCoinsViewFlusher(CCoinsView* viewIn, CCoinsViewDB* dbIn) : CCoinsViewBacked(viewIn), db(dbIn), fFailed(false), nWritingUsage(0)
+{
+}
+
+CCoinsViewFlusher::~CCoinsViewFlusher()
+{
+    Wait();
+}
+
+bool CCoinsViewFlusher::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    {
+        LOCK(cs);
+        CCoinsMap::const_iterator it;
+        if (pmapWriting && (it = pmapWriting->find(outpoint)) != pmapWriting->end()) {
+            coin = it->second.coin;
+            return !coin.IsSpent();
+        }
+    }
+    return base->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewFlusher::HaveCoin(const COutPoint &outpoint) const {
+    {
+        LOCK(cs);
+        CCoinsMap::const_iterator it;
+        if (pmapWriting && (it = pmapWriting->find(outpoint)) != pmapWriting->end())
+            return !it->second.coin.IsSpent();
+    }
+    return base->HaveCoin(outpoint);
+}
+
+uint256 CCoinsViewFlusher::GetBestBlock() const {
+    {
+        LOCK(cs);
+        if (!hashWriting.IsNull())
+            return hashWriting;
+    }
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewFlusher::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    if (!Wait())
+        return false;
+    return base->BatchWrite(mapCoins, hashBlock);
+}
+
+bool CCoinsViewFlusher::StartWrite(CCoinsMap&& mapCoins, size_t nUsage, const uint256 &hashBlock) {
+    if (!Wait())
+        return false;
+    {
+        LOCK(cs);
+        pmapWriting.reset(new CCoinsMap(std::move(mapCoins)));
+        hashWriting = hashBlock;
+        nWritingUsage = nUsage;
+    }
+    thread = std::thread(&TraceThread<std::function<void()> >, "coinsflush", std::function<void()>(std::bind(&CCoinsViewFlusher::ThreadWrite, this)));
+    return true;
+}
+
+void CCoinsViewFlusher::ThreadWrite() {
+    int64_t nStart = GetTimeMicros();
+    bool fOk = false;
+    try {
+        // pmapWriting is only read here, as it is by GetCoin
+        fOk = db->WriteCoins(*pmapWriting, hashWriting);
+    } catch (const std::runtime_error& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+    if (!fOk)
+        fFailed = true;
+    LogPrint(BCLog::BENCH, "%s: wrote %u coins in the background in %.2fms\n", __func__, pmapWriting->size(), (GetTimeMicros() - nStart) * 0.001);
+
+    // Freed out of the lock, which GetCoin takes
+    std::unique_ptr<CCoinsMap> pmapWritten;
+    {
+        LOCK(cs);
+        pmapWritten.swap(pmapWriting);
+        hashWriting.SetNull();
+        nWritingUsage = 0;
+    }
+}
+
+bool CCoinsViewFlusher::Wait() {
+    if (thread.joinable())
+        thread.join();
+    return !fFailed;
+}
+
+size_t CCoinsViewFlusher::DynamicMemoryUsage() const {
+    LOCK(cs);
+    return nWritingUsage;
+}
+
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
 }
 
+CIndexDB::CIndexDB(size_t nCacheSize, bool fMemory, bool fWipe, const CDBTuning& tuning) : CDBWrapper(GetDataDir() / "indexes", nCacheSize, fMemory, fWipe, false, tuning), nIndexWritesUsage(0) {
+}
+
+namespace {
+
+/** Key or value bytes as they are in the database, (un)serialized unchanged. */
+struct RawDBBytes {
+    std::string data;
+
+    RawDBBytes() {}
+    explicit RawDBBytes(const std::string& dataIn) : data(dataIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        s.write(data.data(), data.size());
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        data.resize(s.size());
+        s.read(&data[0], data.size());
+    }
+};
+
+template<typename T>
+std::string SerializeDB(const T& obj)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << obj;
+    return std::string(ss.begin(), ss.end());
+}
+
+template<typename T>
+bool UnserializeDB(const std::string& data, T& obj)
+{
+    try {
+        CDataStream ss(data.data(), data.data() + data.size(), SER_DISK, CLIENT_VERSION);
+        ss >> obj;
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+/** The standard script of an address index type and hash, empty for types that have none. */
+CScript GetAddressScript(unsigned int type, const uint160& hash)
+{
+    if (type == 1)
+        return GetScriptForDestination(CKeyID(hash));
+    if (type == 2)
+        return GetScriptForDestination(CScriptID(hash));
+    return CScript();
+}
+
+RawDBBytes EncodeIndexValue(CAmount nValue)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    uint64_t nAmount = CTxOutCompressor::CompressAmount(nValue < 0 ? -nValue : nValue);
+    ss << VARINT(nAmount);
+    ss << (nValue < 0 ? INDEX_VALUE_DEBIT : INDEX_VALUE_CREDIT);
+    return RawDBBytes(std::string(ss.begin(), ss.end()));
+}
+
+// Takes the key, though this encoding does not depend on it, so that the
+// cursor merge below can decode either index.
+bool DecodeIndexValue(const CAddressIndexKey&, const std::string& data, CAmount& nValue)
+{
+    if (data.empty())
+        return false;
+    const unsigned char chFormat = data.back();
+    if (chFormat != INDEX_VALUE_CREDIT && chFormat != INDEX_VALUE_DEBIT)
+        return UnserializeDB(data, nValue);
+    try {
+        CDataStream ss(data.data(), data.data() + data.size() - 1, SER_DISK, CLIENT_VERSION);
+        uint64_t nAmount;
+        ss >> VARINT(nAmount);
+        nValue = CTxOutCompressor::DecompressAmount(nAmount);
+    } catch (const std::exception&) {
+        return false;
+    }
+    if (chFormat == INDEX_VALUE_DEBIT)
+        nValue = -nValue;
+    return true;
+}
+
+RawDBBytes EncodeIndexValue(const CAddressUnspentKey& key, const CAddressUnspentValue& value)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    uint64_t nAmount = CTxOutCompressor::CompressAmount(value.satoshis);
+    unsigned int nHeight = value.blockHeight;
+    ss << VARINT(nAmount) << VARINT(nHeight);
+    const bool fKeyScript = value.script == GetAddressScript(key.type, key.hashBytes);
+    if (!fKeyScript)
+        ss << *(const CScriptBase*)(&value.script);
+    ss << (fKeyScript ? INDEX_VALUE_KEY_SCRIPT : INDEX_VALUE_SCRIPT);
+    return RawDBBytes(std::string(ss.begin(), ss.end()));
+}
+
+bool DecodeIndexValue(const CAddressUnspentKey& key, const std::string& data, CAddressUnspentValue& value)
+{
+    if (data.empty())
+        return false;
+    const unsigned char chFormat = data.back();
+    if (chFormat != INDEX_VALUE_KEY_SCRIPT && chFormat != INDEX_VALUE_SCRIPT)
+        return UnserializeDB(data, value);
+    try {
+        CDataStream ss(data.data(), data.data() + data.size() - 1, SER_DISK, CLIENT_VERSION);
+        uint64_t nAmount;
+        unsigned int nHeight;
+        ss >> VARINT(nAmount) >> VARINT(nHeight);
+        value.satoshis = CTxOutCompressor::DecompressAmount(nAmount);
+        value.blockHeight = nHeight;
+        if (chFormat == INDEX_VALUE_SCRIPT) {
+            ss >> *(CScriptBase*)(&value.script);
+        } else {
+            value.script = GetAddressScript(key.type, key.hashBytes);
+        }
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+/**
+ * Walks the index database from a key on, as far as the caller stops it,
+ * merged with the buffered index writes in that range: buffered writes
+ * replace or add entries, buffered erases hide them.
+ */
+class CBufferedIndexCursor
+{
+public:
+    template<typename K>
+    CBufferedIndexCursor(const CIndexDB& db, const K& key, size_t nPrefixSize) :
+        buffered(db.GetBufferedRange(key, nPrefixSize)), it(buffered.begin()),
+        pcursor(const_cast<CIndexDB&>(db).NewIterator())
+    {
+        pcursor->Seek(key);
+        Settle();
+    }
+
+    bool Valid() const { return fBuffered || fDatabase; }
+
+    void Next()
+    {
+        if (fBuffered) {
+            ++it;
+        } else {
+            pcursor->Next();
+        }
+        Settle();
+    }
+
+    template<typename K> bool GetKey(K& key)
+    {
+        return fBuffered ? UnserializeDB(it->first, key) : pcursor->GetKey(key);
+    }
+
+    template<typename V> bool GetValue(V& value)
+    {
+        return fBuffered ? UnserializeDB(it->second.value, value) : pcursor->GetValue(value);
+    }
+
+private:
+    /** Move to whichever of the database and the buffer has the lower key, skipping erased and replaced entries. */
+    void Settle()
+    {
+        while (true) {
+            fDatabase = pcursor->Valid() && pcursor->GetKey(keyDatabase);
+            fBuffered = it != buffered.end();
+            if (!fBuffered || (fDatabase && keyDatabase.data < it->first)) {
+                fBuffered = false;
+                return;
+            }
+            if (fDatabase && keyDatabase.data == it->first) {
+                pcursor->Next();
+                continue;
+            }
+            if (!it->second.fErase)
+                return;
+            ++it;
+        }
+    }
+
+    // The buffered writes are copied before the database iterator is made,
+    // so that a flush in between cannot hide them from both.
+    CIndexDB::IndexWriteMap buffered;
+    CIndexDB::IndexWriteMap::const_iterator it;
+    std::unique_ptr<CDBIterator> pcursor;
+    RawDBBytes keyDatabase;
+    bool fBuffered;
+    bool fDatabase;
+};
+
+void CIndexDB::BufferIndexWrite(std::string&& key, bool fErase, std::string&& value)
+{
+    static const size_t nEntryUsage = memusage::MallocUsage(sizeof(memusage::stl_tree_node<std::pair<const std::string, BufferedIndexWrite> >));
+    LOCK(cs_indexWrites);
+    auto inserted = mapIndexWrites.emplace(std::move(key), BufferedIndexWrite());
+    BufferedIndexWrite& entry = inserted.first->second;
+    if (inserted.second) {
+        nIndexWritesUsage += nEntryUsage + inserted.first->first.size();
+    } else {
+        nIndexWritesUsage -= entry.value.size();
+    }
+    entry.fErase = fErase;
+    entry.value = std::move(value);
+    nIndexWritesUsage += entry.value.size();
+}
+
+template<typename K, typename V>
+void CIndexDB::BufferWrite(const K& key, const V& value)
+{
+    BufferIndexWrite(SerializeDB(key), false, SerializeDB(value));
+}
+
+template<typename K>
+void CIndexDB::BufferErase(const K& key)
+{
+    BufferIndexWrite(SerializeDB(key), true, std::string());
+}
+
+template<typename K, typename V>
+bool CIndexDB::ReadBuffered(const K& key, V& value) const
+{
+    {
+        LOCK(cs_indexWrites);
+        IndexWriteMap::const_iterator it = mapIndexWrites.find(SerializeDB(key));
+        if (it != mapIndexWrites.end())
+            return !it->second.fErase && UnserializeDB(it->second.value, value);
+    }
+    return Read(key, value);
+}
+
+template<typename K>
+CIndexDB::IndexWriteMap CIndexDB::GetBufferedRange(const K& key, size_t nPrefixSize) const
+{
+    const std::string strKey = SerializeDB(key);
+    const std::string strPrefix = strKey.substr(0, nPrefixSize);
+    IndexWriteMap range;
+    LOCK(cs_indexWrites);
+    for (IndexWriteMap::const_iterator it = mapIndexWrites.lower_bound(strKey); it != mapIndexWrites.end() && it->first.compare(0, strPrefix.size(), strPrefix) == 0; it++) {
+        range.insert(range.end(), *it);
+    }
+    return range;
+}
+
+size_t CIndexDB::IndexWriteBufferUsage() const
+{
+    LOCK(cs_indexWrites);
+    return nIndexWritesUsage;
+}
+
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
     return Read(std::make_pair(DB_BLOCK_FILES, nFile), info);
 }
@@ -247,6 +626,109 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     return WriteBatch(batch, true);
 }
 
+bool CIndexDB::Flush() {
+    CDBBatch batch(*this);
+    // Readers wait until the writes are in the database.
+    LOCK(cs_indexWrites);
+    for (IndexWriteMap::const_iterator it = mapIndexWrites.begin(); it != mapIndexWrites.end(); it++) {
+        if (it->second.fErase) {
+            batch.Erase(RawDBBytes(it->first));
+        } else {
+            batch.Write(RawDBBytes(it->first), RawDBBytes(it->second.value));
+        }
+    }
+    LogPrint(BCLog::BENCH, "%s: flushing %u index writes (%.1fMiB)\n", __func__, mapIndexWrites.size(), nIndexWritesUsage * (1.0 / 1024 / 1024));
+    if (!WriteBatch(batch, true))
+        return false;
+    mapIndexWrites.clear();
+    nIndexWritesUsage = 0;
+    return true;
+}
+
+bool CIndexDB::MigrateFromBlockTree(CBlockTreeDB& blocktree) {
+    static const char vIndexPrefixes[] = {DB_ADDRESSINDEX, DB_ADDRESS_COUNTER_INDEX, DB_ADDRESSUNSPENTINDEX, DB_ADDRESSBALANCEINDEX,
+                                          DB_SPENTINDEX, DB_ADDRESSINDEX_SYNC};
+    const size_t nBatchSize = gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
+
+    for (char chPrefix : vIndexPrefixes) {
+        std::unique_ptr<CDBIterator> pcursor(blocktree.NewIterator());
+        pcursor->Seek(chPrefix);
+        CDBBatch batch(*this);
+        CDBBatch batchErase(blocktree);
+        RawDBBytes key, value;
+        size_t nMoved = 0;
+        while (true) {
+            boost::this_thread::interruption_point();
+            const bool fEntry = pcursor->Valid() && pcursor->GetKey(key) && !key.data.empty() && key.data[0] == chPrefix;
+            if (fEntry) {
+                if (!pcursor->GetValue(value))
+                    return error("%s: failed to read index entry", __func__);
+                batch.Write(key, value);
+                batchErase.Erase(key);
+                nMoved++;
+                pcursor->Next();
+            }
+            if (!fEntry || batch.SizeEstimate() > nBatchSize) {
+                // Copied before being erased, so that nothing is lost if interrupted
+                if (!WriteBatch(batch, true) || !blocktree.WriteBatch(batchErase, true))
+                    return false;
+                batch.Clear();
+                batchErase.Clear();
+            }
+            if (!fEntry)
+                break;
+        }
+        if (nMoved > 0) {
+            LogPrintf("%s: moved %u index entries with prefix '%c' to the index database\n", __func__, nMoved, chPrefix);
+            blocktree.CompactRange(chPrefix, (char)(chPrefix + 1));
+        }
+    }
+    return true;
+}
+
+/** Erase every entry whose key starts with chPrefix, in batches. Returns the number erased, or -1 on failure. */
+static int64_t ErasePrefix(CDBWrapper& db, char chPrefix, size_t nBatchSize)
+{
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(chPrefix);
+    CDBBatch batch(db);
+    RawDBBytes key;
+    int64_t nErased = 0;
+    while (true) {
+        boost::this_thread::interruption_point();
+        const bool fEntry = pcursor->Valid() && pcursor->GetKey(key) && !key.data.empty() && key.data[0] == chPrefix;
+        if (fEntry) {
+            batch.Erase(key);
+            nErased++;
+            pcursor->Next();
+        }
+        if (!fEntry || batch.SizeEstimate() > nBatchSize) {
+            if (!db.WriteBatch(batch, true))
+                return -1;
+            batch.Clear();
+        }
+        if (!fEntry)
+            break;
+    }
+    if (nErased > 0)
+        db.CompactRange(chPrefix, (char)(chPrefix + 1));
+    return nErased;
+}
+
+bool CIndexDB::DropTimestampIndex(CBlockTreeDB& blocktree) {
+    const size_t nBatchSize = gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
+    for (char chPrefix : {DB_TIMESTAMPINDEX, DB_BLOCKHASHINDEX}) {
+        for (CDBWrapper* pdb : {static_cast<CDBWrapper*>(&blocktree), static_cast<CDBWrapper*>(this)}) {
+            const int64_t nErased = ErasePrefix(*pdb, chPrefix, nBatchSize);
+            if (nErased < 0)
+                return false;
+            if (nErased > 0)
+                LogPrintf("%s: erased %u obsolete timestamp index entries with prefix '%c'\n", __func__, nErased, chPrefix);
+        }
+    }
+    return true;
+}
+
 bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
     return Read(std::make_pair(DB_TXINDEX, txid), pos);
 }
@@ -270,31 +752,27 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
-bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
-	
-    CDBBatch batch(*this);
+bool CIndexDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Write(std::make_pair(DB_ADDRESSINDEX, it->first), it->second);
-    return WriteBatch(batch);
+        BufferWrite(std::make_pair(DB_ADDRESSINDEX, it->first), EncodeIndexValue(it->second));
+    return true;
 }
 
-bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
-    CDBBatch batch(*this);
+bool CIndexDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Erase(std::make_pair(DB_ADDRESSINDEX, it->first));
-    return WriteBatch(batch);
+        BufferErase(std::make_pair(DB_ADDRESSINDEX, it->first));
+    return true;
 }
 
-bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
+bool CIndexDB::ReadAddressIndex(uint160 addressHash, int type,
                                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                                     int start, int end) {
 
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
-
+    boost::scoped_ptr<CBufferedIndexCursor> pcursor;
     if (start > 0 && end > 0) {
-        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
+        pcursor.reset(new CBufferedIndexCursor(*this, std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)), ADDRESS_KEY_PREFIX_SIZE));
     } else {
-        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
+        pcursor.reset(new CBufferedIndexCursor(*this, std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)), ADDRESS_KEY_PREFIX_SIZE));
     }
 
     while (pcursor->Valid()) {
@@ -304,8 +782,9 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
             if (end > 0 && key.second.blockHeight > end) {
                 break;
             }
+            RawDBBytes value;
             CAmount nValue;
-            if (pcursor->GetValue(nValue)) {
+            if (pcursor->GetValue(value) && DecodeIndexValue(key.second, value.data, nValue)) {
                 addressIndex.push_back(std::make_pair(key.second, nValue));
                 pcursor->Next();
             } else {
@@ -319,30 +798,98 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
     return true;
 }
 
-bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
+bool CIndexDB::ReadAddressBalance(const CAddressIndexIteratorKey &key, CAddressBalanceValue &value) {
+    value.SetNull();
+    return ReadBuffered(std::make_pair(DB_ADDRESSBALANCEINDEX, key), value);
+}
+
+bool CIndexDB::UpdateAddressBalanceIndex(const std::vector<std::pair<CAddressIndexIteratorKey, CAddressBalanceValue> > &vect) {
+    for (std::vector<std::pair<CAddressIndexIteratorKey, CAddressBalanceValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        if (it->second.IsNull()) {
+            BufferErase(std::make_pair(DB_ADDRESSBALANCEINDEX, it->first));
+        } else {
+            BufferWrite(std::make_pair(DB_ADDRESSBALANCEINDEX, it->first), it->second);
+        }
+    }
+    return true;
+}
+
+bool CIndexDB::BuildAddressBalanceIndex() {
+    // Runs at startup, before anything is buffered, and writes straight to
+    // the database rather than holding every address in memory.
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(DB_ADDRESSINDEX);
+
+    // Entries of one address are contiguous and ordered by height and
+    // position in the block, so the entries of one transaction are too.
     CDBBatch batch(*this);
+    CAddressIndexIteratorKey current;
+    CAddressBalanceValue value;
+    int nLastHeight = -1;
+    unsigned int nLastTxIndex = 0;
+    size_t nAddresses = 0;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSINDEX)
+            break;
+        RawDBBytes data;
+        CAmount nValue;
+        if (!pcursor->GetValue(data) || !DecodeIndexValue(key.second, data.data, nValue))
+            return error("failed to get address index value");
+
+        if (key.second.type != current.type || key.second.hashBytes != current.hashBytes) {
+            if (!value.IsNull())
+                batch.Write(std::make_pair(DB_ADDRESSBALANCEINDEX, current), value);
+            if (batch.SizeEstimate() > (size_t)gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize)) {
+                if (!WriteBatch(batch))
+                    return false;
+                batch.Clear();
+            }
+            current = CAddressIndexIteratorKey(key.second.type, key.second.hashBytes);
+            value.SetNull();
+            nLastHeight = -1;
+            nAddresses++;
+        }
+        value.balance += nValue;
+        if (nValue > 0)
+            value.received += nValue;
+        if (key.second.blockHeight != nLastHeight || key.second.txindex != nLastTxIndex) {
+            value.txCount++;
+            nLastHeight = key.second.blockHeight;
+            nLastTxIndex = key.second.txindex;
+        }
+        pcursor->Next();
+    }
+    if (!value.IsNull())
+        batch.Write(std::make_pair(DB_ADDRESSBALANCEINDEX, current), value);
+    LogPrintf("%s: %u addresses\n", __func__, nAddresses);
+    return WriteBatch(batch);
+}
+
+bool CIndexDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         if (it->second.IsNull()) {
-            batch.Erase(std::make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
+            BufferErase(std::make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
         } else {
-            batch.Write(std::make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
+            BufferWrite(std::make_pair(DB_ADDRESSUNSPENTINDEX, it->first), EncodeIndexValue(it->first, it->second));
         }
     }
-    return WriteBatch(batch);
+    return true;
 }
 
-bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
+bool CIndexDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
                                            std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
 
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
-    pcursor->Seek(std::make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    boost::scoped_ptr<CBufferedIndexCursor> pcursor(new CBufferedIndexCursor(*this, std::make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)), ADDRESS_KEY_PREFIX_SIZE));
 
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         std::pair<char,CAddressUnspentKey> key;
         if (pcursor->GetKey(key) && key.first == DB_ADDRESSUNSPENTINDEX && key.second.hashBytes == addressHash) {
+            RawDBBytes value;
             CAddressUnspentValue nValue;
-            if (pcursor->GetValue(nValue)) {
+            if (pcursor->GetValue(value) && DecodeIndexValue(key.second, value.data, nValue)) {
                 unspentOutputs.push_back(std::make_pair(key.second, nValue));
                 pcursor->Next();
             } else {
@@ -356,83 +903,145 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
     return true;
 }
 
-bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
-    CDBBatch batch(*this);
-    batch.Write(std::make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
-    return WriteBatch(batch);
-}
-bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes) {
-
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
-
-    pcursor->Seek(std::make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(low)));
+/**
+ * Stream the entries under chPrefix of each of the addresses to fn, merged
+ * on the part of their keys after the address, from strFrom on, or just
+ * after it with fAfter.
+ */
+template<typename Key, typename Value, typename Fn>
+static bool ScanAddressKeys(const CIndexDB& db, char chPrefix, const std::vector<std::pair<uint160, int> >& addresses,
+                            const std::string& strFrom, bool fAfter, const Fn& fn)
+{
+    struct Source {
+        std::string strPrefix;
+        std::unique_ptr<CBufferedIndexCursor> pcursor;
+        RawDBBytes key;
+        bool fValid;
+
+        void Read()
+        {
+            fValid = pcursor->Valid() && pcursor->GetKey(key) && key.data.compare(0, strPrefix.size(), strPrefix) == 0;
+        }
+    };
+
+    std::vector<Source> sources(addresses.size());
+    for (size_t i = 0; i < addresses.size(); i++) {
+        Source& source = sources[i];
+        source.strPrefix = SerializeDB(std::make_pair(chPrefix, CAddressIndexIteratorKey(addresses[i].second, addresses[i].first)));
+        assert(source.strPrefix.size() == ADDRESS_KEY_PREFIX_SIZE);
+        source.pcursor.reset(new CBufferedIndexCursor(db, RawDBBytes(source.strPrefix + strFrom), ADDRESS_KEY_PREFIX_SIZE));
+        source.Read();
+        if (fAfter && source.fValid && source.key.data.compare(ADDRESS_KEY_PREFIX_SIZE, std::string::npos, strFrom) == 0) {
+            source.pcursor->Next();
+            source.Read();
+        }
+    }
 
-    while (pcursor->Valid()) {
+    while (true) {
         boost::this_thread::interruption_point();
-        std::pair<char, CTimestampIndexKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_TIMESTAMPINDEX && key.second.timestamp < high) {
-            if (fActiveOnly) {
-                if (blockOnchainActive(key.second.blockHash)) {
-                    hashes.push_back(std::make_pair(key.second.blockHash, key.second.timestamp));
-                }
-            } else {
-                hashes.push_back(std::make_pair(key.second.blockHash, key.second.timestamp));
-            }
-
-            pcursor->Next();
-        } else {
-            break;
+        Source* pnext = nullptr;
+        for (Source& source : sources) {
+            if (source.fValid && (!pnext || source.key.data.compare(ADDRESS_KEY_PREFIX_SIZE, std::string::npos, pnext->key.data, ADDRESS_KEY_PREFIX_SIZE, std::string::npos) < 0))
+                pnext = &source;
         }
+        if (!pnext)
+            return true;
+
+        std::pair<char, Key> key;
+        RawDBBytes data;
+        Value value;
+        if (!pnext->pcursor->GetKey(key) || !pnext->pcursor->GetValue(data) || !DecodeIndexValue(key.second, data.data, value))
+            return error("%s: failed to read address index entry", __func__);
+        if (!fn(key.second, value))
+            return true;
+        pnext->pcursor->Next();
+        pnext->Read();
     }
-
-    return true;
 }
 
-bool CBlockTreeDB::WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts) {
-    CDBBatch batch(*this);
-    batch.Write(std::make_pair(DB_BLOCKHASHINDEX, blockhashIndex), logicalts);
-    return WriteBatch(batch);
+bool CIndexDB::ScanAddressIndex(const std::vector<std::pair<uint160, int> > &addresses, int nStart, const std::string &strPosition,
+                                    const std::function<bool(const CAddressIndexKey&, CAmount)> &fn) {
+    if (!strPosition.empty())
+        return ScanAddressKeys<CAddressIndexKey, CAmount>(*this, DB_ADDRESSINDEX, addresses, strPosition, true, fn);
+    // Heights are the first thing after the address, big-endian
+    std::string strHeight;
+    if (nStart > 0)
+        strHeight = SerializeDB(CAddressIndexIteratorHeightKey(0, uint160(), nStart)).substr(ADDRESS_KEY_PREFIX_SIZE - 1);
+    return ScanAddressKeys<CAddressIndexKey, CAmount>(*this, DB_ADDRESSINDEX, addresses, strHeight, false, fn);
 }
 
-bool CBlockTreeDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &ltimestamp) {
+bool CIndexDB::ScanAddressUnspentIndex(const std::vector<std::pair<uint160, int> > &addresses, const std::string &strPosition,
+                                           const std::function<bool(const CAddressUnspentKey&, const CAddressUnspentValue&)> &fn) {
+    return ScanAddressKeys<CAddressUnspentKey, CAddressUnspentValue>(*this, DB_ADDRESSUNSPENTINDEX, addresses, strPosition, true, fn);
+}
 
-    CTimestampBlockIndexValue(lts);
-    if (!Read(std::make_pair(DB_BLOCKHASHINDEX, hash), lts))
-       return false;
+std::string CIndexDB::GetAddressKeyPosition(const CAddressIndexKey &key) {
+    return SerializeDB(key).substr(ADDRESS_KEY_PREFIX_SIZE - 1);
+}
 
-    ltimestamp = lts.ltimestamp;
-    return true;
+std::string CIndexDB::GetAddressKeyPosition(const CAddressUnspentKey &key) {
+    return SerializeDB(key).substr(ADDRESS_KEY_PREFIX_SIZE - 1);
 }
 
-bool CBlockTreeDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) {
-    return Read(std::make_pair(DB_SPENTINDEX, key), value);
+bool CIndexDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) {
+    return ReadBuffered(std::make_pair(DB_SPENTINDEX, key), value);
 }
 
-bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
-    CDBBatch batch(*this);
+bool CIndexDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
     for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         if (it->second.IsNull()) {
-            batch.Erase(std::make_pair(DB_SPENTINDEX, it->first));
+            BufferErase(std::make_pair(DB_SPENTINDEX, it->first));
         } else {
-            batch.Write(std::make_pair(DB_SPENTINDEX, it->first), it->second);
+            BufferWrite(std::make_pair(DB_SPENTINDEX, it->first), it->second);
         }
     }
-    return WriteBatch(batch);
+    return true;
 }
 
-bool CBlockTreeDB::blockOnchainActive(const uint256 &hash) {
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
+/** Headers rehashed per GetBlockHeaderHashes call when verifying the block index. */
+static const size_t BLOCK_INDEX_VERIFY_BATCH = 256;
 
-    if (!chainActive.Contains(pblockindex)) {
-       return false;
-    }
+/** Recompute the header hash of every entry, spread over all cores, and check it
+ *  against the hash the entry was stored under. */
+static bool VerifyBlockIndexHashes(const std::vector<CBlockIndex*>& vIndex)
+{
+    const size_t nThreads = std::max(1, GetNumCores());
+    const size_t nPerThread = (vIndex.size() + nThreads - 1) / nThreads;
+    std::atomic<bool> fFailed(false);
+
+    auto verify = [&](size_t nBegin, size_t nEnd) {
+        std::vector<CBlockHeader> vHeaders;
+        std::vector<uint256> vHashes(BLOCK_INDEX_VERIFY_BATCH);
+        for (size_t i = nBegin; i < nEnd && !fFailed; i += BLOCK_INDEX_VERIFY_BATCH) {
+            const size_t nBatch = std::min(nEnd - i, BLOCK_INDEX_VERIFY_BATCH);
+            vHeaders.clear();
+            for (size_t j = 0; j < nBatch; j++) {
+                vHeaders.push_back(vIndex[i + j]->GetBlockHeader());
+            }
+            GetBlockHeaderHashes(vHeaders.data(), nBatch, vHashes.data());
+            for (size_t j = 0; j < nBatch; j++) {
+                if (vHashes[j] != vIndex[i + j]->GetBlockHash()) {
+                    LogPrintf("%s: header hash mismatch: %s\n", __func__, vIndex[i + j]->ToString());
+                    fFailed = true;
+                }
+            }
+        }
+    };
 
-    return true;
+    std::vector<std::thread> threads;
+    for (size_t nBegin = 0; nBegin < vIndex.size(); nBegin += nPerThread) {
+        threads.emplace_back(verify, nBegin, std::min(vIndex.size(), nBegin + nPerThread));
+    }
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    return !fFailed;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
+bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex, bool fVerifyHashes)
 {
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    std::vector<CBlockIndex*> vLoaded;
 
     pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
 
@@ -443,8 +1052,9 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
         if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
             CDiskBlockIndex diskindex;
             if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
+                // Construct block index object. The entry is stored under its
+                // block hash, so there is no need to X11 the header again.
+                CBlockIndex* pindexNew = insertBlockIndex(key.second);
                 pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
                 pindexNew->nHeight        = diskindex.nHeight;
                 pindexNew->nFile          = diskindex.nFile;
@@ -467,6 +1077,9 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
                 if (pindexNew->IsProofOfWork() && !CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, consensusParams))
                     return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
 
+                if (fVerifyHashes)
+                    vLoaded.push_back(pindexNew);
+
                 pcursor->Next();
             } else {
                 return error("%s: failed to read value", __func__);
@@ -476,17 +1089,47 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
         }
     }
 
+    if (fVerifyHashes) {
+        int64_t nStart = GetTimeMillis();
+        if (!VerifyBlockIndexHashes(vLoaded))
+            return error("%s: block index contains entries stored under the wrong hash", __func__);
+        LogPrintf("%s: verified %u header hashes in %dms\n", __func__, vLoaded.size(), GetTimeMillis() - nStart);
+    }
+
+    return true;
+}
+
+bool CIndexDB::ReadAddressIndexSync(uint256& hash) {
+    return ReadBuffered(DB_ADDRESSINDEX_SYNC, hash);
+}
+
+bool CIndexDB::WriteAddressIndexSync(const uint256& hash) {
+    if (hash.IsNull()) {
+        BufferErase(DB_ADDRESSINDEX_SYNC);
+    } else {
+        BufferWrite(DB_ADDRESSINDEX_SYNC, hash);
+    }
+    return true;
+}
+
+bool CIndexDB::ReadIndexBestBlock(uint256& hash) {
+    return ReadBuffered(DB_INDEX_BEST_BLOCK, hash);
+}
+
+bool CIndexDB::WriteIndexBestBlock(const uint256& hash) {
+    BufferWrite(DB_INDEX_BEST_BLOCK, hash);
     return true;
 }
 
-bool CBlockTreeDB::ReadAddressCounter(uint64_t& count) {
-    return Read(DB_ADDRESS_COUNTER_INDEX, count);
+bool CIndexDB::ReadAddressCounter(uint64_t& count) {
+    return ReadBuffered(DB_ADDRESS_COUNTER_INDEX, count);
 }
 
-bool CBlockTreeDB::ModifyAddressCounter(const int64_t& delta) {
+bool CIndexDB::ModifyAddressCounter(const int64_t& delta) {
     uint64_t count = 0;
     ReadAddressCounter(count);
-    return Write(DB_ADDRESS_COUNTER_INDEX, count + delta);
+    BufferWrite(DB_ADDRESS_COUNTER_INDEX, count + delta);
+    return true;
 }
 
 namespace {
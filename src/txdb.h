@@ -9,9 +9,14 @@
 #include "coins.h"
 #include "dbwrapper.h"
 #include "chain.h"
+#include "sync.h"
 
+#include <atomic>
+#include <functional>
 #include <map>
+#include <memory>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -19,13 +24,12 @@ class CBlockIndex;
 class CCoinsViewDBCursor;
 class uint256;
 
+struct CAddressBalanceValue;
+struct CAddressIndexIteratorKey;
 struct CAddressIndexKey;
 struct CAddressUnspentKey;
 struct CAddressUnspentValue;
 struct CMempoolAddressDeltaKey;
-struct CTimestampIndexKey;
-struct CTimestampBlockIndexKey;
-struct CTimestampBlockIndexValue;
 
 //! No need to periodic flush if at least this much space still available.
 static constexpr int MAX_BLOCK_COINSDB_USAGE = 10;
@@ -86,11 +90,70 @@ public:
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
     CCoinsViewCursor *Cursor() const override;
 
+    /**
+     * BatchWrite, leaving mapCoins as it is, so that it can be read from while it is written.
+     * Unless fFinal, the database is left as being in the middle of the transition to hashBlock,
+     * for more coins to be written.
+     */
+    bool WriteCoins(const CCoinsMap &mapCoins, const uint256 &hashBlock, bool fFinal = true);
+
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
 };
 
+/**
+ * Writes the changed coins of the cache above it to the coins database in
+ * the background, so that blocks can go on connecting meanwhile. Until they
+ * are in the database, the coins being written are served from memory.
+ *
+ * One write is in flight at a time, and starting the next one waits for it.
+ * The database marks each write with DB_HEAD_BLOCKS until it completes, so a
+ * write cut short by a crash is finished by ReplayBlocks on the next start.
+ */
+class CCoinsViewFlusher : public CCoinsViewBacked
+{
+public:
+    /** Reads go to viewIn, writes to dbIn, the database viewIn reads from. */
+    CCoinsViewFlusher(CCoinsView* viewIn, CCoinsViewDB* dbIn);
+    ~CCoinsViewFlusher();
+
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    bool HaveCoin(const COutPoint &outpoint) const override;
+    uint256 GetBestBlock() const override;
+    /** Writes synchronously, after the write in flight. */
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+
+    /**
+     * Start writing the changed coins mapCoins, which use nUsage bytes, in
+     * the background. Waits for the write in flight first. Returns false if
+     * that, or any earlier write, failed.
+     */
+    bool StartWrite(CCoinsMap&& mapCoins, size_t nUsage, const uint256 &hashBlock);
+    /** Wait for the write in flight. Returns false if any write failed. */
+    bool Wait();
+    /** Whether a write has failed, without waiting */
+    bool Failed() const { return fFailed; }
+    /** Memory used by the coins being written */
+    size_t DynamicMemoryUsage() const;
+
+private:
+    CCoinsViewFlusher(const CCoinsViewFlusher&);
+    void operator=(const CCoinsViewFlusher&);
+
+    void ThreadWrite();
+
+    CCoinsViewDB* db;
+    std::thread thread;
+    std::atomic<bool> fFailed;
+
+    mutable CCriticalSection cs;
+    //! The coins being written, set by StartWrite and dropped by the write thread once written
+    std::unique_ptr<CCoinsMap> pmapWriting;
+    uint256 hashWriting;
+    size_t nWritingUsage;
+};
+
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
 class CCoinsViewDBCursor: public CCoinsViewCursor
 {
@@ -131,27 +194,120 @@ public:
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
-    bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    /**
+     * Load every block index entry. Entries are keyed by their block hash,
+     * which is trusted unless fVerifyHashes is set, in which case all headers
+     * are rehashed (in parallel) and checked against their keys.
+     */
+    bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex, bool fVerifyHashes = false);
+};
+
+//! -indexdbcache default (MiB)
+static const int64_t nDefaultIndexDBCache = 16;
+//! -indexdbwritebuffer default (MiB), 0 for a quarter of the cache
+static const int64_t nDefaultIndexDBWriteBuffer = 0;
+//! -indexdbbloombits default
+static const int DEFAULT_INDEXDB_BLOOM_BITS = 10;
+
+/**
+ * Access to the explorer index database (indexes/): the address, unspent,
+ * balance and spent indexes. It is a LevelDB instance of its own,
+ * so that its compactions do not hold up block index writes and its cache
+ * can be sized apart from the block index's.
+ *
+ * Writes are held in memory, keyed by their serialized database key, and
+ * reach the database in Flush, which runs with the chainstate flushes.
+ * Reads see the buffered writes.
+ */
+class CIndexDB : public CDBWrapper
+{
+public:
+    CIndexDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, const CDBTuning& tuning = CDBTuning());
+private:
+    CIndexDB(const CIndexDB&);
+    void operator=(const CIndexDB&);
+
+    /** A buffered index write, or erase */
+    struct BufferedIndexWrite {
+        bool fErase;
+        std::string value;
+    };
+    typedef std::map<std::string, BufferedIndexWrite> IndexWriteMap;
+
+    mutable CCriticalSection cs_indexWrites;
+    IndexWriteMap mapIndexWrites;
+    size_t nIndexWritesUsage;
+
+    void BufferIndexWrite(std::string&& key, bool fErase, std::string&& value);
+    template<typename K, typename V> void BufferWrite(const K& key, const V& value);
+    template<typename K> void BufferErase(const K& key);
+    template<typename K, typename V> bool ReadBuffered(const K& key, V& value) const;
+    /** The buffered writes from key on that share its first nPrefixSize bytes */
+    template<typename K> IndexWriteMap GetBufferedRange(const K& key, size_t nPrefixSize) const;
+
+    friend class CBufferedIndexCursor;
+public:
+    /** Write the buffered index writes in one synced batch. */
+    bool Flush();
+    /** Memory used by the index writes waiting for a flush */
+    size_t IndexWriteBufferUsage() const;
+    /**
+     * Move the index entries of databases from before the index database
+     * existed out of the block database. Safe to run again after being
+     * interrupted.
+     */
+    bool MigrateFromBlockTree(CBlockTreeDB& blocktree);
+    /** Erase the timestamp index entries left by older versions, from both databases. */
+    bool DropTimestampIndex(CBlockTreeDB& blocktree);
+
     bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
-	
     bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool ReadAddressIndex(uint160 addressHash, int type,
                         std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                         int start = 0, int end = 0);
+    /** Read the totals of an address. Returns false, leaving value null, if there are none. */
+    bool ReadAddressBalance(const CAddressIndexIteratorKey &key, CAddressBalanceValue &value);
+    /** Write address totals; null ones are erased. */
+    bool UpdateAddressBalanceIndex(const std::vector<std::pair<CAddressIndexIteratorKey, CAddressBalanceValue> > &vect);
+    /** Fill the address totals from the address index, for databases created before they existed. */
+    bool BuildAddressBalanceIndex();
     bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
     bool ReadAddressUnspentIndex(uint160 addressHash, int type,
                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
-    bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
-    bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &vect);
-    bool WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts);
-    bool ReadTimestampBlockIndex(const uint256 &hash, unsigned int &logicalTS);
+    /**
+     * Stream the address index entries of the addresses, merged in block
+     * order, to fn until it returns false. Starts at height nStart, or just
+     * after the entry at strPosition (see GetAddressKeyPosition) if given.
+     */
+    bool ScanAddressIndex(const std::vector<std::pair<uint160, int> > &addresses, int nStart, const std::string &strPosition,
+                          const std::function<bool(const CAddressIndexKey&, CAmount)> &fn);
+    /** Same for the unspent outputs of the addresses, which come in txid order. */
+    bool ScanAddressUnspentIndex(const std::vector<std::pair<uint160, int> > &addresses, const std::string &strPosition,
+                                 const std::function<bool(const CAddressUnspentKey&, const CAddressUnspentValue&)> &fn);
+    /** Where an entry is in the merged order of ScanAddressIndex or ScanAddressUnspentIndex: its key without the address. */
+    static std::string GetAddressKeyPosition(const CAddressIndexKey &key);
+    static std::string GetAddressKeyPosition(const CAddressUnspentKey &key);
     bool ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
     bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect);
 
+    /**
+     * Last block of the active chain the address indexes have been built up
+     * to by the background build, while it is running. Buffered like the
+     * index entries, so that it always matches them. A null hash erases it.
+     */
+    bool ReadAddressIndexSync(uint256& hash);
+    bool WriteAddressIndexSync(const uint256& hash);
+
+    /**
+     * Last block whose entries the block based indexes hold. Buffered like
+     * them, so that after a crash it tells which blocks connected again
+     * on top of an older chain state are already in the indexes.
+     */
+    bool ReadIndexBestBlock(uint256& hash);
+    bool WriteIndexBestBlock(const uint256& hash);
+
     bool ReadAddressCounter(uint64_t& count);
     bool ModifyAddressCounter(const int64_t& delta);
-
-    bool blockOnchainActive(const uint256 &hash);
 };
 
 #endif // BITCOIN_TXDB_H
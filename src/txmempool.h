@@ -9,12 +9,14 @@
 #include <memory>
 #include <set>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <utility>
 #include <string>
 
 #include "amount.h"
 #include "coins.h"
+#include "hash.h"
 #include "indirectmap.h"
 #include "policy/feerate.h"
 #include "primitives/transaction.h"
@@ -50,17 +52,6 @@ struct LockPoints
 
 class CTxMemPool;
 
-struct CSpentIndexKeyCompare
-{
-    bool operator()(const CSpentIndexKey& a, const CSpentIndexKey& b) const {
-        if (a.txid == b.txid) {
-            return a.outputIndex < b.outputIndex;
-        } else {
-            return a.txid < b.txid;
-        }
-    }
-};
-
 struct CMempoolAddressDelta
 {
     int64_t time;
@@ -108,29 +99,6 @@ struct CMempoolAddressDeltaKey
     }
 };
 
-struct CMempoolAddressDeltaKeyCompare
-{
-    bool operator()(const CMempoolAddressDeltaKey& a, const CMempoolAddressDeltaKey& b) const {
-        if (a.type == b.type) {
-            if (a.addressBytes == b.addressBytes) {
-                if (a.txhash == b.txhash) {
-                    if (a.index == b.index) {
-                        return a.spending < b.spending;
-                    } else {
-                        return a.index < b.index;
-                    }
-                } else {
-                    return a.txhash < b.txhash;
-                }
-            } else {
-                return a.addressBytes < b.addressBytes;
-            }
-        } else {
-            return a.type < b.type;
-        }
-    }
-};
-
 /** \class CTxMemPoolEntry
  *
  * CTxMemPoolEntry stores data about the corresponding transaction, as well
@@ -421,6 +389,51 @@ public:
     }
 };
 
+class SaltedAddressHasher
+{
+private:
+    /** Salt */
+    const uint64_t k0, k1;
+
+public:
+    SaltedAddressHasher();
+
+    size_t operator()(const std::pair<uint160, int>& address) const {
+        return CSipHasher(k0, k1).Write(address.second).Write(address.first.begin(), address.first.size()).Finalize();
+    }
+};
+
+/** The mempool address index entry of one input or output */
+struct CMempoolAddressEntry
+{
+    CMempoolAddressDeltaKey key;
+    CMempoolAddressDelta delta;
+
+    CMempoolAddressEntry(const CMempoolAddressDeltaKey& keyIn, const CMempoolAddressDelta& deltaIn) : key(keyIn), delta(deltaIn) {}
+};
+
+// extracts the address hash and type of a CMempoolAddressEntry
+struct mempooladdress_address
+{
+    typedef std::pair<uint160, int> result_type;
+    result_type operator() (const CMempoolAddressEntry &entry) const
+    {
+        return std::make_pair(entry.key.addressBytes, entry.key.type);
+    }
+};
+
+// extracts the transaction hash of a CMempoolAddressEntry
+struct mempooladdress_txid
+{
+    typedef uint256 result_type;
+    result_type operator() (const CMempoolAddressEntry &entry) const
+    {
+        return entry.key.txhash;
+    }
+};
+
+struct address_txid {};
+
 /**
  * CTxMemPool stores valid-according-to-the-current-best-chain transactions
  * that may be included in the next block.
@@ -571,19 +584,26 @@ private:
     typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
     txlinksMap mapLinks;
 
-    typedef std::map<CMempoolAddressDeltaKey, CMempoolAddressDelta, CMempoolAddressDeltaKeyCompare> addressDeltaMap;
+    // The address index entries, bucketed by address for getAddressIndex and
+    // by transaction for their removal with it.
+    typedef boost::multi_index_container<
+        CMempoolAddressEntry,
+        boost::multi_index::indexed_by<
+            boost::multi_index::hashed_non_unique<mempooladdress_address, SaltedAddressHasher>,
+            boost::multi_index::hashed_non_unique<
+                boost::multi_index::tag<address_txid>,
+                mempooladdress_txid,
+                SaltedTxidHasher
+            >
+        >
+    > addressDeltaMap;
     addressDeltaMap mapAddress;
 
-    typedef std::map<uint256, std::vector<CMempoolAddressDeltaKey> > addressDeltaMapInserted;
-	
-    addressDeltaMapInserted mapAddressInserted;
-
-    typedef std::map<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare> mapSpentIndex;
+    // The spent index entries, by the outpoint spent. They are removed by
+    // walking the inputs of the transaction that spends them.
+    typedef std::unordered_map<COutPoint, CSpentIndexValue, SaltedOutpointHasher> mapSpentIndex;
     mapSpentIndex mapSpent;
 
-    typedef std::map<uint256, std::vector<CSpentIndexKey> > mapSpentIndexInserted;
-    mapSpentIndexInserted mapSpentInserted;
-
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
@@ -618,10 +638,9 @@ public:
                          std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results);
     bool removeAddressIndex(const uint256 txhash);
 
-	
     void addSpentIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view);
     bool getSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
-    bool removeSpentIndex(const uint256 txhash);
+    bool removeSpentIndex(const CTransaction &tx);
 
     void removeRecursive(const CTransaction &tx, MemPoolRemovalReason reason = MemPoolRemovalReason::UNKNOWN);
     void removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMemPoolHeight, int flags);
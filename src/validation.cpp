@@ -5,12 +5,15 @@
 
 #include "validation.h"
 
+#include "activeaddresses.h"
 #include "arith_uint256.h"
+#include "blocktimeindex.h"
 #include "base58.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
+#include "coinstats.h"
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/tx_verify.h"
@@ -28,6 +31,7 @@
 #include "primitives/transaction.h"
 #include "random.h"
 #include "reverse_iterator.h"
+#include "script/indexaddress.h"
 #include "script/script.h"
 #include "script/sigcache.h"
 #include "script/standard.h"
@@ -46,6 +50,7 @@
 
 #include <atomic>
 #include <sstream>
+#include <unordered_set>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/join.hpp>
@@ -70,7 +75,7 @@ int nScriptCheckThreads = 0;
 std::atomic_bool fImporting(false);
 bool fReindex = false;
 bool fTxIndex = false;
-bool fAddressIndex = false;
+std::atomic_bool fAddressIndex(false);
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
@@ -90,6 +95,9 @@ CAmount maxTxFee = DEFAULT_TRANSACTION_MAXFEE;
 
 CBlockPolicyEstimator feeEstimator;
 CTxMemPool mempool(&feeEstimator);
+CActiveAddresses activeAddresses(ACTIVE_ADDRESS_WINDOW);
+/** Logical timestamps of the connected blocks, for getblockhashes */
+static CBlockTimeIndex blockTimeIndex;
 
 static void CheckBlockIndex(const Consensus::Params& consensusParams);
 
@@ -202,14 +210,18 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 CCoinsViewDB *pcoinsdbview = nullptr;
+CCoinsViewFlusher *pcoinsflusher = nullptr;
 CCoinsViewCache *pcoinsTip = nullptr;
 CBlockTreeDB *pblocktree = nullptr;
+CIndexDB *pindexdb = nullptr;
 
 enum FlushStateMode {
     FLUSH_STATE_NONE,
     FLUSH_STATE_IF_NEEDED,
     FLUSH_STATE_PERIODIC,
-    FLUSH_STATE_ALWAYS
+    FLUSH_STATE_ALWAYS,
+    /** The block index and the buffered index writes, not the chainstate */
+    FLUSH_STATE_INDEXES
 };
 
 // See definition for documentation
@@ -989,9 +1001,7 @@ bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const
     if (!fAddressIndex)
         return error("Timestamp index not enabled");
 
-    if (!pblocktree->ReadTimestampIndex(high, low, fActiveOnly, hashes))
-        return error("Unable to get hashes for timestamps");
-
+    blockTimeIndex.Find(high, low, fActiveOnly, hashes);
     return true;
 }
 
@@ -1001,7 +1011,7 @@ bool GetAddressIndex(uint160 addressHash, int type,
     if (!fAddressIndex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end))
+    if (!pindexdb->ReadAddressIndex(addressHash, type, addressIndex, start, end))
         return error("unable to get txids for address");
 
     return true;
@@ -1013,12 +1023,157 @@ bool GetAddressUnspent(uint160 addressHash, int type,
     if (!fAddressIndex)
         return error("address index not enabled");
  
-    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
+    if (!pindexdb->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
+        return error("unable to get txids for address");
+
+    return true;
+}
+
+bool ScanAddressIndex(const std::vector<std::pair<uint160, int> > &addresses, int start, const std::string &position,
+                      const std::function<bool(const CAddressIndexKey&, CAmount)> &fn)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pindexdb->ScanAddressIndex(addresses, start, position, fn))
+        return error("unable to get txids for address");
+
+    return true;
+}
+
+bool ScanAddressUnspent(const std::vector<std::pair<uint160, int> > &addresses, const std::string &position,
+                        const std::function<bool(const CAddressUnspentKey&, const CAddressUnspentValue&)> &fn)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pindexdb->ScanAddressUnspentIndex(addresses, position, fn))
         return error("unable to get txids for address");
 
     return true;
 }
 
+/** The addresses a block spends from (per the spent index) and pays to, except the premine address. */
+static void GetBlockActiveAddresses(const CBlock& block, const Consensus::Params& consensusParams, std::vector<uint160>& vAddresses)
+{
+    uint160 premineAddr;
+    int premineType;
+    CBitcoinAddress(consensusParams.premineAddress).GetIndexKey(premineAddr, premineType);
+
+    CIndexAddressExtractor extractor;
+    for (const auto& tx : block.vtx) {
+        for (const auto& in : tx->vin) {
+            CSpentIndexValue spentInfo;
+            CSpentIndexKey spentKey(in.prevout.hash, in.prevout.n);
+            if (!GetSpentIndex(spentKey, spentInfo) || spentInfo.addressType == 0)
+                continue;
+
+            vAddresses.push_back(spentInfo.addressHash);
+        }
+        for (const auto& out : tx->vout) {
+            uint160 addr;
+            int addrType;
+            if (!extractor.Extract(out.scriptPubKey, addrType, addr))
+                continue;
+
+            if (addr != premineAddr)
+                vAddresses.push_back(addr);
+        }
+    }
+}
+
+/** Extend the active address window backwards from its oldest block as far as it reaches. */
+static void ExtendActiveAddresses(const CChainParams& chainparams)
+{
+    CBlock block;
+    for (CBlockIndex* pindex = chainActive[activeAddresses.FrontHeight() - 1]; pindex && activeAddresses.InWindow(pindex->nTime); pindex = pindex->pprev) {
+        if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus())) {
+            LogPrintf("%s: failed to read block %s, active addresses may be undercounted\n", __func__, pindex->GetBlockHash().ToString());
+            break;
+        }
+        std::vector<uint160> vAddresses;
+        GetBlockActiveAddresses(block, chainparams.GetConsensus(), vAddresses);
+        activeAddresses.PushFront(pindex->GetBlockHash(), pindex->nHeight, pindex->nTime, std::move(vAddresses));
+    }
+}
+
+void LoadActiveAddresses(const CChainParams& chainparams)
+{
+    AssertLockHeld(cs_main);
+    activeAddresses.Clear();
+    CBlockIndex* pindexTip = chainActive.Tip();
+    if (!fAddressIndex || pindexTip == nullptr)
+        return;
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindexTip, chainparams.GetConsensus()))
+        return;
+    std::vector<uint160> vAddresses;
+    GetBlockActiveAddresses(block, chainparams.GetConsensus(), vAddresses);
+    activeAddresses.PushBack(pindexTip->GetBlockHash(), pindexTip->nHeight, pindexTip->nTime, std::move(vAddresses));
+    ExtendActiveAddresses(chainparams);
+}
+
+/**
+ * Move the active address window along with the tip: add the block just
+ * connected (pblock) or drop the one just disconnected (pblock null).
+ * Anything else, such as a window that was never loaded, starts it over.
+ */
+static void UpdateActiveAddresses(const CChainParams& chainparams, const CBlockIndex* pindexOld, const CBlock* pblock)
+{
+    AssertLockHeld(cs_main);
+    if (!fAddressIndex)
+        return;
+    if (pindexOld == nullptr || activeAddresses.TipHash() != pindexOld->GetBlockHash()) {
+        LoadActiveAddresses(chainparams);
+        return;
+    }
+
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    if (pblock) {
+        std::vector<uint160> vAddresses;
+        GetBlockActiveAddresses(*pblock, chainparams.GetConsensus(), vAddresses);
+        activeAddresses.PushBack(pindexTip->GetBlockHash(), pindexTip->nHeight, pindexTip->nTime, std::move(vAddresses));
+    } else {
+        activeAddresses.PopBack();
+        if (activeAddresses.IsEmpty()) {
+            LoadActiveAddresses(chainparams);
+        } else {
+            // An earlier tip time reaches further back
+            ExtendActiveAddresses(chainparams);
+        }
+    }
+}
+
+/** Rebuild the block time index from the active chain and the other blocks that have been connected. */
+static void LoadBlockTimeIndex()
+{
+    AssertLockHeld(cs_main);
+    std::vector<const CBlockIndex*> vStale;
+    for (const BlockMap::value_type& entry : mapBlockIndex) {
+        const CBlockIndex* pindex = entry.second;
+        if (pindex->IsValid(BLOCK_VALID_SCRIPTS) && !chainActive.Contains(pindex))
+            vStale.push_back(pindex);
+    }
+    blockTimeIndex.Load(chainActive.Tip(), vStale);
+}
+
+/** Move the block time index along with the tip, starting it over if it does not follow. */
+static void UpdateBlockTimeIndex(const CBlockIndex* pindex, bool fConnect)
+{
+    if (!(fConnect ? blockTimeIndex.Connect(pindex) : blockTimeIndex.Disconnect(pindex)))
+        LoadBlockTimeIndex();
+}
+
+bool GetAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &value)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    pindexdb->ReadAddressBalance(CAddressBalanceKey(type, addressHash), value);
+    return true;
+}
+
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
 {
     if (!fAddressIndex)
@@ -1027,7 +1182,7 @@ bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
     if (mempool.getSpentIndex(key, value))
         return true;
 
-    if (!pblocktree->ReadSpentIndex(key, value))
+    if (!pindexdb->ReadSpentIndex(key, value))
         return false;
 
     return true;
@@ -1477,8 +1632,291 @@ bool AbortNode(CValidationState& state, const std::string& strMessage, const std
     return state.Error(strMessage);
 }
 
+/** What one block does to the balance record of one address. */
+struct CAddressBalanceDelta {
+    CAmount balance = 0;
+    CAmount received = 0;
+    int64_t txCount = 0;
+    /** Position in the block of the last transaction counted */
+    int nLastTx = -1;
+};
+
+typedef std::map<std::pair<unsigned int, uint160>, CAddressBalanceDelta> AddressBalanceDeltas;
+
+void AddAddressBalanceDelta(AddressBalanceDeltas& deltas, unsigned int type, const uint160& hashBytes, int nTx, CAmount nValue)
+{
+    CAddressBalanceDelta& delta = deltas[std::make_pair(type, hashBytes)];
+    delta.balance += nValue;
+    if (nValue > 0)
+        delta.received += nValue;
+    if (delta.nLastTx != nTx) {
+        delta.txCount++;
+        delta.nLastTx = nTx;
+    }
+}
+
+/**
+ * Add (or, when disconnecting, subtract) the deltas to the balance records
+ * and count how many addresses that gives or takes a balance.
+ */
+bool ApplyAddressBalanceDeltas(const AddressBalanceDeltas& deltas, bool fDisconnect, int32_t& activeAddressDelta)
+{
+    const int sign = fDisconnect ? -1 : 1;
+    std::vector<std::pair<CAddressBalanceKey, CAddressBalanceValue> > vBalances;
+    vBalances.reserve(deltas.size());
+    for (const auto& entry : deltas) {
+        const CAddressBalanceKey key(entry.first.first, entry.first.second);
+        CAddressBalanceValue value;
+        pindexdb->ReadAddressBalance(key, value);
+        const CAmount nOldBalance = value.balance;
+        value.balance += sign * entry.second.balance;
+        value.received += sign * entry.second.received;
+        value.txCount += sign * entry.second.txCount;
+        if (nOldBalance == 0 && value.balance != 0) {
+            activeAddressDelta++;
+        } else if (nOldBalance != 0 && value.balance == 0) {
+            activeAddressDelta--;
+        }
+        vBalances.push_back(std::make_pair(key, value));
+    }
+    return pindexdb->UpdateAddressBalanceIndex(vBalances);
+}
+
 } // namespace
 
+/** The block the indexes hold the entries of, or nullptr if they were written without keeping it. */
+static bool ReadIndexBestBlock(const CBlockIndex*& pindexIndexed)
+{
+    pindexIndexed = nullptr;
+    uint256 hash;
+    if (!pindexdb->ReadIndexBestBlock(hash))
+        return true;
+    // The background address index build runs without cs_main
+    LOCK(cs_main);
+    BlockMap::const_iterator it = mapBlockIndex.find(hash);
+    if (it == mapBlockIndex.end())
+        return error("%s: the indexes were written up to unknown block %s", __func__, hash.ToString());
+    pindexIndexed = it->second;
+    return true;
+}
+
+/**
+ * Take blocks back out of the indexes until the block they hold the entries
+ * of is pindex or one of its ancestors. The index writes are flushed before
+ * the chain state's, so after a crash the indexes can be ahead of it, on a
+ * branch that is not connected again.
+ */
+static bool RewindBlockIndexes(const CBlockIndex* pindex, const Consensus::Params& consensusParams)
+{
+    while (true) {
+        const CBlockIndex* pindexIndexed;
+        if (!ReadIndexBestBlock(pindexIndexed))
+            return false;
+        if (!pindexIndexed || pindex->GetAncestor(pindexIndexed->nHeight) == pindexIndexed)
+            return true;
+        LogPrintf("%s: taking block %s (%d) back out of the indexes\n", __func__, pindexIndexed->GetBlockHash().ToString(), pindexIndexed->nHeight);
+        if (!IndexBlockFromDisk(pindexIndexed, true, consensusParams))
+            return false;
+    }
+}
+
+/** Add the index entries of a block, finding the coins it spends in its undo data. */
+static bool WriteBlockIndexes(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
+{
+    if (blockundo.vtxundo.size() + 1 != block.vtx.size())
+        return error("%s: block and undo data inconsistent", __func__);
+
+    // The balances and counters are added to, so a block connected again
+    // over an older chain state after a crash must not be written twice.
+    const CBlockIndex* pindexIndexed;
+    if (!ReadIndexBestBlock(pindexIndexed))
+        return false;
+    if (pindexIndexed && pindexIndexed->GetAncestor(pindex->nHeight) == pindex)
+        return true;
+    if (!RewindBlockIndexes(pindex->pprev, consensusParams))
+        return false;
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    AddressBalanceDeltas addressBalanceDeltas;
+    CIndexAddressExtractor extractor;
+
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction &tx = *(block.vtx[i]);
+        const uint256 txhash = tx.GetHash();
+        uint160 hashBytes;
+        int addressType;
+
+        if (i > 0) {
+            const CTxUndo &txundo = blockundo.vtxundo[i-1];
+            if (txundo.vprevout.size() != tx.vin.size())
+                return error("%s: transaction and undo data inconsistent", __func__);
+            for (size_t j = 0; j < tx.vin.size(); j++) {
+                const CTxIn &input = tx.vin[j];
+                const CTxOut &prevout = txundo.vprevout[j].out;
+
+                if (extractor.Extract(prevout.scriptPubKey, addressType, hashBytes)) {
+                    // record spending activity
+                    addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, txhash, j, true), prevout.nValue * -1));
+                    AddAddressBalanceDelta(addressBalanceDeltas, addressType, hashBytes, i, prevout.nValue * -1);
+
+                    // remove address from unspent index
+                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, input.prevout.hash, input.prevout.n), CAddressUnspentValue()));
+                }
+
+                spentIndex.push_back(std::make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(txhash, j, pindex->nHeight, prevout.nValue, addressType, hashBytes)));
+            }
+        }
+
+        for (unsigned int k = 0; k < tx.vout.size(); k++) {
+            const CTxOut &out = tx.vout[k];
+            if (!extractor.Extract(out.scriptPubKey, addressType, hashBytes))
+                continue;
+
+            // record receiving activity
+            addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, txhash, k, false), out.nValue));
+            AddAddressBalanceDelta(addressBalanceDeltas, addressType, hashBytes, i, out.nValue);
+
+            // record unspent output
+            addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
+        }
+    }
+
+    if (!pindexdb->WriteAddressIndex(addressIndex))
+        return error("%s: failed to write address index", __func__);
+    if (!pindexdb->UpdateAddressUnspentIndex(addressUnspentIndex))
+        return error("%s: failed to write address unspent index", __func__);
+    if (!pindexdb->UpdateSpentIndex(spentIndex))
+        return error("%s: failed to write spent index", __func__);
+
+    // update balances and count new addresses with balance
+    int32_t activeAddressDelta = 0;
+    if (!ApplyAddressBalanceDeltas(addressBalanceDeltas, false, activeAddressDelta))
+        return error("%s: failed to write address balance index", __func__);
+
+    // Remove premine address
+    if (pindex->nHeight == consensusParams.hardforkHeight)
+        activeAddressDelta--;
+
+    if (!pindexdb->ModifyAddressCounter(activeAddressDelta))
+        return error("%s: failed to write address count", __func__);
+    if (!pindexdb->WriteIndexBestBlock(pindex->GetBlockHash()))
+        return error("%s: failed to write index best block", __func__);
+
+    return true;
+}
+
+/** Take the entries of a block back out of the indexes written by WriteBlockIndexes. */
+static bool EraseBlockIndexes(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
+{
+    if (blockundo.vtxundo.size() + 1 != block.vtx.size())
+        return error("%s: block and undo data inconsistent", __func__);
+
+    // A block the indexes do not hold, already taken out before a crash, is
+    // left alone; the blocks written after it are taken out first.
+    const CBlockIndex* pindexIndexed;
+    if (!ReadIndexBestBlock(pindexIndexed))
+        return false;
+    if (pindexIndexed) {
+        if (pindexIndexed->GetAncestor(pindex->nHeight) != pindex)
+            return true;
+        if (pindexIndexed != pindex && !RewindBlockIndexes(pindex, consensusParams))
+            return false;
+    }
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    AddressBalanceDeltas addressBalanceDeltas;
+    CIndexAddressExtractor extractor;
+
+    // undo transactions in reverse order, so that outputs spent in the same
+    // block end up erased from the unspent index
+    for (int i = block.vtx.size() - 1; i >= 0; i--) {
+        const CTransaction &tx = *(block.vtx[i]);
+        const uint256 txhash = tx.GetHash();
+        uint160 hashBytes;
+        int addressType;
+
+        for (unsigned int k = tx.vout.size(); k-- > 0;) {
+            const CTxOut &out = tx.vout[k];
+            if (!extractor.Extract(out.scriptPubKey, addressType, hashBytes))
+                continue;
+
+            // undo receiving activity
+            addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, txhash, k, false), out.nValue));
+            AddAddressBalanceDelta(addressBalanceDeltas, addressType, hashBytes, i, out.nValue);
+
+            // undo unspent index
+            addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, txhash, k), CAddressUnspentValue()));
+        }
+
+        if (i > 0) {
+            const CTxUndo &txundo = blockundo.vtxundo[i-1];
+            if (txundo.vprevout.size() != tx.vin.size())
+                return error("%s: transaction and undo data inconsistent", __func__);
+            for (unsigned int j = tx.vin.size(); j-- > 0;) {
+                const CTxIn &input = tx.vin[j];
+                const Coin &coin = txundo.vprevout[j];
+                const CTxOut &prevout = coin.out;
+
+                spentIndex.push_back(std::make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue()));
+
+                if (!extractor.Extract(prevout.scriptPubKey, addressType, hashBytes))
+                    continue;
+
+                // undo spending activity
+                addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, txhash, j, true), prevout.nValue * -1));
+                AddAddressBalanceDelta(addressBalanceDeltas, addressType, hashBytes, i, prevout.nValue * -1);
+
+                // restore unspent index
+                addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, input.prevout.hash, input.prevout.n), CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, coin.nHeight)));
+            }
+        }
+    }
+
+    if (!pindexdb->EraseAddressIndex(addressIndex))
+        return error("%s: failed to delete address index", __func__);
+    if (!pindexdb->UpdateAddressUnspentIndex(addressUnspentIndex))
+        return error("%s: failed to write address unspent index", __func__);
+    if (!pindexdb->UpdateSpentIndex(spentIndex))
+        return error("%s: failed to delete spent index", __func__);
+
+    int32_t activeAddressDelta = 0;
+    if (!ApplyAddressBalanceDeltas(addressBalanceDeltas, true, activeAddressDelta))
+        return error("%s: failed to write address balance index", __func__);
+    // The premine address is not counted, see WriteBlockIndexes
+    if (pindex->nHeight == consensusParams.hardforkHeight)
+        activeAddressDelta++;
+    if (!pindexdb->ModifyAddressCounter(activeAddressDelta))
+        return error("%s: failed to write address count", __func__);
+    if (!pindexdb->WriteIndexBestBlock(pindex->pprev->GetBlockHash()))
+        return error("%s: failed to write index best block", __func__);
+
+    return true;
+}
+
+bool IndexBlockFromDisk(const CBlockIndex* pindex, bool fErase, const Consensus::Params& consensusParams)
+{
+    // The genesis block has no undo data, and its outputs are not indexed
+    if (!pindex->pprev)
+        return true;
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex, consensusParams))
+        return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+
+    CBlockUndo blockundo;
+    CDiskBlockPos pos = pindex->GetUndoPos();
+    if (pos.IsNull() || !UndoReadFromDisk(blockundo, pos, pindex->pprev->GetBlockHash()))
+        return error("%s: failed to read undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+
+    if (fErase)
+        return EraseBlockIndexes(block, blockundo, pindex, consensusParams);
+    return WriteBlockIndexes(block, blockundo, pindex, consensusParams);
+}
+
 enum DisconnectResult
 {
     DISCONNECT_OK,      // All good.
@@ -1521,8 +1959,9 @@ int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
 }
 
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
- *  When FAILED is returned, view is left in an indeterminate state. */
-static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view)
+ *  When FAILED is returned, view is left in an indeterminate state.
+ *  The address index is left alone unless fUpdateIndexes is set. */
+static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view, bool fUpdateIndexes = true)
 {
     bool fClean = true;
 
@@ -1542,9 +1981,11 @@ static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex*
         return DISCONNECT_FAILED;
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
-    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    // The index entries come from the undo data, which the loop below moves out
+    if (fAddressIndex && fUpdateIndexes && !EraseBlockIndexes(block, blockUndo, pindex, Params().GetConsensus())) {
+        error("DisconnectBlock(): failed to delete address index");
+        return DISCONNECT_FAILED;
+    }
 
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
@@ -1552,47 +1993,6 @@ static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex*
         uint256 hash = tx.GetHash();
         bool is_coinbase = tx.IsCoinBase();
 
-        if (fAddressIndex) {
-
-            for (unsigned int k = tx.vout.size(); k-- > 0;) {
-                const CTxOut &out = tx.vout[k];
-
-                if (out.scriptPubKey.IsPayToScriptHash()) {
-    
-                    std::vector<unsigned char> hashBytes(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22);
-
-                    // undo receiving activity
-                    addressIndex.push_back(std::make_pair(CAddressIndexKey(2, uint160(hashBytes), pindex->nHeight, i, tx.GetHash(), k, false), out.nValue));
-
-                    // undo unspent index
-                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(2, uint160(hashBytes), tx.GetHash(), k), CAddressUnspentValue()));
-
-                } else if (out.scriptPubKey.IsPayToPubkeyHash()) {
-                    std::vector<unsigned char> hashBytes(out.scriptPubKey.begin()+3, out.scriptPubKey.begin()+23);
-
-                    // undo receiving activity
-                    addressIndex.push_back(std::make_pair(CAddressIndexKey(1, uint160(hashBytes), pindex->nHeight, i, tx.GetHash(), k, false), out.nValue));
-
-                    // undo unspent index
-                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(1, uint160(hashBytes), tx.GetHash(), k), CAddressUnspentValue()));
-
-                } else if (out.scriptPubKey.IsPayToPubkey()) {
-                    std::vector<unsigned char> pubkeyBytes(out.scriptPubKey.begin() + 1, out.scriptPubKey.end()-1);
-                    auto tmp(Hash160(pubkeyBytes));
-                    std::vector<unsigned char> hashBytes(tmp.begin(), tmp.end());
-
-                    // undo spending activity
-                    addressIndex.push_back(std::make_pair(CAddressIndexKey(1, uint160(hashBytes), pindex->nHeight, i, tx.GetHash(), k, false), out.nValue));
-
-                    // restore unspent index
-                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(1, uint160(hashBytes), tx.GetHash(), k), CAddressUnspentValue()));
-                } else {
-                    continue;
-                }
-
-            }
-        }            
-
         // Check that all outputs are available and match the outputs in the block itself
         // exactly.
         for (size_t o = 0; o < tx.vout.size(); o++) {
@@ -1615,46 +2015,6 @@ static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex*
             }
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
                 const COutPoint &out = tx.vin[j].prevout;
-                const CTxIn input = tx.vin[j];
-                if (fAddressIndex) {
-                    spentIndex.push_back(std::make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue()));
-
-                    const CTxIn input = tx.vin[j];
-                    Coin coin;
-                    view.GetCoin(input.prevout, coin);
-                    const CTxOut &prevout = coin.out;
-
-                    if (prevout.scriptPubKey.IsPayToScriptHash()) {
-                        std::vector<unsigned char> hashBytes(prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22);
-
-                        // undo spending activity
-                        addressIndex.push_back(std::make_pair(CAddressIndexKey(2, uint160(hashBytes), pindex->nHeight, i, hash, j, true), prevout.nValue * -1));
-
-                        // restore unspent index
-                        addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(2, uint160(hashBytes), input.prevout.hash, input.prevout.n), CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, coin.nHeight)));
-
-                    } else if (prevout.scriptPubKey.IsPayToPubkeyHash()) {
-                        std::vector<unsigned char> hashBytes(prevout.scriptPubKey.begin()+3, prevout.scriptPubKey.begin()+23);
-
-                        // undo spending activity
-                        addressIndex.push_back(std::make_pair(CAddressIndexKey(1, uint160(hashBytes), pindex->nHeight, i, hash, j, true), prevout.nValue * -1));
-
-                        // restore unspent index
-                        addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(1, uint160(hashBytes), input.prevout.hash, input.prevout.n), CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, coin.nHeight)));
-
-                    } else if (prevout.scriptPubKey.IsPayToPubkey()) {
-                        std::vector<unsigned char> pubkeyBytes(prevout.scriptPubKey.begin() + 1, prevout.scriptPubKey.end()-1);
-                        auto tmp(Hash160(pubkeyBytes));
-                        std::vector<unsigned char> hashBytes(tmp.begin(), tmp.end());
-
-                        // undo spending activity
-                        addressIndex.push_back(std::make_pair(CAddressIndexKey(1, uint160(hashBytes), pindex->nHeight, i, hash, j, true), prevout.nValue * -1));
-
-                        // restore unspent index
-                        addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(1, uint160(hashBytes), input.prevout.hash, input.prevout.n), CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, coin.nHeight)));
-                    }
-                }                
-
                 int res = ApplyTxInUndo(std::move(txundo.vprevout[j]), view, out);
                 if (res == DISCONNECT_FAILED) return DISCONNECT_FAILED;
                 fClean = fClean && res != DISCONNECT_UNCLEAN;
@@ -1666,17 +2026,6 @@ static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex*
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
-    if (fAddressIndex) {
-        if (!pblocktree->EraseAddressIndex(addressIndex)) {
-            error("Failed to delete address index");
-            return DISCONNECT_FAILED;
-        }
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            error("Failed to write address unspent index");
-            return DISCONNECT_FAILED;
-        }
-    }
-
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
@@ -1712,6 +2061,99 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+/** Coins read per prefetch check; the queue balances the checks over its threads. */
+static const size_t PREFETCH_COINS_PER_CHECK = 16;
+
+/**
+ * Reads a slice of the coins a block spends from the coins database, into
+ * slots of the caller's that stay spent for the coins not found.
+ */
+class CCoinsPrefetchCheck
+{
+private:
+    const CCoinsView* view;
+    const COutPoint* pOutPoint;
+    Coin* pCoin;
+    size_t nCount;
+
+public:
+    CCoinsPrefetchCheck() : view(nullptr), pOutPoint(nullptr), pCoin(nullptr), nCount(0) {}
+    CCoinsPrefetchCheck(const CCoinsView* viewIn, const COutPoint* pOutPointIn, Coin* pCoinIn, size_t nCountIn) :
+        view(viewIn), pOutPoint(pOutPointIn), pCoin(pCoinIn), nCount(nCountIn) {}
+
+    bool operator()() {
+        for (size_t i = 0; i < nCount; i++) {
+            try {
+                if (!view->GetCoin(pOutPoint[i], pCoin[i]))
+                    pCoin[i].Clear();
+            } catch (const std::runtime_error&) {
+                // Left for the validation thread to read, and report
+                pCoin[i].Clear();
+            }
+        }
+        return true;
+    }
+
+    void swap(CCoinsPrefetchCheck& check) {
+        std::swap(view, check.view);
+        std::swap(pOutPoint, check.pOutPoint);
+        std::swap(pCoin, check.pCoin);
+        std::swap(nCount, check.nCount);
+    }
+};
+
+static CCheckQueue<CCoinsPrefetchCheck> prefetchqueue(8);
+
+void ThreadCoinsPrefetch() {
+    RenameThread("bitcoin-prefetch");
+    prefetchqueue.Thread();
+}
+
+/**
+ * Read the coins a block spends that are not in pcoinsTip yet from the
+ * coins database, in key order and on the prefetch threads, and add them
+ * to pcoinsTip. ConnectBlock then finds them in memory instead of waiting
+ * on the database one input at a time.
+ */
+static void PrefetchBlockInputs(const CBlock& block)
+{
+    AssertLockHeld(cs_main);
+    if (nScriptCheckThreads == 0)
+        return;
+
+    std::unordered_set<uint256, BlockHasher> setBlockTxids;
+    for (const auto& tx : block.vtx) {
+        setBlockTxids.insert(tx->GetHash());
+    }
+    std::vector<COutPoint> vOutPoints;
+    for (const auto& tx : block.vtx) {
+        if (tx->IsCoinBase())
+            continue;
+        for (const CTxIn& txin : tx->vin) {
+            if (!setBlockTxids.count(txin.prevout.hash) && !pcoinsTip->HaveCoinInCache(txin.prevout))
+                vOutPoints.push_back(txin.prevout);
+        }
+    }
+    if (vOutPoints.size() < 2 * PREFETCH_COINS_PER_CHECK)
+        return;
+    std::sort(vOutPoints.begin(), vOutPoints.end());
+    vOutPoints.erase(std::unique(vOutPoints.begin(), vOutPoints.end()), vOutPoints.end());
+
+    std::vector<Coin> vCoins(vOutPoints.size());
+    std::vector<CCoinsPrefetchCheck> vChecks;
+    for (size_t i = 0; i < vOutPoints.size(); i += PREFETCH_COINS_PER_CHECK) {
+        vChecks.emplace_back(pcoinsflusher, &vOutPoints[i], &vCoins[i], std::min(PREFETCH_COINS_PER_CHECK, vOutPoints.size() - i));
+    }
+    CCheckQueueControl<CCoinsPrefetchCheck> control(&prefetchqueue);
+    control.Add(vChecks);
+    control.Wait();
+
+    for (size_t i = 0; i < vOutPoints.size(); i++) {
+        if (!vCoins[i].IsSpent())
+            pcoinsTip->AddFetchedCoin(vOutPoints[i], std::move(vCoins[i]));
+    }
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -1836,7 +2278,7 @@ static int64_t nTimeTotal = 0;
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
  *  can fail if those validity checks fail (among other reasons). */
 static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
-                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck = false)
+                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck = false, bool fUpdateIndexes = true)
 {
     AssertLockHeld(cs_main);
     assert(pindex);
@@ -1977,12 +2419,6 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
-    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
-    std::map<uint160, CAmount> addressBalances;
-    std::map<uint160, CAmount> addressBalanceDiffs;
-    int32_t activeAddressDelta = 0;
     std::vector<PrecomputedTransactionData> txdata;
     txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
     for (unsigned int i = 0; i < block.vtx.size(); i++)
@@ -2009,54 +2445,6 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
                 return state.DoS(100, error("%s: contains a non-BIP68-final transaction", __func__),
                                  REJECT_INVALID, "bad-txns-nonfinal");
             }
-            if (fAddressIndex)
-            {
-                for (size_t j = 0; j < tx.vin.size(); j++) {
-
-                    const CTxIn input = tx.vin[j];
-                    Coin coin;
-                    view.GetCoin(input.prevout, coin);
-                    const CTxOut &prevout = coin.out;
-
-                    uint160 hashBytes;
-                    int addressType;
-
-                    if (prevout.scriptPubKey.IsPayToScriptHash()) {
-                        hashBytes = uint160(std::vector <unsigned char>(prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22));
-                        addressType = 2;
-                    } else if (prevout.scriptPubKey.IsPayToPubkeyHash()) {
-                        hashBytes = uint160(std::vector <unsigned char>(prevout.scriptPubKey.begin()+3, prevout.scriptPubKey.begin()+23));
-                        addressType = 1;
-                    } else if (prevout.scriptPubKey.IsPayToPubkey()) {
-                        std::vector<unsigned char> pubkeyBytes(prevout.scriptPubKey.begin() + 1, prevout.scriptPubKey.end() - 1);
-                        hashBytes = Hash160(pubkeyBytes);
-                        addressType = 1;
-                    } else {
-                        hashBytes.SetNull();
-                        addressType = 0;
-                    }
-                    if (fAddressIndex && addressType > 0) {
-                        // record spending activity
-                        addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, tx.GetHash(), j, true), prevout.nValue * -1));
-                        addressBalanceDiffs[hashBytes] += prevout.nValue * -1;
-
-                        // remove address from unspent index
-                        addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, input.prevout.hash, input.prevout.n), CAddressUnspentValue()));
-
-                        // get address balance
-                        if (addressBalances.find(hashBytes) == addressBalances.cend()) {
-                            std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-                            pblocktree->ReadAddressIndex(hashBytes, addressType, addressIndex);
-                            CAmount balance = 0;
-                            for (const auto& index : addressIndex)
-                                balance += index.second;
-                            addressBalances[hashBytes] = balance;
-                        }
-                    }
-
-                    spentIndex.push_back(std::make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(tx.GetHash(), j, pindex->nHeight, prevout.nValue, addressType, hashBytes)));
-                }
-            }
         }
 
         // GetTransactionSigOpCost counts 3 types of sigops:
@@ -2082,45 +2470,6 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
         }
 
         CTxUndo undoDummy;
-        if (fAddressIndex) {
-            for (unsigned int k = 0; k < tx.vout.size(); k++) {
-                const CTxOut &out = tx.vout[k];
-
-                uint160 hashBytes;
-                int addressType;
-
-                if (out.scriptPubKey.IsPayToScriptHash()) {
-                    hashBytes = uint160(std::vector <unsigned char>(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22));
-                    addressType = 2;
-                } else if (out.scriptPubKey.IsPayToPubkeyHash()) {
-                    hashBytes = uint160(std::vector <unsigned char>(out.scriptPubKey.begin()+3, out.scriptPubKey.begin()+23));
-                    addressType = 1;
-                } else if (out.scriptPubKey.IsPayToPubkey()) {
-                    std::vector<unsigned char> pubkeyBytes(out.scriptPubKey.begin() + 1, out.scriptPubKey.end() - 1);
-                    hashBytes = Hash160(pubkeyBytes);
-                    addressType = 1;
-                } else {
-                    continue;
-                }
-
-                // record receiving activity
-                addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, tx.GetHash(), k, false), out.nValue));
-                addressBalanceDiffs[hashBytes] += out.nValue;
-
-                // record unspent output
-                addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, tx.GetHash(), k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
-
-                // get address balance
-                if (addressBalances.find(hashBytes) == addressBalances.cend()) {
-                    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-                    pblocktree->ReadAddressIndex(hashBytes, addressType, addressIndex);
-                    CAmount balance = 0;
-                    for (const auto& index : addressIndex)
-                        balance += index.second;
-                    addressBalances[hashBytes] = balance;
-                }
-            }
-        }
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
         }
@@ -2184,57 +2533,9 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     if (fTxIndex)
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
-    if (fAddressIndex) {
-        if (!pblocktree->WriteAddressIndex(addressIndex)) {
+    if (fAddressIndex && fUpdateIndexes)
+        if (!WriteBlockIndexes(block, blockundo, pindex, chainparams.GetConsensus()))
             return AbortNode(state, "Failed to write address index");
-        }
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            return AbortNode(state, "Failed to write address unspent index");
-        }
-
-        if (!pblocktree->UpdateSpentIndex(spentIndex))
-            return AbortNode(state, "Failed to write transaction index");
-
-        // count new addresses with balance
-        for (const auto& entry : addressBalances) {
-            const auto& diff = addressBalanceDiffs.find(entry.first)->second;
-            if (diff == 0) continue;
-
-            const auto& balance = entry.second;
-            const auto newBalance = balance + diff;
-            if (newBalance == 0) {
-                activeAddressDelta--;
-            } else if (balance == 0) {
-                activeAddressDelta++;
-            }
-        }
-
-        // Remove premine address
-        if (isPremineBlock)
-            activeAddressDelta--;
-
-        if (!pblocktree->ModifyAddressCounter(activeAddressDelta))
-            return AbortNode(state, "Failed to write address count");
-
-        unsigned int logicalTS = pindex->nTime;
-        unsigned int prevLogicalTS = 0;
-    
-        // retrieve logical timestamp of the previous block
-        if (pindex->pprev)
-            if (!pblocktree->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), prevLogicalTS))
-                LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
-
-        if (logicalTS <= prevLogicalTS) {
-            logicalTS = prevLogicalTS + 1;
-            LogPrintf("%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, pindex->nTime, prevLogicalTS, logicalTS);
-        }
-
-        if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(logicalTS, pindex->GetBlockHash())))
-            return AbortNode(state, "Failed to write timestamp index");
-
-        if (!pblocktree->WriteTimestampBlockIndex(CTimestampBlockIndexKey(pindex->GetBlockHash()), CTimestampBlockIndexValue(logicalTS)))
-            return AbortNode(state, "Failed to write blockhash index");
-    }
 
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
@@ -2248,6 +2549,9 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     return true;
 }
 
+/** Part of the coins cache kept across a background chainstate flush, in percent */
+static const int64_t COINS_CACHE_KEEP_PERCENT = 25;
+
 /**
  * Update the on-disk chain state.
  * The caches and indexes are flushed depending on the mode we're called with
@@ -2265,6 +2569,8 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
     bool fDoFullFlush = false;
     int64_t nNow = 0;
     try {
+    if (pcoinsflusher->Failed())
+        return AbortNode(state, "Failed to write to coin database");
     {
         LOCK(cs_LastBlockFile);
         if (fPruneMode && (fCheckForPruning || nManualPruneHeight > 0) && !fReindex) {
@@ -2294,7 +2600,9 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             nLastSetChain = nNow;
         }
         int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
-        int64_t cacheSize = pcoinsTip->DynamicMemoryUsage();
+        // Buffered index writes are flushed with the coins and share their budget,
+        // as do the coins still being written in the background.
+        int64_t cacheSize = pcoinsTip->DynamicMemoryUsage() + pcoinsflusher->DynamicMemoryUsage() + pindexdb->IndexWriteBufferUsage();
         int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
         // The cache is large and we're within 10% and 10 MiB of the limit, but we have time now (not in the middle of a block processing).
         bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize > std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024);
@@ -2306,8 +2614,9 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
         bool fPeriodicFlush = mode == FLUSH_STATE_PERIODIC && nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
         // Combine all conditions that result in a full cache flush.
         fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune;
+        const bool fIndexFlush = fDoFullFlush || mode == FLUSH_STATE_INDEXES;
         // Write blocks and block index to disk.
-        if (fDoFullFlush || fPeriodicWrite) {
+        if (fIndexFlush || fPeriodicWrite) {
             // Depend on nMinDiskSpace to ensure we can write block index
             if (!CheckDiskSpace(0))
                 return state.Error("out of disk space");
@@ -2331,6 +2640,12 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
                     return AbortNode(state, "Failed to write to block index database");
                 }
             }
+            // The buffered index writes go with the chainstate, after the block index they refer to,
+            // or on their own while the background address index build is their only writer.
+            // They are written ahead of the chainstate and carry the block they are up to,
+            // so that the blocks connected again after a crash in between are skipped.
+            if (fIndexFlush && !pindexdb->Flush())
+                return AbortNode(state, "Failed to write to index database");
             // Finally remove any pruned files
             if (fFlushForPrune)
                 UnlinkPrunedFiles(setFilesToPrune);
@@ -2346,8 +2661,17 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
             // Flush the chainstate (which may refer to block index entries).
-            if (!pcoinsTip->Flush())
-                return AbortNode(state, "Failed to write to coin database");
+            if (mode == FLUSH_STATE_ALWAYS) {
+                if (!pcoinsTip->Flush())
+                    return AbortNode(state, "Failed to write to coin database");
+            } else {
+                // Otherwise the changed coins are written in the background,
+                // while the next blocks connect on top of the coins kept.
+                CCoinsMap mapDirty;
+                size_t nDirtyUsage = pcoinsTip->TakeDirty(mapDirty, nCoinCacheUsage * COINS_CACHE_KEEP_PERCENT / 100);
+                if (!pcoinsflusher->StartWrite(std::move(mapDirty), nDirtyUsage, pcoinsTip->GetBestBlock()))
+                    return AbortNode(state, "Failed to write to coin database");
+            }
             nLastFlush = nNow;
         }
     }
@@ -2368,6 +2692,12 @@ void FlushStateToDisk() {
     FlushStateToDisk(chainparams, state, FLUSH_STATE_ALWAYS);
 }
 
+bool FlushIndexesToDisk() {
+    CValidationState state;
+    const CChainParams& chainparams = Params();
+    return FlushStateToDisk(chainparams, state, FLUSH_STATE_INDEXES);
+}
+
 void PruneAndFlush() {
     CValidationState state;
     fCheckForPruning = true;
@@ -2488,6 +2818,8 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
 
     // Update chainActive and related variables.
     UpdateTip(pindexDelete->pprev, chainparams);
+    UpdateActiveAddresses(chainparams, pindexDelete, nullptr);
+    UpdateBlockTimeIndex(pindexDelete, false);
     // Let wallets know transactions went from 1-confirmed to
     // 0-confirmed or conflicted:
     GetMainSignals().BlockDisconnected(pblock);
@@ -2495,6 +2827,7 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
 }
 
 static int64_t nTimeReadFromDisk = 0;
+static int64_t nTimePrefetch = 0;
 static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
@@ -2587,9 +2920,12 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     }
     const CBlock& blockConnecting = *pthisBlock;
     // Apply the block atomically to the chain state.
-    int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
+    int64_t nTimeRead = GetTimeMicros(); nTimeReadFromDisk += nTimeRead - nTime1;
+    LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTimeRead - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+    PrefetchBlockInputs(blockConnecting);
+    int64_t nTime2 = GetTimeMicros(); nTimePrefetch += nTime2 - nTimeRead;
     int64_t nTime3;
-    LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+    LogPrint(BCLog::BENCH, "  - Prefetch inputs: %.2fms [%.2fs]\n", (nTime2 - nTimeRead) * 0.001, nTimePrefetch * 0.000001);
     {
         CCoinsViewCache view(pcoinsTip);
         bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams);
@@ -2616,6 +2952,8 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     disconnectpool.removeForBlock(blockConnecting.vtx);
     // Update chainActive & related variables.
     UpdateTip(pindexNew, chainparams);
+    UpdateActiveAddresses(chainparams, pindexNew->pprev, &blockConnecting);
+    UpdateBlockTimeIndex(pindexNew, true);
 
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
     LogPrint(BCLog::BENCH, "  - Connect postprocess: %.2fms [%.2fs]\n", (nTime6 - nTime5) * 0.001, nTimePostConnect * 0.000001);
@@ -3438,7 +3776,7 @@ static bool ContextualCheckBlock(const CBlock& block, CValidationState& state, c
     return true;
 }
 
-static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fCheckPOW = true)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
@@ -3457,7 +3795,7 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus()))
+        if (!CheckBlockHeader(block, state, chainparams.GetConsensus(), fCheckPOW))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
 
         // Get prev block index
@@ -3497,15 +3835,92 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
     return true;
 }
 
+/** Headers hashed per check; the queue balances the checks over its threads. */
+static const size_t HEADERS_PER_HASH_CHECK = 32;
+
+/**
+ * Hashes a slice of the headers of a headers message, which keeps the hashes in
+ * the headers' hash caches, and checks their proof of work.
+ */
+class CHeaderHashCheck
+{
+private:
+    const CBlockHeader* pHeader;
+    char* pPowValid;
+    size_t nCount;
+    const Consensus::Params* pConsensusParams;
+
+public:
+    CHeaderHashCheck() : pHeader(nullptr), pPowValid(nullptr), nCount(0), pConsensusParams(nullptr) {}
+    CHeaderHashCheck(const CBlockHeader* pHeaderIn, char* pPowValidIn, size_t nCountIn, const Consensus::Params* pConsensusParamsIn) :
+        pHeader(pHeaderIn), pPowValid(pPowValidIn), nCount(nCountIn), pConsensusParams(pConsensusParamsIn) {}
+
+    bool operator()() {
+        std::vector<uint256> vHashes(nCount);
+        GetBlockHeaderHashes(pHeader, nCount, vHashes.data());
+        for (size_t i = 0; i < nCount; i++) {
+            pPowValid[i] = !pHeader[i].IsProofOfWork() || CheckProofOfWork(vHashes[i], pHeader[i].nBits, *pConsensusParams);
+        }
+        return true;
+    }
+
+    void swap(CHeaderHashCheck& check) {
+        std::swap(pHeader, check.pHeader);
+        std::swap(pPowValid, check.pPowValid);
+        std::swap(nCount, check.nCount);
+        std::swap(pConsensusParams, check.pConsensusParams);
+    }
+};
+
+static CCheckQueue<CHeaderHashCheck> headercheckqueue(4);
+
+void ThreadHeaderHashCheck() {
+    RenameThread("bitcoin-hdrhash");
+    headercheckqueue.Thread();
+}
+
+/**
+ * Hash a batch of headers and check their proof of work without holding any
+ * lock, on the header hashing threads and the calling one. The hashes are kept
+ * in the headers' hash caches, so AcceptBlockHeader does not compute them again.
+ * vPowValid[i] is set when header i passes the proof of work check (or is
+ * proof of stake, which has none).
+ */
+static void PrecheckBlockHeaders(const std::vector<CBlockHeader>& headers, const Consensus::Params& consensusParams, std::vector<char>& vPowValid)
+{
+    vPowValid.assign(headers.size(), 0);
+    if (headers.empty())
+        return;
+
+    std::vector<CHeaderHashCheck> vChecks;
+    for (size_t nBegin = 0; nBegin < headers.size(); nBegin += HEADERS_PER_HASH_CHECK) {
+        const size_t nCount = std::min(HEADERS_PER_HASH_CHECK, headers.size() - nBegin);
+        vChecks.emplace_back(headers.data() + nBegin, vPowValid.data() + nBegin, nCount, &consensusParams);
+    }
+    if (vChecks.size() == 1) {
+        vChecks[0]();
+        return;
+    }
+    CCheckQueueControl<CHeaderHashCheck> control(&headercheckqueue);
+    control.Add(vChecks);
+    control.Wait();
+}
+
 // Exposed wrapper for AcceptBlockHeader
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex, CBlockHeader *first_invalid)
 {
     if (first_invalid != nullptr) first_invalid->SetNull();
+
+    std::vector<char> vPowValid;
+    PrecheckBlockHeaders(headers, chainparams.GetConsensus(), vPowValid);
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
+        for (size_t i = 0; i < headers.size(); i++) {
+            const CBlockHeader& header = headers[i];
             CBlockIndex *pindex = nullptr; // Use a temp pindex instead of ppindex to avoid a const_cast
-            if (!AcceptBlockHeader(header, state, chainparams, &pindex)) {
+            // Headers that failed the precheck go through the full check, so
+            // that they are rejected exactly as before.
+            if (!AcceptBlockHeader(header, state, chainparams, &pindex, !vPowValid[i])) {
                 if (first_invalid) *first_invalid = header;
                 return false;
             }
@@ -3885,7 +4300,8 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
 
 bool static LoadBlockIndexDB(const CChainParams& chainparams)
 {
-    if (!pblocktree->LoadBlockIndexGuts(chainparams.GetConsensus(), InsertBlockIndex))
+    if (!pblocktree->LoadBlockIndexGuts(chainparams.GetConsensus(), InsertBlockIndex,
+                                        gArgs.GetBoolArg("-verifyblockindexhashes", DEFAULT_VERIFY_BLOCK_INDEX_HASHES)))
         return false;
 
     boost::this_thread::interruption_point();
@@ -3981,9 +4397,20 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
     pblocktree->ReadFlag("txindex", fTxIndex);
     LogPrintf("%s: transaction index %s\n", __func__, fTxIndex ? "enabled" : "disabled");
 
-    pblocktree->ReadFlag("addrindex", fAddressIndex);
+    bool fAddressIndexFlag = false;
+    pblocktree->ReadFlag("addrindex", fAddressIndexFlag);
+    fAddressIndex = fAddressIndexFlag;
     LogPrintf("LoadBlockIndexDB(): address index %s\n", fAddressIndex ? "enabled" : "disabled");
 
+    // Address indexes from before the balance records need them built once
+    bool fAddressBalances = false;
+    pblocktree->ReadFlag("addrbalance", fAddressBalances);
+    if (fAddressIndex && !fAddressBalances) {
+        LogPrintf("LoadBlockIndexDB(): building address balance index\n");
+        if (!pindexdb->BuildAddressBalanceIndex() || !pblocktree->WriteFlag("addrbalance", true))
+            return error("LoadBlockIndexDB(): failed to build address balance index");
+    }
+
     return true;
 }
 
@@ -4006,6 +4433,7 @@ bool LoadChainTip(const CChainParams& chainparams)
     if (it == mapBlockIndex.end())
         return false;
     chainActive.SetTip(it->second);
+    LoadBlockTimeIndex();
 
     PruneBlockIndexCandidates();
 
@@ -4081,7 +4509,7 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
         if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
             assert(coins.GetBestBlock() == pindex->GetBlockHash());
-            DisconnectResult res = DisconnectBlock(block, pindex, coins);
+            DisconnectResult res = DisconnectBlock(block, pindex, coins, false);
             if (res == DISCONNECT_FAILED) {
                 return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
             }
@@ -4109,7 +4537,7 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
             CBlock block;
             if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
                 return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-            if (!ConnectBlock(block, state, pindex, coins, chainparams))
+            if (!ConnectBlock(block, state, pindex, coins, chainparams, false, false))
                 return error("VerifyDB(): *** found unconnectable block at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
         }
     }
@@ -4307,6 +4735,7 @@ void UnloadBlockIndex()
     LOCK(cs_main);
     setBlockIndexCandidates.clear();
     chainActive.SetTip(nullptr);
+    blockTimeIndex.Clear();
     pindexBestInvalid = nullptr;
     pindexBestHeader = nullptr;
     mempool.clear();
@@ -4348,6 +4777,7 @@ bool LoadBlockIndex(const CChainParams& chainparams)
 
         fAddressIndex = gArgs.GetBoolArg("-addrindex", false);
         pblocktree->WriteFlag("addrindex", fAddressIndex);    
+        pblocktree->WriteFlag("addrbalance", true);
         LogPrintf("Initializing databases...\n");
         // Use the provided setting for -txindex in the new database
         fTxIndex = gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX);
@@ -4835,6 +5265,228 @@ void DumpMempool(void)
     }
 }
 
+static const uint32_t UTXO_SNAPSHOT_VERSION = 1;
+/** Coins written to the coins database at once while loading a snapshot */
+static const size_t UTXO_SNAPSHOT_BATCH_COINS = 200000;
+
+/*
+ * A UTXO snapshot is, after a header of the network magic, the version and
+ * the base block hash, the coins by transaction, in the order of the coins
+ * database: the number of outputs, the txid and, for each output, its index
+ * and the coin. No outputs ends the coins. A trailer of the number of coins
+ * and the hash of the UTXO set, as gettxoutsetinfo computes it, follows.
+ */
+
+bool DumpUTXOSnapshot(CCoinsViewDB* view, const fs::path& path, CCoinsStats& stats)
+{
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    {
+        // No flush may start between the one of everything and the cursor
+        LOCK(cs_main);
+        FlushStateToDisk();
+        pcursor.reset(view->Cursor());
+        BlockMap::const_iterator it = mapBlockIndex.find(pcursor->GetBestBlock());
+        if (it == mapBlockIndex.end())
+            return error("%s: the chain state is at unknown block %s", __func__, pcursor->GetBestBlock().ToString());
+        stats.nHeight = it->second->nHeight;
+    }
+
+    fs::path pathTemp = path;
+    pathTemp += ".new";
+    CAutoFile file(fsbridge::fopen(pathTemp, "wb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return error("%s: unable to open %s", __func__, pathTemp.string());
+
+    int64_t nStart = GetTimeMicros();
+    try {
+        CCoinsStatsHasher hasher(stats, pcursor->GetBestBlock());
+        file << FLATDATA(Params().MessageStart());
+        file << UTXO_SNAPSHOT_VERSION;
+        file << stats.hashBlock;
+
+        uint256 hashTx;
+        std::vector<std::pair<uint32_t, Coin> > vOutputs;
+        auto WriteOutputs = [&]() {
+            uint64_t nOutputs = vOutputs.size();
+            file << VARINT(nOutputs);
+            file << hashTx;
+            for (const auto& output : vOutputs) {
+                file << VARINT(output.first);
+                file << output.second;
+            }
+            vOutputs.clear();
+        };
+        while (pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            COutPoint key;
+            Coin coin;
+            if (!pcursor->GetKey(key) || !pcursor->GetValue(coin))
+                return error("%s: unable to read value", __func__);
+            if (!vOutputs.empty() && key.hash != hashTx)
+                WriteOutputs();
+            hashTx = key.hash;
+            vOutputs.emplace_back(key.n, coin);
+            hasher.Add(key, std::move(coin));
+            pcursor->Next();
+        }
+        if (!vOutputs.empty())
+            WriteOutputs();
+        uint64_t nEnd = 0;
+        file << VARINT(nEnd);
+
+        hasher.Finalize();
+        file << stats.nTransactionOutputs;
+        file << stats.hashSerialized;
+        FileCommit(file.Get());
+        file.fclose();
+    } catch (const std::exception& e) {
+        return error("%s: unable to write %s: %s", __func__, pathTemp.string(), e.what());
+    }
+    if (!RenameOver(pathTemp, path))
+        return error("%s: unable to rename %s", __func__, pathTemp.string());
+
+    LogPrintf("Dumped a UTXO snapshot of %u coins at block %s to %s: %.2fs\n", stats.nTransactionOutputs, stats.hashBlock.ToString(), path.string(), (GetTimeMicros() - nStart) * 0.000001);
+    return true;
+}
+
+/** Read the header of the snapshot in file, up to its base block hash. Throws on read errors. */
+static bool ReadUTXOSnapshotHeader(CAutoFile& file, const fs::path& path, uint256& hashBlock)
+{
+    CMessageHeader::MessageStartChars pchMessageStart;
+    uint32_t nVersion;
+    file >> FLATDATA(pchMessageStart);
+    file >> nVersion;
+    file >> hashBlock;
+    if (memcmp(pchMessageStart, Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE) != 0)
+        return error("%s: %s is a snapshot of another network", __func__, path.string());
+    if (nVersion != UTXO_SNAPSHOT_VERSION)
+        return error("%s: %s has unknown version %u", __func__, path.string(), nVersion);
+    return true;
+}
+
+/** Read the snapshot at path, giving each coin to fn, and check it against its trailer. */
+static bool ReadUTXOSnapshot(const fs::path& path, CCoinsStats& stats, const std::function<bool(const COutPoint&, const Coin&)>& fn)
+{
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return error("%s: unable to open %s", __func__, path.string());
+
+    try {
+        uint256 hashBlock;
+        if (!ReadUTXOSnapshotHeader(file, path, hashBlock))
+            return false;
+
+        CCoinsStatsHasher hasher(stats, hashBlock);
+        while (true) {
+            uint64_t nOutputs;
+            file >> VARINT(nOutputs);
+            if (nOutputs == 0)
+                break;
+            COutPoint outpoint;
+            file >> outpoint.hash;
+            for (uint64_t i = 0; i < nOutputs; i++) {
+                Coin coin;
+                file >> VARINT(outpoint.n);
+                file >> coin;
+                if (coin.IsSpent())
+                    return error("%s: %s has a spent coin", __func__, path.string());
+                if (!fn(outpoint, coin))
+                    return false;
+                hasher.Add(outpoint, std::move(coin));
+            }
+            if (ShutdownRequested())
+                return false;
+        }
+        hasher.Finalize();
+
+        uint64_t nCoins;
+        uint256 hashSerialized;
+        file >> nCoins;
+        file >> hashSerialized;
+        if (nCoins != stats.nTransactionOutputs || hashSerialized != stats.hashSerialized)
+            return error("%s: %s is corrupt", __func__, path.string());
+    } catch (const std::exception& e) {
+        return error("%s: unable to read %s: %s", __func__, path.string(), e.what());
+    }
+    return true;
+}
+
+bool LoadUTXOSnapshot(CCoinsViewDB* view, const fs::path& path, const uint256& hashExpected)
+{
+    int64_t nStart = GetTimeMicros();
+
+    // A chain state at or past the base block already has what the snapshot
+    // would give it, as happens on every restart that keeps the option.
+    if (!view->GetBestBlock().IsNull()) {
+        uint256 hashBase;
+        {
+            CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+            if (file.IsNull())
+                return error("%s: unable to open %s", __func__, path.string());
+            try {
+                if (!ReadUTXOSnapshotHeader(file, path, hashBase))
+                    return false;
+            } catch (const std::exception& e) {
+                return error("%s: unable to read %s: %s", __func__, path.string(), e.what());
+            }
+        }
+        LOCK(cs_main);
+        BlockMap::const_iterator itBase = mapBlockIndex.find(hashBase);
+        BlockMap::const_iterator itBest = mapBlockIndex.find(view->GetBestBlock());
+        if (itBase != mapBlockIndex.end() && itBest != mapBlockIndex.end() &&
+            itBest->second->GetAncestor(itBase->second->nHeight) == itBase->second) {
+            LogPrintf("%s: Warning: the chain state at block %s already contains the base block %s of %s, ignoring -loadutxosnapshot\n",
+                      __func__, view->GetBestBlock().ToString(), hashBase.ToString(), path.string());
+            return true;
+        }
+        return error("%s: the chain state at block %s does not build on the base block %s of the snapshot, start with -reindex-chainstate to replace it",
+                     __func__, view->GetBestBlock().ToString(), hashBase.ToString());
+    }
+
+    // Check the whole snapshot first, so that nothing of another one ends
+    // up in the coins database.
+    CCoinsStats stats;
+    if (!ReadUTXOSnapshot(path, stats, [](const COutPoint&, const Coin&) { return true; }))
+        return false;
+    if (stats.hashSerialized != hashExpected)
+        return error("%s: the UTXO set of %s has hash %s, not %s", __func__, path.string(), stats.hashSerialized.ToString(), hashExpected.ToString());
+    {
+        LOCK(cs_main);
+        BlockMap::iterator it = mapBlockIndex.find(stats.hashBlock);
+        if (it == mapBlockIndex.end() || it->second->nChainTx == 0)
+            return error("%s: the base block %s of the snapshot, or one of its ancestors, is not on disk", __func__, stats.hashBlock.ToString());
+    }
+
+    // A load that was interrupted is left as a replay up to the base block,
+    // from an empty database.
+    const std::vector<uint256> vHeads = view->GetHeadBlocks();
+    const bool fResume = vHeads.size() == 2 && vHeads[0] == stats.hashBlock && vHeads[1].IsNull();
+    if (!vHeads.empty() && !fResume)
+        return error("%s: the chain state is not empty, start with -reindex-chainstate to replace it", __func__);
+
+    CCoinsStats statsWritten;
+    CCoinsMap mapCoins;
+    bool fOk = ReadUTXOSnapshot(path, statsWritten, [&](const COutPoint& outpoint, const Coin& coin) {
+        CCoinsCacheEntry& entry = mapCoins[outpoint];
+        entry.coin = coin;
+        entry.flags = CCoinsCacheEntry::DIRTY;
+        if (mapCoins.size() < UTXO_SNAPSHOT_BATCH_COINS)
+            return true;
+        bool fWritten = view->WriteCoins(mapCoins, stats.hashBlock, false);
+        mapCoins.clear();
+        return fWritten;
+    });
+    // Should the snapshot have changed since it was checked, what is
+    // written so far is left to ReplayBlocks, as if interrupted.
+    if (!fOk || statsWritten.hashSerialized != hashExpected)
+        return error("%s: unable to load %s", __func__, path.string());
+    if (!view->WriteCoins(mapCoins, stats.hashBlock))
+        return error("%s: unable to write the coins database", __func__);
+
+    LogPrintf("Loaded a UTXO snapshot of %u coins at block %s: %.2fs\n", stats.nTransactionOutputs, stats.hashBlock.ToString(), (GetTimeMicros() - nStart) * 0.000001);
+    return true;
+}
+
 //! Guess how far we are in the verification process at the given block index
 double GuessVerificationProgress(const ChainTxData& data, CBlockIndex *pindex) {
     if (pindex == nullptr)
@@ -21,6 +21,7 @@
 
 #include <algorithm>
 #include <exception>
+#include <functional>
 #include <map>
 #include <set>
 #include <stdint.h>
@@ -30,141 +31,25 @@
 
 #include <atomic>
 
+class CActiveAddresses;
 class CBlockIndex;
 class CBlockTreeDB;
+class CIndexDB;
 class CChainParams;
 class CCoinsViewDB;
+class CCoinsViewFlusher;
 class CInv;
 class CConnman;
 class CScriptCheck;
 class CBlockPolicyEstimator;
 class CTxMemPool;
 class CValidationState;
+struct CCoinsStats;
 struct ChainTxData;
 
 struct PrecomputedTransactionData;
 struct LockPoints;
 
-struct CTimestampIndexIteratorKey {
-    unsigned int timestamp;
-
-    size_t GetSerializeSize(int nType, int nVersion) const {
-        return 4;
-    }
-    template<typename Stream>
-    void Serialize(Stream& s) const {
-        ser_writedata32be(s, timestamp);
-    }
-    template<typename Stream>
-    void Unserialize(Stream& s) {
-        timestamp = ser_readdata32be(s);
-    }
-
-    CTimestampIndexIteratorKey(unsigned int time) {
-        timestamp = time;
-    }
-
-    CTimestampIndexIteratorKey() {
-        SetNull();
-    }
-
-    void SetNull() {
-        timestamp = 0;
-    }
-};
-
-struct CTimestampIndexKey {
-    unsigned int timestamp;
-    uint256 blockHash;
-
-    size_t GetSerializeSize(int nType, int nVersion) const {
-        return 36;
-    }
-    template<typename Stream>
-    void Serialize(Stream& s) const {
-        ser_writedata32be(s, timestamp);
-        blockHash.Serialize(s);
-    }
-    template<typename Stream>
-    void Unserialize(Stream& s) {
-        timestamp = ser_readdata32be(s);
-        blockHash.Unserialize(s);
-    }
-
-    CTimestampIndexKey(unsigned int time, uint256 hash) {
-        timestamp = time;
-        blockHash = hash;
-    }
-
-    CTimestampIndexKey() {
-        SetNull();
-    }
-
-    void SetNull() {
-        timestamp = 0;
-        blockHash.SetNull();
-    }
-};
-
-struct CTimestampBlockIndexKey {
-    uint256 blockHash;
-
-    size_t GetSerializeSize(int nType, int nVersion) const {
-        return 32;
-    }
-
-    template<typename Stream>
-    void Serialize(Stream& s) const {
-        blockHash.Serialize(s);
-    }
-
-    template<typename Stream>
-    void Unserialize(Stream& s) {
-        blockHash.Unserialize(s);
-    }
-
-    CTimestampBlockIndexKey(uint256 hash) {
-        blockHash = hash;
-    }
-
-    CTimestampBlockIndexKey() {
-        SetNull();
-    }
-
-    void SetNull() {
-        blockHash.SetNull();
-    }
-};
-
-struct CTimestampBlockIndexValue {
-    unsigned int ltimestamp;
-    size_t GetSerializeSize(int nType, int nVersion) const {
-        return 4;
-    }
-
-    template<typename Stream>
-    void Serialize(Stream& s) const {
-        ser_writedata32(s, ltimestamp);
-    }
-
-    template<typename Stream>
-    void Unserialize(Stream& s) {
-        ltimestamp = ser_readdata32(s);
-    }
-
-    CTimestampBlockIndexValue (unsigned int time) {
-        ltimestamp = time;
-    }
-
-    CTimestampBlockIndexValue() {
-        SetNull();
-    }
-
-    void SetNull() {
-        ltimestamp = 0;
-    }
-};
-
 struct CAddressUnspentKey {
     unsigned int type;
     uint160 hashBytes;
@@ -379,6 +264,39 @@ struct CAddressIndexIteratorKey {
     }
 };
 
+/** Address balance records are keyed by address type and hash, like the address index iterators. */
+typedef CAddressIndexIteratorKey CAddressBalanceKey;
+
+/** Running totals of an address, so that its balance does not need a scan of its history. */
+struct CAddressBalanceValue {
+    CAmount balance;
+    CAmount received;
+    int64_t txCount;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(balance);
+        READWRITE(received);
+        READWRITE(txCount);
+    }
+
+    CAddressBalanceValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        balance = 0;
+        received = 0;
+        txCount = 0;
+    }
+
+    bool IsNull() const {
+        return balance == 0 && received == 0 && txCount == 0;
+    }
+};
+
 /** Default for DEFAULT_WHITELISTRELAY. */
 static const bool DEFAULT_WHITELISTRELAY = true;
 /** Default for DEFAULT_WHITELISTFORCERELAY. */
@@ -464,6 +382,8 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
+/** Default for -verifyblockindexhashes */
+static const bool DEFAULT_VERIFY_BLOCK_INDEX_HASHES = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
@@ -492,6 +412,8 @@ extern CScript COINBASE_FLAGS;
 extern CCriticalSection cs_main;
 extern CBlockPolicyEstimator feeEstimator;
 extern CTxMemPool mempool;
+/** Addresses used in the last ACTIVE_ADDRESS_WINDOW of blocks, with -addrindex */
+extern CActiveAddresses activeAddresses;
 typedef std::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern BlockMap mapBlockIndex;
 extern uint64_t nLastBlockTx;
@@ -503,7 +425,8 @@ extern std::atomic_bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
-extern bool fAddressIndex;
+/** Enabled by the background address index build from its own thread, see StartAddressIndexer */
+extern std::atomic_bool fAddressIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
@@ -605,6 +528,10 @@ bool LoadChainTip(const CChainParams& chainparams);
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the thread reading ahead the coins of the block being connected */
+void ThreadCoinsPrefetch();
+/** Run an instance of the thread hashing the headers of headers messages */
+void ThreadHeaderHashCheck();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
@@ -630,6 +557,12 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune);
 CBlockIndex * InsertBlockIndex(uint256 hash);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
+/**
+ * Write the block index and the buffered index writes, leaving the chainstate
+ * in memory. Only for the background address index build, whose writes do not
+ * depend on the chainstate.
+ */
+bool FlushIndexesToDisk();
 /** Prune block files and flush state to disk. */
 void PruneAndFlush();
 /** Prune block files up to a given height */
@@ -733,9 +666,34 @@ bool GetAddressIndex(uint160 addressHash, int type,
 
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
 
+/**
+ * Add a block to the address, unspent, spent and balance indexes,
+ * or with fErase take it back out, reading it and its undo data from disk.
+ * For building the indexes apart from ConnectBlock.
+ */
+bool IndexBlockFromDisk(const CBlockIndex* pindex, bool fErase, const Consensus::Params& consensusParams);
+
+/** Fill the window of active addresses from the blocks at the tip of the active chain. Requires cs_main. */
+void LoadActiveAddresses(const CChainParams& chainparams);
+
+/** Current totals of an address from the address index; null if it never appeared in the chain. */
+bool GetAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &value);
+
 bool GetAddressUnspent(uint160 addressHash, int type,
       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
       
+/**
+ * Stream the address index entries of several addresses, in block order,
+ * from height start or just after position (a previous entry's
+ * CIndexDB::GetAddressKeyPosition) until fn returns false.
+ */
+bool ScanAddressIndex(const std::vector<std::pair<uint160, int> > &addresses, int start, const std::string &position,
+                      const std::function<bool(const CAddressIndexKey&, CAmount)> &fn);
+
+/** Same for the unspent outputs of the addresses, in txid order. */
+bool ScanAddressUnspent(const std::vector<std::pair<uint160, int> > &addresses, const std::string &position,
+                        const std::function<bool(const CAddressUnspentKey&, const CAddressUnspentValue&)> &fn);
+
 bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes);
 
 /** Functions for disk access for blocks */
@@ -791,12 +749,18 @@ extern CChain chainActive;
 /** Global variable that points to the coins database (protected by cs_main) */
 extern CCoinsViewDB *pcoinsdbview;
 
+/** Writes pcoinsTip's changes to pcoinsdbview in the background, pcoinsTip's backing view */
+extern CCoinsViewFlusher *pcoinsflusher;
+
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache *pcoinsTip;
 
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
+/** Global variable that points to the explorer index database (protected by cs_main) */
+extern CIndexDB *pindexdb;
+
 /**
  * Return the spend height, which is one more than the inputs.GetBestBlock().
  * While checking, GetBestBlock() refers to the parent block. (protected by cs_main)
@@ -828,4 +792,18 @@ void DumpMempool();
 /** Load the mempool from disk. */
 bool LoadMempool();
 
+/**
+ * Write the UTXO set of the coins database, at its best block, to a
+ * snapshot at path. Fills stats with what was written.
+ */
+bool DumpUTXOSnapshot(CCoinsViewDB* view, const fs::path& path, CCoinsStats& stats);
+
+/**
+ * Fill the empty coins database from the snapshot at path, if the hash of
+ * its UTXO set is hashExpected. The database is then at the snapshot's base
+ * block, which has to be in mapBlockIndex with its data. A database whose
+ * best block is, or descends from, the base block is left as it is.
+ */
+bool LoadUTXOSnapshot(CCoinsViewDB* view, const fs::path& path, const uint256& hashExpected);
+
 #endif // BITCOIN_VALIDATION_H
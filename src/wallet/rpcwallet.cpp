@@ -3,6 +3,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "activeaddresses.h"
 #include "amount.h"
 #include "base58.h"
 #include "chain.h"
@@ -3091,60 +3092,10 @@ UniValue bumpfee(const JSONRPCRequest& request)
 }
 
 UniValue countactiveaddresses(const JSONRPCRequest& request) {
-    auto* pindexBest = chainActive.Tip();
-    if (!fAddressIndex || pindexBest == nullptr) return UniValue(0);
-
-    LOCK(cs_main);
-
-    std::set<uint160> addresses;
-    
-    const auto endTime = pindexBest->nTime - 24 * 60 * 60;
-
-    uint160 premineAddr;
-    int premineType;
-    CBitcoinAddress(Params().GetConsensus().premineAddress).GetIndexKey(premineAddr, premineType);
-
-    CBlock block;
-    CBlockIndex* currentIndex = pindexBest;
-    while (currentIndex != nullptr && currentIndex->nTime > endTime) {
-        if (!ReadBlockFromDisk(block, currentIndex, Params().GetConsensus()))
-            break;
-
-        for (const auto& tx : block.vtx) {
-            for (const auto& in : tx->vin) {
-                CSpentIndexValue spentInfo;
-                CSpentIndexKey spentKey(in.prevout.hash, in.prevout.n);
-                if (!GetSpentIndex(spentKey, spentInfo))
-                    continue;
-
-                addresses.insert(spentInfo.addressHash);
-            }
-            for (const auto& out : tx->vout) {
-                CTxDestination dest;
-                if (!ExtractDestination(out.scriptPubKey, dest))
-                    continue;
-
-                uint160 addr;
-                switch (dest.which()) {
-                    default:
-                        continue;
-                    case 1:
-                        addr = (uint160) boost::get<CKeyID>(dest);
-                        break;
-                    case 2:
-                        addr = (uint160) boost::get<CScriptID>(dest);
-                        break;
-                }
-
-                if (addr != premineAddr)
-                    addresses.insert(addr);
-            }
-        }
-
-        currentIndex = currentIndex->pprev;
-    }
+    if (!fAddressIndex) return UniValue(0);
 
-    return UniValue((uint64_t)addresses.size());
+    // Kept up to date as the tip moves, no need for cs_main
+    return UniValue((uint64_t)activeAddresses.Count());
 }
 
 UniValue countaddresseswithbalance(const JSONRPCRequest& request) {
@@ -3153,7 +3104,7 @@ UniValue countaddresseswithbalance(const JSONRPCRequest& request) {
     LOCK(cs_main);
 
     uint64_t addressCount;
-    if (!pblocktree->ReadAddressCounter(addressCount))
+    if (!pindexdb->ReadAddressCounter(addressCount))
         return UniValue(0);
 
     return UniValue(addressCount);
@@ -3181,7 +3132,7 @@ UniValue averagebalance(const JSONRPCRequest& request) {
     supply += subsidy * (height % halvingInterval);
 
     uint64_t addressCount = 0;
-    pblocktree->ReadAddressCounter(addressCount);
+    pindexdb->ReadAddressCounter(addressCount);
 
     return ValueFromAmount(addressCount > 0 ? supply / addressCount : 0);
 }
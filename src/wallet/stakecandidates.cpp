@@ -0,0 +1,241 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/stakecandidates.h"
+
+#include "checkqueue.h"
+#include "consensus/consensus.h"
+#include "crypto/common.h"
+#include "pos.h"
+#include "util.h"
+
+#include <algorithm>
+#include <limits>
+#include <string.h>
+
+/** Candidates searched per stake kernel check; the queue balances the checks over its threads. */
+static const size_t STAKE_CANDIDATES_PER_CHECK = 1024;
+
+void CStakeCandidates::Prepare(Candidate& candidate, const uint256& hashStakeModifier, const arith_uint256& bnTarget)
+{
+    // Same layout as GetStakeHashProof: modifier, masked block time, txid,
+    // output index, timestamp. The first 64 bytes stop 4 bytes into the txid.
+    unsigned char prefix[64];
+    memcpy(prefix, hashStakeModifier.begin(), 32);
+    WriteLE32(prefix + 32, candidate.nBlockTime & ~STAKE_TIMESTAMP_MASK);
+    memcpy(prefix + 36, candidate.prevout.hash.begin(), 28);
+    candidate.midstate.Reset().Write(prefix, sizeof(prefix));
+
+    candidate.bnWeightedTarget = bnTarget;
+    candidate.bnWeightedTarget *= arith_uint256(candidate.nValue);
+    candidate.fPrepared = true;
+}
+
+void CStakeCandidates::Add(const COutPoint& prevout, CAmount nValue, int nHeight, uint32_t nBlockTime)
+{
+    if (mapIndex.count(prevout))
+        return;
+    // Prepared by the next search, which does not hold the wallet lock
+    Candidate candidate;
+    candidate.prevout = prevout;
+    candidate.nValue = nValue;
+    candidate.nHeight = nHeight;
+    candidate.nBlockTime = nBlockTime;
+    candidate.fPrepared = false;
+    mapIndex.emplace(prevout, vCandidates.size());
+    vCandidates.push_back(candidate);
+}
+
+void CStakeCandidates::Remove(const COutPoint& prevout)
+{
+    auto it = mapIndex.find(prevout);
+    if (it == mapIndex.end())
+        return;
+    size_t nPos = it->second;
+    mapIndex.erase(it);
+    if (nPos != vCandidates.size() - 1) {
+        vCandidates[nPos] = vCandidates.back();
+        mapIndex[vCandidates[nPos].prevout] = nPos;
+    }
+    vCandidates.pop_back();
+}
+
+void CStakeCandidates::Clear()
+{
+    vCandidates.clear();
+    mapIndex.clear();
+    fLoaded = false;
+}
+
+void CStakeCandidates::TakeSnapshot(const uint256& hashStakeModifier, int nPrevHeight, uint32_t nBits, const KernelFilter& filter, Snapshot& snapshot)
+{
+    if (nBits != nTargetBits || hashStakeModifier != hashMidstateModifier) {
+        nTargetBits = nBits;
+        hashMidstateModifier = hashStakeModifier;
+        for (Candidate& candidate : vCandidates) {
+            candidate.fPrepared = false;
+        }
+    }
+
+    snapshot.vCandidates.clear();
+    snapshot.vCandidates.reserve(vCandidates.size());
+    for (const Candidate& candidate : vCandidates) {
+        if (filter(candidate.prevout))
+            snapshot.vCandidates.push_back(candidate);
+    }
+    snapshot.hashStakeModifier = hashStakeModifier;
+    snapshot.nPrevHeight = nPrevHeight;
+    snapshot.nBits = nBits;
+    snapshot.bnTarget.SetCompact(nBits);
+    snapshot.nPrepared = 0;
+}
+
+void CStakeCandidates::KeepPrepared(const Snapshot& snapshot)
+{
+    if (snapshot.nPrepared == 0 || snapshot.nBits != nTargetBits || snapshot.hashStakeModifier != hashMidstateModifier)
+        return;
+    for (const Candidate& prepared : snapshot.vCandidates) {
+        auto it = mapIndex.find(prepared.prevout);
+        if (it == mapIndex.end())
+            continue;
+        Candidate& candidate = vCandidates[it->second];
+        if (!candidate.fPrepared && prepared.fPrepared) {
+            candidate.bnWeightedTarget = prepared.bnWeightedTarget;
+            candidate.midstate = prepared.midstate;
+            candidate.fPrepared = true;
+        }
+    }
+}
+
+void CStakeCandidates::Snapshot::SearchSlice(size_t nBegin, size_t nEnd, uint32_t nFirstSlot, std::atomic<uint32_t>& nLastSlot, SliceResult& result)
+{
+    unsigned char tail[12];
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    uint256 hashProof;
+    for (size_t i = nBegin; i < nEnd; i++) {
+        Candidate& candidate = vCandidates[i];
+        if (nPrevHeight + 1 - candidate.nHeight < COINBASE_MATURITY) {
+            result.stats.nSkippedMaturity++;
+            continue;
+        }
+        // The age only grows with the timestamp, so start at the first slot
+        // where the candidate is old enough.
+        const uint64_t nAged = (uint64_t)candidate.nBlockTime + STAKE_MIN_AGE;
+        const uint64_t nStart = std::max<uint64_t>(nFirstSlot, ((nAged + STAKE_TIMESTAMP_MASK) | STAKE_TIMESTAMP_MASK) - STAKE_TIMESTAMP_MASK);
+        if (nStart > nLastSlot.load(std::memory_order_relaxed)) {
+            result.stats.nSkippedAge++;
+            continue;
+        }
+        if (!candidate.fPrepared) {
+            Prepare(candidate, hashStakeModifier, bnTarget);
+            result.nPrepared++;
+        }
+        memcpy(tail, candidate.prevout.hash.begin() + 28, 4);
+        WriteLE32(tail + 4, candidate.prevout.n);
+        // Slots after the best kernel found so far, by any thread, cannot
+        // improve on it. Equal ones can, with a lower index.
+        for (uint32_t nTime = nStart; nTime <= nLastSlot.load(std::memory_order_relaxed) && nTime >= nStart; nTime += STAKE_TIMESTAMP_MASK + 1) {
+            WriteLE32(tail + 8, nTime);
+            CSHA256(candidate.midstate).Write(tail, sizeof(tail)).Finalize(hash);
+            CSHA256().Write(hash, sizeof(hash)).Finalize(hashProof.begin());
+            result.stats.nKernels++;
+            if (UintToArith256(hashProof) > candidate.bnWeightedTarget)
+                continue;
+            if (nTime < result.nTime || (nTime == result.nTime && i < result.nIndex)) {
+                result.nTime = nTime;
+                result.nIndex = i;
+            }
+            uint32_t nLast = nLastSlot.load();
+            while (nTime < nLast && !nLastSlot.compare_exchange_weak(nLast, nTime)) {}
+            break;
+        }
+    }
+}
+
+/** Searches a slice of a snapshot for the earliest kernel, see CStakeCandidates::Snapshot::FindKernel. */
+class CStakeKernelCheck
+{
+private:
+    CStakeCandidates::Snapshot* pSnapshot;
+    size_t nBegin;
+    size_t nEnd;
+    uint32_t nFirstSlot;
+    std::atomic<uint32_t>* pLastSlot;
+    CStakeCandidates::Snapshot::SliceResult* pResult;
+
+public:
+    CStakeKernelCheck() : pSnapshot(nullptr), nBegin(0), nEnd(0), nFirstSlot(0), pLastSlot(nullptr), pResult(nullptr) {}
+    CStakeKernelCheck(CStakeCandidates::Snapshot* pSnapshotIn, size_t nBeginIn, size_t nEndIn, uint32_t nFirstSlotIn,
+                      std::atomic<uint32_t>* pLastSlotIn, CStakeCandidates::Snapshot::SliceResult* pResultIn) :
+        pSnapshot(pSnapshotIn), nBegin(nBeginIn), nEnd(nEndIn), nFirstSlot(nFirstSlotIn), pLastSlot(pLastSlotIn), pResult(pResultIn) {}
+
+    bool operator()() {
+        pSnapshot->SearchSlice(nBegin, nEnd, nFirstSlot, *pLastSlot, *pResult);
+        return true;
+    }
+
+    void swap(CStakeKernelCheck& check) {
+        std::swap(pSnapshot, check.pSnapshot);
+        std::swap(nBegin, check.nBegin);
+        std::swap(nEnd, check.nEnd);
+        std::swap(nFirstSlot, check.nFirstSlot);
+        std::swap(pLastSlot, check.pLastSlot);
+        std::swap(pResult, check.pResult);
+    }
+};
+
+static CCheckQueue<CStakeKernelCheck> stakekernelqueue(1);
+
+void ThreadStakeKernelSearch() {
+    RenameThread("b2x-stakekernel");
+    stakekernelqueue.Thread();
+}
+
+bool CStakeCandidates::Snapshot::FindKernel(uint32_t nTimeBegin, uint32_t nTimeEnd, COutPoint& prevoutRet, uint32_t& nTimeRet, SearchStats* pstats)
+{
+    const uint32_t nFirstSlot = (nTimeBegin | STAKE_TIMESTAMP_MASK) + 1;
+    if (nTimeEnd < nFirstSlot || nFirstSlot == 0 || vCandidates.empty())
+        return false;
+
+    const size_t nSlices = (vCandidates.size() + STAKE_CANDIDATES_PER_CHECK - 1) / STAKE_CANDIDATES_PER_CHECK;
+    std::atomic<uint32_t> nLastSlot(nTimeEnd);
+    std::vector<SliceResult> vResults(nSlices);
+    for (SliceResult& result : vResults) {
+        result.nTime = std::numeric_limits<uint32_t>::max();
+        result.nIndex = std::numeric_limits<size_t>::max();
+        result.nPrepared = 0;
+    }
+    if (nSlices == 1) {
+        SearchSlice(0, vCandidates.size(), nFirstSlot, nLastSlot, vResults[0]);
+    } else {
+        CCheckQueueControl<CStakeKernelCheck> control(&stakekernelqueue);
+        std::vector<CStakeKernelCheck> vChecks;
+        vChecks.reserve(nSlices);
+        for (size_t nSlice = 0; nSlice < nSlices; nSlice++) {
+            const size_t nBegin = nSlice * STAKE_CANDIDATES_PER_CHECK;
+            const size_t nEnd = std::min(vCandidates.size(), nBegin + STAKE_CANDIDATES_PER_CHECK);
+            vChecks.emplace_back(this, nBegin, nEnd, nFirstSlot, &nLastSlot, &vResults[nSlice]);
+        }
+        control.Add(vChecks);
+        control.Wait();
+    }
+
+    size_t nBest = 0;
+    for (size_t nSlice = 0; nSlice < nSlices; nSlice++) {
+        const SliceResult& result = vResults[nSlice];
+        nPrepared += result.nPrepared;
+        if (pstats) {
+            pstats->nKernels += result.stats.nKernels;
+            pstats->nSkippedMaturity += result.stats.nSkippedMaturity;
+            pstats->nSkippedAge += result.stats.nSkippedAge;
+        }
+        if (result.nTime < vResults[nBest].nTime || (result.nTime == vResults[nBest].nTime && result.nIndex < vResults[nBest].nIndex))
+            nBest = nSlice;
+    }
+    if (vResults[nBest].nIndex == std::numeric_limits<size_t>::max())
+        return false;
+    prevoutRet = vCandidates[vResults[nBest].nIndex].prevout;
+    nTimeRet = vResults[nBest].nTime;
+    return true;
+}
@@ -0,0 +1,145 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_STAKECANDIDATES_H
+#define BITCOIN_WALLET_STAKECANDIDATES_H
+
+#include "amount.h"
+#include "arith_uint256.h"
+#include "coins.h"
+#include "crypto/sha256.h"
+#include "primitives/transaction.h"
+#include "uint256.h"
+
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+class CStakeKernelCheck;
+
+/**
+ * The confirmed wallet outputs that can stake, kept up to date as blocks are
+ * connected and disconnected, so that a staking attempt does not have to walk
+ * the wallet and the UTXO set for every output.
+ *
+ * For the stake modifier of the current tip, each candidate keeps the SHA256
+ * state after the first 64 bytes of its kernel (modifier, block time and most
+ * of the txid). Those bytes do not depend on the timestamp being tried, so one
+ * timestamp costs only the two remaining compressions of the double SHA256.
+ */
+class CStakeCandidates
+{
+private:
+    struct Candidate {
+        COutPoint prevout;
+        CAmount nValue;
+        int nHeight;
+        uint32_t nBlockTime;
+        /** Whether bnWeightedTarget and midstate are for the modifier and target of the table */
+        bool fPrepared;
+        /** nValue times the target */
+        arith_uint256 bnWeightedTarget;
+        /** Kernel hasher over the first 64 bytes, for the modifier */
+        CSHA256 midstate;
+    };
+
+    static void Prepare(Candidate& candidate, const uint256& hashStakeModifier, const arith_uint256& bnTarget);
+
+public:
+    /** Decides whether a candidate may really be spent (not spent in the mempool, not locked, ...). */
+    typedef std::function<bool(const COutPoint&)> KernelFilter;
+
+    /** What one FindKernel call went through. */
+    struct SearchStats {
+        /** Kernel hashes computed */
+        uint64_t nKernels = 0;
+        /** Candidates too shallow to stake on the next block */
+        uint64_t nSkippedMaturity = 0;
+        /** Candidates too young to stake at any of the timestamps searched */
+        uint64_t nSkippedAge = 0;
+    };
+
+    /**
+     * The candidates a filter accepted, copied out of the table along with
+     * the stake modifier, height and target they are searched for, so that
+     * the search does not need the wallet.
+     */
+    class Snapshot
+    {
+    public:
+        Snapshot() : nPrevHeight(0), nBits(0), nPrepared(0) {}
+
+        size_t size() const { return vCandidates.size(); }
+
+        /**
+         * Look for a kernel at every STAKE_TIMESTAMP_MASK-aligned timestamp
+         * in (nTimeBegin, nTimeEnd]. Candidates are subject to the same
+         * depth, age and weighted target rules as CheckProofOfStake. Returns
+         * the earliest timestamp that has a kernel. Large snapshots are split
+         * over the stake kernel threads (see ThreadStakeKernelSearch). If
+         * pstats is given, the work done is added to it.
+         */
+        bool FindKernel(uint32_t nTimeBegin, uint32_t nTimeEnd, COutPoint& prevoutRet, uint32_t& nTimeRet, SearchStats* pstats = nullptr);
+
+    private:
+        friend class CStakeCandidates;
+        friend class CStakeKernelCheck;
+
+        /** The earliest kernel (by timestamp, then index) one slice of the search found, and what it took. */
+        struct SliceResult {
+            uint32_t nTime;
+            size_t nIndex;
+            SearchStats stats;
+            size_t nPrepared;
+        };
+
+        /** Search vCandidates[nBegin, nEnd), preparing the candidates that need it and lowering nLastSlot as kernels are found. */
+        void SearchSlice(size_t nBegin, size_t nEnd, uint32_t nFirstSlot, std::atomic<uint32_t>& nLastSlot, SliceResult& result);
+
+        std::vector<Candidate> vCandidates;
+        uint256 hashStakeModifier;
+        int nPrevHeight;
+        uint32_t nBits;
+        arith_uint256 bnTarget;
+        /** Candidates whose kernel midstate was computed by a search of this snapshot */
+        size_t nPrepared;
+    };
+
+    CStakeCandidates() : fLoaded(false), nTargetBits(0) {}
+
+    void Add(const COutPoint& prevout, CAmount nValue, int nHeight, uint32_t nBlockTime);
+    void Remove(const COutPoint& prevout);
+    void Clear();
+
+    size_t size() const { return vCandidates.size(); }
+    bool Contains(const COutPoint& prevout) const { return mapIndex.count(prevout) != 0; }
+
+    /** Whether the table has been filled from the wallet since it was last cleared. */
+    bool IsLoaded() const { return fLoaded; }
+    void SetLoaded() { fLoaded = true; }
+
+    /**
+     * Copy the candidates accepted by filter into snapshot, to search for the
+     * block after height nPrevHeight. This and KeepPrepared are the only
+     * parts of a staking attempt that need the wallet lock.
+     */
+    void TakeSnapshot(const uint256& hashStakeModifier, int nPrevHeight, uint32_t nBits, const KernelFilter& filter, Snapshot& snapshot);
+    /** Keep the kernel midstates a search of snapshot computed, for the next snapshots with the same modifier. */
+    void KeepPrepared(const Snapshot& snapshot);
+
+private:
+    std::vector<Candidate> vCandidates;
+    std::unordered_map<COutPoint, size_t, SaltedOutpointHasher> mapIndex;
+    bool fLoaded;
+
+    /** The modifier and target fPrepared refers to */
+    uint32_t nTargetBits;
+    uint256 hashMidstateModifier;
+};
+
+/** Run a stake kernel search thread, for Snapshot::FindKernel. */
+void ThreadStakeKernelSearch();
+
+#endif // BITCOIN_WALLET_STAKECANDIDATES_H
@@ -0,0 +1,149 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/stakecandidates.h"
+
+#include "consensus/consensus.h"
+#include "pos.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+
+#include <stdint.h>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(stakecandidates_tests, BasicTestingSetup)
+
+namespace {
+
+struct TestCandidate {
+    COutPoint prevout;
+    CAmount nValue;
+    int nHeight;
+    uint32_t nBlockTime;
+};
+
+/** The earliest slot with a kernel, following CheckProofOfStake one candidate and timestamp at a time. */
+bool FindKernelSlowly(const std::vector<TestCandidate>& candidates, const uint256& hashStakeModifier, int nPrevHeight, uint32_t nBits,
+                      uint32_t nTimeBegin, uint32_t nTimeEnd, const COutPoint* pexclude, uint32_t& nTimeRet)
+{
+    for (uint32_t nTime = (nTimeBegin | STAKE_TIMESTAMP_MASK) + 1; nTime <= nTimeEnd; nTime += STAKE_TIMESTAMP_MASK + 1) {
+        for (const TestCandidate& candidate : candidates) {
+            if (pexclude && candidate.prevout == *pexclude)
+                continue;
+            if (nPrevHeight + 1 - candidate.nHeight < COINBASE_MATURITY)
+                continue;
+            if (nTime - candidate.nBlockTime < STAKE_MIN_AGE)
+                continue;
+            arith_uint256 bnTarget;
+            bnTarget.SetCompact(nBits);
+            bnTarget *= arith_uint256(candidate.nValue);
+            uint256 hashProof = GetStakeHashProof(candidate.prevout, nTime, candidate.nBlockTime & ~STAKE_TIMESTAMP_MASK, hashStakeModifier);
+            if (UintToArith256(hashProof) <= bnTarget) {
+                nTimeRet = nTime;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(find_kernel_matches_check_proof_of_stake)
+{
+    const int nPrevHeight = 1000;
+    const uint32_t nNow = 1500000000;
+    // A target of about 2^232 per satoshi, so that the candidates below
+    // find a kernel every few hundred hashes.
+    const uint32_t nBits = 0x1e00ffff;
+
+    std::vector<TestCandidate> candidates;
+    CStakeCandidates table;
+    for (int i = 0; i < 3000; i++) {
+        TestCandidate candidate;
+        candidate.prevout = COutPoint(InsecureRand256(), InsecureRandRange(4));
+        candidate.nValue = 10000 + InsecureRandRange(40000);
+        // Some too young or too shallow to stake
+        candidate.nHeight = nPrevHeight - InsecureRandRange(2 * COINBASE_MATURITY);
+        candidate.nBlockTime = nNow - InsecureRandRange(2 * STAKE_MIN_AGE);
+        candidates.push_back(candidate);
+        table.Add(candidate.prevout, candidate.nValue, candidate.nHeight, candidate.nBlockTime);
+    }
+    BOOST_CHECK_EQUAL(table.size(), candidates.size());
+
+    // Search on the calling thread alone, then with three kernel threads next to it.
+    boost::thread_group threadGroup;
+    auto acceptAll = [](const COutPoint&) { return true; };
+    for (int round = 0; round < 4; round++) {
+        const uint256 hashStakeModifier = InsecureRand256();
+        const uint32_t nTimeBegin = nNow + round * 1000;
+        const uint32_t nTimeEnd = nTimeBegin + 1000;
+        if (round == 2) {
+            for (int i = 0; i < 3; i++) {
+                threadGroup.create_thread(&ThreadStakeKernelSearch);
+            }
+        }
+
+        uint32_t nExpectedTime = 0;
+        bool fExpected = FindKernelSlowly(candidates, hashStakeModifier, nPrevHeight, nBits, nTimeBegin, nTimeEnd, nullptr, nExpectedTime);
+        CStakeCandidates::Snapshot snapshot;
+        table.TakeSnapshot(hashStakeModifier, nPrevHeight, nBits, acceptAll, snapshot);
+        BOOST_CHECK_EQUAL(snapshot.size(), table.size());
+        COutPoint prevout;
+        uint32_t nTime = 0;
+        BOOST_CHECK_EQUAL(snapshot.FindKernel(nTimeBegin, nTimeEnd, prevout, nTime), fExpected);
+        table.KeepPrepared(snapshot);
+        if (!fExpected)
+            continue;
+        BOOST_CHECK_EQUAL(nTime, nExpectedTime);
+        BOOST_CHECK_EQUAL(nTime & STAKE_TIMESTAMP_MASK, 0U);
+
+        // A new snapshot, with the midstates kept in the table, finds the very same kernel.
+        CStakeCandidates::Snapshot snapshotKept;
+        table.TakeSnapshot(hashStakeModifier, nPrevHeight, nBits, acceptAll, snapshotKept);
+        COutPoint prevoutKept;
+        uint32_t nTimeKept = 0;
+        BOOST_CHECK(snapshotKept.FindKernel(nTimeBegin, nTimeEnd, prevoutKept, nTimeKept));
+        BOOST_CHECK(prevoutKept == prevout);
+        BOOST_CHECK_EQUAL(nTimeKept, nTime);
+
+        // The kernel found checks out on its own.
+        const TestCandidate* pkernel = nullptr;
+        for (const TestCandidate& candidate : candidates) {
+            if (candidate.prevout == prevout)
+                pkernel = &candidate;
+        }
+        BOOST_REQUIRE(pkernel);
+        std::vector<TestCandidate> single(1, *pkernel);
+        uint32_t nSingleTime = 0;
+        BOOST_CHECK(FindKernelSlowly(single, hashStakeModifier, nPrevHeight, nBits, nTime - 1, nTime, nullptr, nSingleTime));
+
+        // A filtered out kernel is left out of the snapshot, in favour of the next one.
+        auto rejectKernel = [&prevout](const COutPoint& out) { return out != prevout; };
+        fExpected = FindKernelSlowly(candidates, hashStakeModifier, nPrevHeight, nBits, nTimeBegin, nTimeEnd, &prevout, nExpectedTime);
+        CStakeCandidates::Snapshot snapshotFiltered;
+        table.TakeSnapshot(hashStakeModifier, nPrevHeight, nBits, rejectKernel, snapshotFiltered);
+        BOOST_CHECK_EQUAL(snapshotFiltered.size(), table.size() - 1);
+        COutPoint prevoutNext;
+        BOOST_CHECK_EQUAL(snapshotFiltered.FindKernel(nTimeBegin, nTimeEnd, prevoutNext, nTime), fExpected);
+        if (fExpected)
+            BOOST_CHECK_EQUAL(nTime, nExpectedTime);
+    }
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    // Removing keeps the rest of the table intact.
+    for (size_t i = 0; i < candidates.size(); i += 2) {
+        table.Remove(candidates[i].prevout);
+    }
+    BOOST_CHECK_EQUAL(table.size(), candidates.size() / 2);
+    for (size_t i = 0; i < candidates.size(); i++) {
+        BOOST_CHECK_EQUAL(table.Contains(candidates[i].prevout), i % 2 == 1);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
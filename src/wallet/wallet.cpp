@@ -1337,6 +1337,7 @@ void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const
     for (size_t i = 0; i < pblock->vtx.size(); i++) {
         SyncTransaction(pblock->vtx[i], pindex, i);
     }
+    UpdateStakeCandidates(*pblock, pindex);
 }
 
 void CWallet::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock) {
@@ -1345,6 +1346,7 @@ void CWallet::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock) {
     for (const CTransactionRef& ptx : pblock->vtx) {
         SyncTransaction(ptx, nullptr, -1);
     }
+    UpdateStakeCandidates(*pblock, nullptr);
 }
 
 
@@ -1729,6 +1731,8 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool f
         }
         ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
 
+        // Transactions found by the rescan did not go through BlockConnected
+        stakeCandidates.Clear();
         fScanningWallet = false;
     }
     return ret;
@@ -3225,18 +3229,149 @@ uint64_t CWallet::GetStakeWeight() const
     return nWeight;
 }
 
-bool CWallet::CreateCoinStake(const CKeyStore& keystore, uint32_t nBits, uint32_t nStakeTime, CMutableTransaction& tx, CKey& key)
+bool CWallet::IsStakeCandidateSpent(const COutPoint& prevout) const
 {
-    CBlockIndex* pindexPrev = chainActive.Tip();
-    arith_uint256 bnTargetPerCoinDay;
-    bnTargetPerCoinDay.SetCompact(nBits);
+    std::pair<TxSpends::const_iterator, TxSpends::const_iterator> range = mapTxSpends.equal_range(prevout);
+    for (TxSpends::const_iterator it = range.first; it != range.second; ++it) {
+        std::map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(it->second);
+        if (mit != mapWallet.end() && mit->second.GetDepthInMainChain() > 0)
+            return true;
+    }
+    return false;
+}
+
+void CWallet::AddStakeCandidate(const CWalletTx& wtx, unsigned int n, const CBlockIndex* pindex)
+{
+    const CTxOut& txout = wtx.tx->vout[n];
+    if (!(IsMine(txout) & ISMINE_SPENDABLE))
+        return;
+    COutPoint prevout(wtx.GetHash(), n);
+    if (IsStakeCandidateSpent(prevout))
+        return;
+    stakeCandidates.Add(prevout, txout.nValue, pindex->nHeight, pindex->nTime);
+}
+
+void CWallet::LoadStakeCandidates()
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    stakeCandidates.Clear();
+    for (const std::pair<const uint256, CWalletTx>& item : mapWallet) {
+        const CWalletTx& wtx = item.second;
+        if (wtx.hashUnset())
+            continue;
+        BlockMap::const_iterator mi = mapBlockIndex.find(wtx.hashBlock);
+        if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second))
+            continue;
+        for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+            AddStakeCandidate(wtx, i, mi->second);
+        }
+    }
+    stakeCandidates.SetLoaded();
+    LogPrint(BCLog::STAKE, "%s: %u stake candidates\n", __func__, stakeCandidates.size());
+}
+
+void CWallet::UpdateStakeCandidates(const CBlock& block, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_wallet);
+
+    if (!stakeCandidates.IsLoaded())
+        return;
+
+    if (pindex) {
+        for (const CTransactionRef& ptx : block.vtx) {
+            if (!ptx->IsCoinBase()) {
+                for (const CTxIn& txin : ptx->vin) {
+                    stakeCandidates.Remove(txin.prevout);
+                }
+            }
+            std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(ptx->GetHash());
+            if (mi == mapWallet.end())
+                continue;
+            for (unsigned int i = 0; i < ptx->vout.size(); i++) {
+                AddStakeCandidate(mi->second, i, pindex);
+            }
+        }
+    } else {
+        for (auto it = block.vtx.rbegin(); it != block.vtx.rend(); ++it) {
+            const CTransaction& tx = **it;
+            for (unsigned int i = 0; i < tx.vout.size(); i++) {
+                stakeCandidates.Remove(COutPoint(tx.GetHash(), i));
+            }
+            if (tx.IsCoinBase())
+                continue;
+            // The outputs this transaction spent can stake again if they are
+            // still confirmed.
+            for (const CTxIn& txin : tx.vin) {
+                std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(txin.prevout.hash);
+                if (mi == mapWallet.end() || mi->second.hashUnset() || txin.prevout.n >= mi->second.tx->vout.size())
+                    continue;
+                BlockMap::const_iterator bi = mapBlockIndex.find(mi->second.hashBlock);
+                if (bi == mapBlockIndex.end() || !chainActive.Contains(bi->second))
+                    continue;
+                AddStakeCandidate(mi->second, txin.prevout.n, bi->second);
+            }
+        }
+    }
+}
 
+bool CWallet::CreateCoinStake(const CKeyStore& keystore, uint32_t nBits, uint32_t nSearchFrom, uint32_t& nStakeTime, CMutableTransaction& tx, CKey& key)
+{
     tx.vin.clear();
     tx.vout.clear();
 
     // Mark coin stake transaction
     tx.nVersion = CTransaction::POS_TX_VERSION;
 
+    // The outputs that can stake right now, as of the current tip
+    auto filter = [this](const COutPoint& prevout) {
+        std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(prevout.hash);
+        return mi != mapWallet.end() && mi->second.GetBlocksToMaturity() == 0 &&
+               !IsSpent(prevout.hash, prevout.n) && !IsLockedCoin(prevout.hash, prevout.n);
+    };
+    CStakeCandidates::Snapshot snapshot;
+    const CBlockIndex* pindexPrev;
+    {
+        LOCK2(cs_main, cs_wallet);
+        if (!stakeCandidates.IsLoaded())
+            LoadStakeCandidates();
+        pindexPrev = chainActive.Tip();
+        stakeCandidates.TakeSnapshot(pindexPrev->bnStakeModifierV2, pindexPrev->nHeight, nBits, filter, snapshot);
+    }
+
+    // Find a kernel among them, for every timestamp slot since the last
+    // search at once, without holding the locks
+    COutPoint prevoutKernel;
+    uint32_t nKernelTime;
+    CStakeCandidates::SearchStats stats;
+    const int64_t nSearchStart = GetTimeMicros();
+    const bool fFound = snapshot.FindKernel(nSearchFrom, nStakeTime, prevoutKernel, nKernelTime, &stats);
+    stakingStats.nSearches++;
+    stakingStats.nSearchMicros += GetTimeMicros() - nSearchStart;
+    stakingStats.nKernels += stats.nKernels;
+    stakingStats.nSkippedMaturity += stats.nSkippedMaturity;
+    stakingStats.nSkippedAge += stats.nSkippedAge;
+
+    {
+        LOCK2(cs_main, cs_wallet);
+        stakeCandidates.KeepPrepared(snapshot);
+        if (!fFound) {
+            LogPrint(BCLog::STAKE, "%s: No kernel found among %u stake candidates\n", __func__, snapshot.size());
+            return false;
+        }
+        // The wallet and the chain may have moved on during the search
+        if (chainActive.Tip() != pindexPrev) {
+            LogPrint(BCLog::STAKE, "%s: Tip changed during the kernel search\n", __func__);
+            return false;
+        }
+        if (!filter(prevoutKernel)) {
+            LogPrint(BCLog::STAKE, "%s: Kernel %s spent or locked during the search\n", __func__, prevoutKernel.ToString());
+            return false;
+        }
+    }
+    nStakeTime = nKernelTime;
+
     // Choose coins to use
     CAmount nBalance = GetBalance();
 
@@ -3256,43 +3391,30 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, uint32_t nBits, uint32_
         LogPrint(BCLog::STAKE, "%s: Failed to select coins for staking\n", __func__);
         return false;
     }
-        
-
-    if (setCoins.empty())
-        return false;
 
     int64_t nCredit = 0;
     CScript scriptPubKeyKernel;
-    for (auto pcoin : setCoins) {
-        boost::this_thread::interruption_point();
-        // Search backward in time from the given txNew timestamp
-        // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
-        COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
-        if (!CheckProofOfStake(pcoinsTip, pindexPrev->bnStakeModifierV2, pindexPrev->nHeight, nBits, nStakeTime, prevoutStake)) {
-            LogPrint(BCLog::STAKE, "%s: Failed to check kernel\n", __func__);
-            continue;
-        }
-
-        // Found a kernel
+    {
+        const CWalletTx* pcoin = &mapWallet[prevoutKernel.hash];
         LogPrint(BCLog::STAKE, "%s: Kernel found\n", __func__);
         std::vector<std::vector<unsigned char> > vSolutions;
         txnouttype whichType;
         CScript scriptPubKeyOut;
-        scriptPubKeyKernel = pcoin.first->tx->vout[pcoin.second].scriptPubKey;
+        scriptPubKeyKernel = pcoin->tx->vout[prevoutKernel.n].scriptPubKey;
         if (!Solver(scriptPubKeyKernel, whichType, vSolutions)) {
             LogPrint(BCLog::STAKE, "%s: Failed to parse kernel\n", __func__);
-            continue;
+            return false;
         }
         LogPrint(BCLog::STAKE, "%s: CreateCoinStake : parsed kernel type=%d\n", __func__, whichType);
         if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH) {
             LogPrint(BCLog::STAKE, "%s: CreateCoinStake : no support for kernel type=%d\n", __func__, whichType);
-            continue;  // only support pay to public key and pay to address
+            return false;  // only support pay to public key and pay to address
         }
         if (whichType == TX_PUBKEYHASH) {
             // convert to pay to public key type
             if (!keystore.GetKey(uint160(vSolutions[0]), key)) {
                 LogPrint(BCLog::STAKE, "%s: CreateCoinStake : failed to get key for kernel type=%d\n", __func__, whichType);
-                continue;  // unable to find corresponding public key
+                return false;  // unable to find corresponding public key
             }
             scriptPubKeyOut << key.GetPubKey().getvch() << OP_CHECKSIG;
         }
@@ -3300,21 +3422,20 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, uint32_t nBits, uint32_
             auto vchPubKey = vSolutions[0];
             if (!keystore.GetKey(Hash160(vchPubKey), key)) {
                 LogPrint(BCLog::STAKE, "%s: CreateCoinStake : failed to get key for kernel type=%d\n", __func__, whichType);
-                continue;  // unable to find corresponding public key
+                return false;  // unable to find corresponding public key
             }
             if (key.GetPubKey() != vchPubKey) {
                 LogPrint(BCLog::STAKE, "%s: CreateCoinStake : failed to get key for kernel type=%d\n", __func__, whichType);
-                continue; // keys mismatch
+                return false; // keys mismatch
             }
             scriptPubKeyOut = scriptPubKeyKernel;
         }
 
-        tx.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
-        nCredit += pcoin.first->tx->vout[pcoin.second].nValue;
-        vwtxPrev.push_back(pcoin.first);
+        tx.vin.push_back(CTxIn(prevoutKernel));
+        nCredit += pcoin->tx->vout[prevoutKernel.n].nValue;
+        vwtxPrev.push_back(pcoin);
         tx.vout.push_back(CTxOut(0, scriptPubKeyOut));
         LogPrint(BCLog::STAKE, "%s: CreateCoinStake : added kernel type=%d\n", __func__, whichType);
-        break;
     }
 
     if (nCredit == 0 || nCredit > nBalance - nReserveBalance)
@@ -4263,6 +4384,7 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     strUsage += HelpMessageOpt("-rescan", _("Rescan the block chain for missing wallet transactions on startup"));
     strUsage += HelpMessageOpt("-salvagewallet", _("Attempt to recover private keys from a corrupt wallet on startup"));
     strUsage += HelpMessageOpt("-spendzeroconfchange", strprintf(_("Spend unconfirmed change when sending transactions (default: %u)"), DEFAULT_SPEND_ZEROCONF_CHANGE));
+    strUsage += HelpMessageOpt("-stakethreads=<n>", strprintf(_("Set the number of threads that search for stake kernels, <= 0 for one per core (default: %d)"), DEFAULT_STAKE_THREADS));
     strUsage += HelpMessageOpt("-txconfirmtarget=<n>", strprintf(_("If paytxfee is not set, include enough fee so transactions begin confirmation on average within n blocks (default: %u)"), DEFAULT_TX_CONFIRM_TARGET));
     strUsage += HelpMessageOpt("-usehd", _("Use hierarchical deterministic key generation (HD) after BIP32. Only has effect during wallet creation/first start") + " " + strprintf(_("(default: %u)"), DEFAULT_USE_HD_WALLET));
     strUsage += HelpMessageOpt("-walletrbf", strprintf(_("Send transactions with full-RBF opt-in enabled (default: %u)"), DEFAULT_WALLET_RBF));
@@ -18,6 +18,7 @@
 #include "wallet/crypter.h"
 #include "wallet/walletdb.h"
 #include "wallet/rpcwallet.h"
+#include "wallet/stakecandidates.h"
 #include "pos.h"
 
 #include <algorithm>
@@ -662,6 +663,15 @@ private:
     std::atomic<bool> fScanningWallet;
 
     bool SelectCoinsForStaking(CAmount& nTargetValue, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
+
+    /** Confirmed outputs that can stake, filled on the first staking attempt. Guarded by cs_wallet. */
+    CStakeCandidates stakeCandidates;
+    /** Whether a transaction confirmed in the active chain spends prevout. Mempool spends are checked when a kernel is found. */
+    bool IsStakeCandidateSpent(const COutPoint& prevout) const;
+    void AddStakeCandidate(const CWalletTx& wtx, unsigned int n, const CBlockIndex* pindex);
+    void LoadStakeCandidates();
+    /** Apply a block connected at pindex, or disconnected if pindex is null, to stakeCandidates. */
+    void UpdateStakeCandidates(const CBlock& block, const CBlockIndex* pindex);
     /**
      * Select a set of coins such that nValueRet >= nTargetValue and at least
      * all coins from coinControl are selected; Never select unconfirmed coins
@@ -964,7 +974,12 @@ public:
     bool CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey, CConnman* connman, CValidationState& state);
 
     uint64_t GetStakeWeight() const;
-    bool CreateCoinStake(const CKeyStore &keystore, uint32_t nBits, uint32_t nStakeTime, CMutableTransaction& tx, CKey& key);
+    /**
+     * Look for a kernel at the timestamp slots in (nSearchFrom, nStakeTime] and
+     * build the coinstake spending it. On success nStakeTime is set to the
+     * timestamp of the kernel, which the block has to use.
+     */
+    bool CreateCoinStake(const CKeyStore &keystore, uint32_t nBits, uint32_t nSearchFrom, uint32_t& nStakeTime, CMutableTransaction& tx, CKey& key);
 
 
     void ListAccountCreditDebit(const std::string& strAccount, std::list<CAccountingEntry>& entries);
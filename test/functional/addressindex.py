@@ -99,6 +99,23 @@ class AddressIndexTest(BitcoinTestFramework):
         assert_equal(multitxids[4], txid2)
         assert_equal(multitxids[5], txidb2)
 
+        # Check that paging through multiple addresses returns the same txids
+        print ("Testing pagination...")
+        paged_txids = []
+        cursor = None
+        while True:
+            query = {"addresses": ["2N2JD6wb56AfK4tfmM6PwdVmoYk2dCKf4Br", "mo9ncXisMeAoXwqcV5EWuyncbmCcQN4rVs"], "limit": 4}
+            if cursor is not None:
+                query["cursor"] = cursor
+            page = self.nodes[1].getaddresstxids(query)
+            assert(len(page["txids"]) <= 4)
+            paged_txids += page["txids"]
+            cursor = page["cursor"]
+            if cursor is None:
+                break
+        assert_equal(paged_txids, multitxids)
+        assert_raises_rpc_error(-8, "Invalid cursor", self.nodes[1].getaddresstxids, {"addresses": ["mo9ncXisMeAoXwqcV5EWuyncbmCcQN4rVs"], "cursor": "00"})
+
         # Check that balances are correct
         balance0 = self.nodes[1].getaddressbalance("2N2JD6wb56AfK4tfmM6PwdVmoYk2dCKf4Br")
         assert_equal(balance0["balance"], 45 * 100000000)
@@ -163,6 +180,27 @@ class AddressIndexTest(BitcoinTestFramework):
 
         balance2 = self.nodes[1].getaddressbalance(address2)
         assert_equal(balance2["balance"], change_amount)
+        assert_equal(balance2["received"], amount + change_amount)
+        assert_equal(balance2["txcount"], 2)
+
+        # A transaction involving two of the addresses is counted once
+        balance_p2sh = self.nodes[1].getaddressbalance("2N2JD6wb56AfK4tfmM6PwdVmoYk2dCKf4Br")
+        balance_both = self.nodes[1].getaddressbalance({"addresses": [address2, "2N2JD6wb56AfK4tfmM6PwdVmoYk2dCKf4Br"]})
+        assert_equal(balance_both["balance"], balance2["balance"] + balance_p2sh["balance"])
+        assert_equal(balance_both["txcount"], balance2["txcount"] + balance_p2sh["txcount"] - 1)
+
+        # Check that balances are rolled back with the block
+        print ("Testing balances after reorg...")
+        tip = self.nodes[1].getbestblockhash()
+        self.nodes[1].invalidateblock(tip)
+        balance2 = self.nodes[1].getaddressbalance(address2)
+        assert_equal(balance2["balance"], amount)
+        assert_equal(balance2["received"], amount)
+        assert_equal(balance2["txcount"], 1)
+        self.nodes[1].reconsiderblock(tip)
+        balance2 = self.nodes[1].getaddressbalance(address2)
+        assert_equal(balance2["balance"], change_amount)
+        assert_equal(balance2["txcount"], 2)
 
         # Check that deltas are returned correctly
         deltas = self.nodes[1].getaddressdeltas({"addresses": [address2], "start": 1, "end": 200})
@@ -187,8 +225,26 @@ class AddressIndexTest(BitcoinTestFramework):
         assert_equal(len(utxos), 1)
         assert_equal(utxos[0]["satoshis"], change_amount)
 
+        # Check that enabling the index on an existing node builds it in the background
+        print ("Testing background index build...")
+        self.stop_node(0)
+        self.start_node(0, ["-addrindex"])
+        connect_nodes(self.nodes[0], 1)
+        wait_until(lambda: self.index_synced(0))
+        assert_equal(self.nodes[0].getaddresstxids({"addresses": ["2N2JD6wb56AfK4tfmM6PwdVmoYk2dCKf4Br", "mo9ncXisMeAoXwqcV5EWuyncbmCcQN4rVs"]}), multitxids)
+        assert_equal(self.nodes[0].getaddressbalance(address2), self.nodes[1].getaddressbalance(address2))
+        assert_equal(self.nodes[0].getaddressutxos({"addresses": [address2]}), utxos)
+
         print ("Passed\n")
 
+    def index_synced(self, node):
+        try:
+            self.nodes[node].getaddresstxids("mo9ncXisMeAoXwqcV5EWuyncbmCcQN4rVs")
+            return True
+        except JSONRPCException as e:
+            assert_equal(e.error["code"], -28)
+            return False
+
 
 if __name__ == '__main__':
     AddressIndexTest().main()
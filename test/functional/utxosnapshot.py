@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+# Copyright (c) 2017 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test dumptxoutset and starting a chain state with -loadutxosnapshot.
+
+- Dump the UTXO set of node0 at its tip.
+- Restart node1, which has the same blocks, with -reindex-chainstate and the
+  snapshot. Its UTXO set must be node0's, and it must keep syncing from there.
+- Check that a snapshot with another hash is refused, and that one the chain
+  state is already past is ignored.
+"""
+import os
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+    connect_nodes_bi,
+    sync_blocks,
+)
+
+class UTXOSnapshotTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+
+    def run_test(self):
+        node0, node1 = self.nodes
+        node0.generate(5)
+        sync_blocks(self.nodes)
+
+        self.log.info("Dump the UTXO set of node0")
+        res = node0.dumptxoutset("utxo.dat")
+        stats = node0.gettxoutsetinfo()
+        path = os.path.join(self.options.tmpdir, "node0", "regtest", "utxo.dat")
+        assert_equal(res['path'], path)
+        assert_equal(res['coins_written'], stats['txouts'])
+        assert_equal(res['base_hash'], stats['bestblock'])
+        assert_equal(res['base_height'], 205)
+        assert_equal(res['hash_serialized_2'], stats['hash_serialized_2'])
+        assert_raises_rpc_error(-8, "already exists", node0.dumptxoutset, "utxo.dat")
+
+        self.log.info("Refuse a snapshot with another hash")
+        self.stop_node(1)
+        self.assert_start_raises_init_error(1, ["-reindex-chainstate", "-loadutxosnapshot=" + path, "-utxosnapshothash=" + "00" * 32], "Error loading the UTXO snapshot")
+        self.assert_start_raises_init_error(1, ["-loadutxosnapshot=" + path], "-loadutxosnapshot requires the hash of the snapshot")
+
+        self.log.info("Start node1 from the snapshot")
+        self.start_node(1, ["-reindex-chainstate", "-loadutxosnapshot=" + path, "-utxosnapshothash=" + res['hash_serialized_2']])
+        assert_equal(node1.getbestblockhash(), res['base_hash'])
+        stats1 = node1.gettxoutsetinfo()
+        assert_equal(stats1['txouts'], stats['txouts'])
+        assert_equal(stats1['hash_serialized_2'], stats['hash_serialized_2'])
+
+        self.log.info("Keep syncing on top of the snapshot")
+        connect_nodes_bi(self.nodes, 0, 1)
+        node0.generate(5)
+        sync_blocks(self.nodes)
+        assert_equal(node1.gettxoutsetinfo()['hash_serialized_2'], node0.gettxoutsetinfo()['hash_serialized_2'])
+
+        self.log.info("Ignore a snapshot that the chain state is already past")
+        tip = node1.getbestblockhash()
+        stats1 = node1.gettxoutsetinfo()
+        self.stop_node(1)
+        self.start_node(1, ["-loadutxosnapshot=" + path, "-utxosnapshothash=" + res['hash_serialized_2']])
+        assert_equal(node1.getbestblockhash(), tip)
+        assert_equal(node1.gettxoutsetinfo()['hash_serialized_2'], stats1['hash_serialized_2'])
+
+if __name__ == '__main__':
+    UTXOSnapshotTest().main()